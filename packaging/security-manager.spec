@@ -90,6 +90,8 @@ mkdir -p %{buildroot}/%{_unitdir}/sockets.target.wants
 ln -s ../security-manager.socket %{buildroot}/%{_unitdir}/sockets.target.wants/security-manager.socket
 ln -s ../security-manager-master.socket %{buildroot}/%{_unitdir}/sockets.target.wants/security-manager-master.socket
 ln -s ../security-manager-slave.socket %{buildroot}/%{_unitdir}/sockets.target.wants/security-manager-slave.socket
+mkdir -p %{buildroot}/%{_unitdir}/basic.target.wants
+ln -s ../security-manager-rules-loader.service %{buildroot}/%{_unitdir}/basic.target.wants/security-manager-rules-loader.service
 
 %clean
 rm -rf %{buildroot}
@@ -144,6 +146,8 @@ fi
 %attr(-,root,root) %{_unitdir}/sockets.target.wants/security-manager.*
 %attr(-,root,root) %{_unitdir}/sockets.target.wants/security-manager-master.*
 %attr(-,root,root) %{_unitdir}/sockets.target.wants/security-manager-slave.*
+%attr(-,root,root) %{_unitdir}/security-manager-rules-loader.service
+%attr(-,root,root) %{_unitdir}/basic.target.wants/security-manager-rules-loader.service
 %config(noreplace) %attr(0600,root,root) %{TZ_SYS_DB}/.security-manager.db
 %config(noreplace) %attr(0600,root,root) %{TZ_SYS_DB}/.security-manager.db-journal
 %{_datadir}/license/%{name}
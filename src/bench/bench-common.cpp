@@ -0,0 +1,109 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        bench-common.cpp
+ * @author      Rafal Krypa <r.krypa@samsung.com>
+ * @version     1.0
+ * @brief       Command line handling and scratch files shared by benchmarks
+ */
+
+#include <errno.h>
+#include <ftw.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+
+#include <dpl/exception.h>
+#include <dpl/log/log.h>
+#include <dpl/singleton.h>
+#include <dpl/singleton_safe_impl.h>
+
+#include "bench-common.h"
+
+IMPLEMENT_SAFE_SINGLETON(SecurityManager::Log::LogSystem);
+
+namespace SecurityManager {
+namespace Bench {
+
+namespace {
+
+int removeEntry(const char *path, const struct stat *, int, struct FTW *)
+{
+    if (remove(path) == -1)
+        std::cerr << "Cannot remove " << path << ": " << strerror(errno) << std::endl;
+    return 0;
+}
+
+} // namespace anonymous
+
+void throwErrno(const std::string &what)
+{
+    throw std::runtime_error(what + ": " + strerror(errno));
+}
+
+void removeTree(const std::string &path)
+{
+    nftw(path.c_str(), removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+ScratchDir::ScratchDir(const std::string &parent)
+    : m_path(parent + "/security-manager-bench-XXXXXX")
+{
+    if (mkdtemp(&m_path[0]) == nullptr)
+        throwErrno("Cannot create directory in " + parent);
+}
+
+ScratchDir::~ScratchDir()
+{
+    removeTree(m_path);
+}
+
+int run(int argc, char *argv[], po::options_description &options,
+    const std::function<int(const po::variables_map &)> &bench)
+{
+    options.add_options()
+        ("help,h", "Print this help message")
+        ;
+
+    try {
+        SecurityManager::Singleton<SecurityManager::Log::LogSystem>::Instance().SetTag(
+            "SECURITY_MANAGER_BENCH");
+
+        po::variables_map vm;
+        po::store(po::parse_command_line(argc, argv, options), vm);
+        if (vm.count("help")) {
+            std::cout << options << std::endl;
+            return EXIT_SUCCESS;
+        }
+        po::notify(vm);
+
+        return bench(vm);
+    } catch (const SecurityManager::Exception &e) {
+        std::cerr << "Error: " << e.DumpToString() << std::endl;
+    } catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+    }
+    return EXIT_FAILURE;
+}
+
+} // namespace Bench
+} // namespace SecurityManager
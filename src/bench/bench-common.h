@@ -0,0 +1,92 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        bench-common.h
+ * @author      Rafal Krypa <r.krypa@samsung.com>
+ * @version     1.0
+ * @brief       Command line handling and scratch files shared by benchmarks
+ */
+
+#ifndef _SECURITY_MANAGER_BENCH_COMMON_
+#define _SECURITY_MANAGER_BENCH_COMMON_
+
+#include <functional>
+#include <string>
+
+#include <boost/program_options.hpp>
+
+#include <dpl/noncopyable.h>
+
+namespace SecurityManager {
+namespace Bench {
+
+namespace po = boost::program_options;
+
+/**
+ * Throw std::runtime_error describing current errno.
+ *
+ * @param[in] what - description of the failed operation
+ */
+void throwErrno(const std::string &what);
+
+/**
+ * Remove a file or directory tree, without following links.
+ * Errors are reported on standard error.
+ *
+ * @param[in] path - root of the tree
+ */
+void removeTree(const std::string &path);
+
+/*
+ * Uniquely named directory for files of a benchmark, removed with all its
+ * contents when the object is destroyed.
+ */
+class ScratchDir : private Noncopyable
+{
+public:
+    /**
+     * @param[in] parent - directory to create the scratch directory in
+     * @throws std::runtime_error
+     */
+    explicit ScratchDir(const std::string &parent);
+    ~ScratchDir();
+
+    const std::string &path() const { return m_path; }
+
+private:
+    std::string m_path;
+};
+
+/**
+ * Entry point of a benchmark: set up logging, parse command line with
+ * given options and --help, then call the benchmark. Usage is printed
+ * for --help. Errors thrown by the benchmark are reported on standard
+ * error.
+ *
+ * @param[in] argc, argv - arguments of main()
+ * @param[in] options - options of the benchmark, --help is added to them
+ * @param[in] bench - the benchmark, returning exit code of the program
+ * @return exit code of the program
+ */
+int run(int argc, char *argv[], po::options_description &options,
+    const std::function<int(const po::variables_map &)> &bench);
+
+} // namespace Bench
+} // namespace SecurityManager
+
+#endif /* _SECURITY_MANAGER_BENCH_COMMON_ */
@@ -0,0 +1,212 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        cynara-bench.cpp
+ * @author      Rafal Krypa <r.krypa@samsung.com>
+ * @version     1.0
+ * @brief       Check of in-memory Cynara policy evaluator against Cynara
+ *              administrative checks, with timing of both
+ *
+ * Keys are built from clients, users and privileges found in security-manager
+ * buckets. Each key is resolved from PRIVACY_MANAGER and MAIN buckets by
+ * CynaraAdminPolicyEvaluator and by cynara_admin_check. Policies are only
+ * read, so the check can be run on a device with installed applications.
+ * With --local-apps the check runs against in-memory policies of synthetic
+ * applications instead, without Cynara service.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <cynara.h>
+#include "bench-common.h"
+#include "cynara-local-backend.h"
+
+namespace po = boost::program_options;
+
+using namespace SecurityManager;
+
+namespace {
+
+typedef std::tuple<std::string, std::string, std::string> Key;
+
+/* Policies of synthetic applications, shaped like those set on installation */
+void populateLocalPolicies(size_t apps)
+{
+    const size_t PRIVILEGES = 32, APP_PRIVILEGES = 8;
+    const std::vector<std::string> users = {"5001", "5002"};
+
+    for (const auto &user : users)
+        CynaraAdmin::getInstance().UserInit(static_cast<uid_t>(std::stoul(user)),
+            SM_USER_TYPE_NORMAL);
+
+    CynaraAdminPolicyBatch policies;
+    for (size_t i = 0; i < apps; ++i) {
+        std::string label = "User::Pkg::bench_app_" + std::to_string(i);
+        for (const auto &user : users) {
+            for (size_t j = 0; j < APP_PRIVILEGES; ++j) {
+                std::string privilege = "http://tizen.org/privilege/bench." +
+                    std::to_string((i + j * 3) % PRIVILEGES);
+                policies.add(label, user, privilege, CYNARA_ADMIN_ALLOW,
+                    CynaraAdmin::Buckets.at(Bucket::MANIFESTS));
+                // Some privileges are revoked by the user or the admin
+                if ((i + j) % 7 == 0)
+                    policies.add(label, user, privilege, CYNARA_ADMIN_DENY,
+                        CynaraAdmin::Buckets.at(Bucket::PRIVACY_MANAGER));
+                if ((i + j) % 11 == 0)
+                    policies.add(label, CYNARA_ADMIN_WILDCARD, privilege, CYNARA_ADMIN_DENY,
+                        CynaraAdmin::Buckets.at(Bucket::ADMIN));
+            }
+        }
+    }
+    CynaraAdmin::getInstance().SetPolicies(policies);
+}
+
+/* Take every n-th value, so that at most limit of them are left */
+std::vector<std::string> sample(const std::set<std::string> &values, size_t limit)
+{
+    std::vector<std::string> result;
+    size_t step = values.size() > limit ? (values.size() + limit - 1) / limit : 1;
+    size_t i = 0;
+    for (const auto &value : values)
+        if (i++ % step == 0)
+            result.push_back(value);
+    return result;
+}
+
+std::vector<Key> collectKeys(size_t limit)
+{
+    std::set<std::string> clients, users, privileges;
+
+    for (const auto &bucket : CynaraAdmin::Buckets) {
+        std::vector<CynaraAdminPolicy> policies;
+        CynaraAdmin::getInstance().ListPolicies(bucket.second,
+            CYNARA_ADMIN_ANY, CYNARA_ADMIN_ANY, CYNARA_ADMIN_ANY, policies);
+
+        for (const auto &policy : policies) {
+            if (std::string(policy.client) != CYNARA_ADMIN_WILDCARD)
+                clients.insert(policy.client);
+            if (std::string(policy.user) != CYNARA_ADMIN_WILDCARD)
+                users.insert(policy.user);
+            if (std::string(policy.privilege) != CYNARA_ADMIN_WILDCARD)
+                privileges.insert(policy.privilege);
+        }
+    }
+
+    // Keys matched only by wildcards and bucket defaults
+    clients.insert("User::Pkg::bench_unknown");
+    users.insert("65533");
+    privileges.insert("http://tizen.org/privilege/bench.unknown");
+
+    std::cout << "Found " << clients.size() << " clients, " << users.size() <<
+        " users, " << privileges.size() << " privileges" << std::endl;
+
+    // Spread the limit over the three dimensions, users are the fewest
+    size_t userLimit = std::min<size_t>(users.size(), 8);
+    size_t rest = std::max<size_t>(1, limit / userLimit);
+    size_t clientLimit = 1;
+    while ((clientLimit + 1) * (clientLimit + 1) <= rest)
+        ++clientLimit;
+
+    std::vector<Key> keys;
+    for (const auto &client : sample(clients, clientLimit))
+        for (const auto &user : sample(users, userLimit))
+            for (const auto &privilege : sample(privileges, rest / clientLimit))
+                keys.emplace_back(client, user, privilege);
+    return keys;
+}
+
+bool compare(const std::vector<Key> &keys, const std::string &bucket)
+{
+    std::vector<int> expected, actual;
+    expected.reserve(keys.size());
+    actual.reserve(keys.size());
+
+    auto start = std::chrono::steady_clock::now();
+    for (const auto &key : keys) {
+        int result;
+        std::string resultExtra;
+        CynaraAdmin::getInstance().Check(std::get<0>(key), std::get<1>(key),
+            std::get<2>(key), bucket, result, resultExtra, true);
+        expected.push_back(result);
+    }
+    auto adminTime = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    CynaraAdminPolicyEvaluator evaluator;
+    for (const auto &key : keys)
+        actual.push_back(evaluator.Check(std::get<0>(key), std::get<1>(key),
+            std::get<2>(key), bucket));
+    auto evaluatorTime = std::chrono::steady_clock::now() - start;
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (expected[i] == actual[i])
+            continue;
+        if (++mismatches <= 10)
+            std::cout << "  MISMATCH " << std::get<0>(keys[i]) << " " <<
+                std::get<1>(keys[i]) << " " << std::get<2>(keys[i]) <<
+                ": cynara_admin_check " << expected[i] << ", evaluator " <<
+                actual[i] << std::endl;
+    }
+
+    auto ms = [](std::chrono::steady_clock::duration d) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(d).count() / 1000.0;
+    };
+    std::cout << bucket << ": " << keys.size() << " keys, " << mismatches <<
+        " mismatches, cynara_admin_check " << ms(adminTime) << " ms, evaluator " <<
+        ms(evaluatorTime) << " ms (including listing of buckets)" << std::endl;
+
+    return mismatches == 0;
+}
+
+} // namespace anonymous
+
+int main(int argc, char *argv[])
+{
+    size_t maxKeys = 2000;
+    size_t localApps = 0;
+    po::options_description optDesc("Allowed options");
+    optDesc.add_options()
+        ("max-keys,k", po::value<size_t>(&maxKeys), "Approximate number of checked keys")
+        ("local-apps,l", po::value<size_t>(&localApps),
+            "Check in-memory policies of given number of synthetic applications "
+            "instead of Cynara service")
+        ;
+
+    return Bench::run(argc, argv, optDesc, [&](const po::variables_map &) {
+        if (localApps > 0) {
+            auto backend = std::make_shared<CynaraLocalBackend>();
+            backend->setupDefaultBuckets();
+            CynaraAdmin::setBackend(backend);
+            populateLocalPolicies(localApps);
+        }
+
+        std::vector<Key> keys = collectKeys(maxKeys);
+        bool ok = compare(keys, CynaraAdmin::Buckets.at(Bucket::PRIVACY_MANAGER));
+        ok = compare(keys, CynaraAdmin::Buckets.at(Bucket::MAIN)) && ok;
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    });
+}
@@ -0,0 +1,423 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        cynara-local-backend.cpp
+ * @author      Rafal Krypa <r.krypa@samsung.com>
+ * @version     1.0
+ * @brief       In-process stand-in for Cynara service, for benchmarks
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <dpl/log/log.h>
+
+#include "cynara-local-backend.h"
+
+namespace SecurityManager {
+
+namespace {
+
+/* Allocate C string the way libcynara does, so that callers can free() it */
+char *dupString(const std::string &str)
+{
+    return strdup(str.c_str());
+}
+
+template <typename T>
+T **allocNullTerminated(size_t count)
+{
+    return static_cast<T **>(calloc(count + 1, sizeof(T *)));
+}
+
+} // namespace anonymous
+
+CynaraLocalBackend::CynaraLocalBackend()
+    : m_latency(0)
+    , m_jitter(0)
+{
+}
+
+void CynaraLocalBackend::setLatency(std::chrono::microseconds latency,
+    std::chrono::microseconds jitter, unsigned int seed)
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    m_latency = latency;
+    m_jitter = jitter;
+    m_random.seed(seed);
+}
+
+void CynaraLocalBackend::setBucket(const std::string &bucket, int defaultResult)
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    m_buckets[bucket].defaultResult = defaultResult;
+}
+
+void CynaraLocalBackend::setupDefaultBuckets()
+{
+    static const struct {
+        const char *name;
+        int defaultResult;
+        const char *link;
+    } buckets[] = {
+        {CYNARA_ADMIN_DEFAULT_BUCKET, CYNARA_ADMIN_DENY, "MAIN"},
+        {"ADMIN", CYNARA_ADMIN_NONE, nullptr},
+        {"MAIN", CYNARA_ADMIN_DENY, "MANIFESTS"},
+        {"MANIFESTS", CYNARA_ADMIN_DENY, nullptr},
+        {"USER_TYPE_ADMIN", CYNARA_ADMIN_DENY, "ADMIN"},
+        {"USER_TYPE_NORMAL", CYNARA_ADMIN_DENY, "ADMIN"},
+        {"USER_TYPE_GUEST", CYNARA_ADMIN_DENY, "ADMIN"},
+        {"USER_TYPE_SYSTEM", CYNARA_ADMIN_DENY, "ADMIN"},
+    };
+
+    std::lock_guard<std::mutex> guard(m_mutex);
+    const PolicyKey any(CYNARA_ADMIN_WILDCARD, CYNARA_ADMIN_WILDCARD, CYNARA_ADMIN_WILDCARD);
+
+    for (const auto &bucket : buckets)
+        m_buckets[bucket.name].defaultResult = bucket.defaultResult;
+
+    for (const auto &bucket : buckets)
+        if (bucket.link)
+            m_buckets[bucket.name].policies[any] = {CYNARA_ADMIN_BUCKET, bucket.link};
+
+    // Non-application programs get access to all privileges
+    for (const char *client : {"User", "System"})
+        m_buckets["MANIFESTS"].policies[PolicyKey(client, CYNARA_ADMIN_WILDCARD,
+            CYNARA_ADMIN_WILDCARD)] = {CYNARA_ADMIN_ALLOW, ""};
+}
+
+bool CynaraLocalBackend::filterMatches(const std::string &filter, const std::string &value)
+{
+    return filter == CYNARA_ADMIN_ANY || filter == value;
+}
+
+void CynaraLocalBackend::simulateLatency()
+{
+    std::chrono::microseconds delay;
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        delay = m_latency;
+        if (m_jitter.count() > 0)
+            delay += std::chrono::microseconds(std::uniform_int_distribution<long long>(
+                0, m_jitter.count())(m_random));
+    }
+
+    if (delay.count() > 0)
+        std::this_thread::sleep_for(delay);
+}
+
+CynaraLocalBackend::PolicyResult CynaraLocalBackend::resolve(const Bucket &bucket,
+    const PolicyKey &key, bool recursive, unsigned depth)
+{
+    if (depth > MAX_DEPTH) {
+        LogError("Cynara bucket links nested too deeply");
+        return {CYNARA_ADMIN_DENY, ""};
+    }
+
+    const std::string wildcard(CYNARA_ADMIN_WILDCARD);
+    bool hasMinimal = false;
+    PolicyResult minimal = {bucket.defaultResult, ""};
+
+    for (int i = 0; i < 8; ++i) {
+        PolicyKey candidate(
+            (i & 4) ? wildcard : std::get<0>(key),
+            (i & 2) ? wildcard : std::get<1>(key),
+            (i & 1) ? wildcard : std::get<2>(key));
+
+        auto it = bucket.policies.find(candidate);
+        if (it == bucket.policies.end())
+            continue;
+
+        PolicyResult result = it->second;
+        if (result.result == CYNARA_ADMIN_DENY)
+            return result;
+
+        if (result.result == CYNARA_ADMIN_BUCKET) {
+            if (!recursive)
+                continue;
+            auto linked = m_buckets.find(result.extra);
+            if (linked == m_buckets.end())
+                continue;
+            result = resolve(linked->second, key, recursive, depth + 1);
+            if (result.result == CYNARA_ADMIN_NONE)
+                continue;
+        }
+
+        if (!hasMinimal || result.result < minimal.result) {
+            minimal = result;
+            hasMinimal = true;
+        }
+    }
+
+    return minimal;
+}
+
+int CynaraLocalBackend::setPolicies(const struct cynara_admin_policy *const *policies)
+{
+    if (!policies)
+        return CYNARA_API_INVALID_PARAM;
+
+    simulateLatency();
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    // Validate all policies first, so that nothing is applied on error
+    for (size_t i = 0; policies[i] != nullptr; ++i) {
+        const struct cynara_admin_policy *policy = policies[i];
+        if (!policy->bucket || !policy->client || !policy->user || !policy->privilege)
+            return CYNARA_API_INVALID_PARAM;
+
+        switch (policy->result) {
+        case CYNARA_ADMIN_DELETE:
+        case CYNARA_ADMIN_DENY:
+        case CYNARA_ADMIN_ALLOW:
+            break;
+        case CYNARA_ADMIN_BUCKET:
+            if (!policy->result_extra)
+                return CYNARA_API_INVALID_PARAM;
+            if (m_buckets.find(policy->result_extra) == m_buckets.end())
+                return CYNARA_API_BUCKET_NOT_FOUND;
+            break;
+        default:
+            return CYNARA_API_INVALID_PARAM;
+        }
+
+        if (m_buckets.find(policy->bucket) == m_buckets.end())
+            return CYNARA_API_BUCKET_NOT_FOUND;
+    }
+
+    for (size_t i = 0; policies[i] != nullptr; ++i) {
+        const struct cynara_admin_policy *policy = policies[i];
+        auto &bucketPolicies = m_buckets[policy->bucket].policies;
+        PolicyKey key(policy->client, policy->user, policy->privilege);
+
+        if (policy->result == CYNARA_ADMIN_DELETE)
+            bucketPolicies.erase(key);
+        else
+            bucketPolicies[key] = {policy->result,
+                policy->result_extra ? policy->result_extra : ""};
+    }
+
+    return CYNARA_API_SUCCESS;
+}
+
+int CynaraLocalBackend::listPolicies(const char *bucket, const char *client,
+    const char *user, const char *privilege, struct cynara_admin_policy ***policies)
+{
+    if (!bucket || !client || !user || !privilege || !policies)
+        return CYNARA_API_INVALID_PARAM;
+
+    simulateLatency();
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    auto bucketIt = m_buckets.find(bucket);
+    if (bucketIt == m_buckets.end())
+        return CYNARA_API_BUCKET_NOT_FOUND;
+
+    std::vector<std::pair<const PolicyKey *, const PolicyResult *>> matching;
+    for (const auto &policy : bucketIt->second.policies)
+        if (filterMatches(client, std::get<0>(policy.first)) &&
+            filterMatches(user, std::get<1>(policy.first)) &&
+            filterMatches(privilege, std::get<2>(policy.first)))
+            matching.emplace_back(&policy.first, &policy.second);
+
+    auto result = allocNullTerminated<struct cynara_admin_policy>(matching.size());
+    if (!result)
+        return CYNARA_API_OUT_OF_MEMORY;
+
+    for (size_t i = 0; i < matching.size(); ++i) {
+        auto policy = static_cast<struct cynara_admin_policy *>(
+            calloc(1, sizeof(struct cynara_admin_policy)));
+        result[i] = policy;
+        if (policy) {
+            policy->bucket = dupString(bucket);
+            policy->client = dupString(std::get<0>(*matching[i].first));
+            policy->user = dupString(std::get<1>(*matching[i].first));
+            policy->privilege = dupString(std::get<2>(*matching[i].first));
+            policy->result = matching[i].second->result;
+            if (!matching[i].second->extra.empty())
+                policy->result_extra = dupString(matching[i].second->extra);
+        }
+
+        if (!policy || !policy->bucket || !policy->client || !policy->user ||
+            !policy->privilege ||
+            (!matching[i].second->extra.empty() && !policy->result_extra)) {
+            for (size_t j = 0; j <= i; ++j) {
+                if (!result[j])
+                    continue;
+                free(result[j]->bucket);
+                free(result[j]->client);
+                free(result[j]->user);
+                free(result[j]->privilege);
+                free(result[j]->result_extra);
+                free(result[j]);
+            }
+            free(result);
+            return CYNARA_API_OUT_OF_MEMORY;
+        }
+    }
+
+    *policies = result;
+    return CYNARA_API_SUCCESS;
+}
+
+int CynaraLocalBackend::erase(const char *startBucket, int recursive, const char *client,
+    const char *user, const char *privilege)
+{
+    if (!startBucket || !client || !user || !privilege)
+        return CYNARA_API_INVALID_PARAM;
+
+    simulateLatency();
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    if (m_buckets.find(startBucket) == m_buckets.end())
+        return CYNARA_API_BUCKET_NOT_FOUND;
+
+    // Collect buckets to clean before erasing links to them
+    std::set<std::string> buckets;
+    std::vector<std::string> toVisit = {startBucket};
+    while (!toVisit.empty()) {
+        std::string name = std::move(toVisit.back());
+        toVisit.pop_back();
+        if (!buckets.insert(name).second)
+            continue;
+
+        auto bucketIt = m_buckets.find(name);
+        if (!recursive || bucketIt == m_buckets.end())
+            continue;
+
+        for (const auto &policy : bucketIt->second.policies)
+            if (policy.second.result == CYNARA_ADMIN_BUCKET)
+                toVisit.push_back(policy.second.extra);
+    }
+
+    for (const auto &name : buckets) {
+        auto bucketIt = m_buckets.find(name);
+        if (bucketIt == m_buckets.end())
+            continue;
+
+        auto &policies = bucketIt->second.policies;
+        for (auto it = policies.begin(); it != policies.end();) {
+            if (filterMatches(client, std::get<0>(it->first)) &&
+                filterMatches(user, std::get<1>(it->first)) &&
+                filterMatches(privilege, std::get<2>(it->first)))
+                it = policies.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    return CYNARA_API_SUCCESS;
+}
+
+int CynaraLocalBackend::check(const char *startBucket, int recursive, const char *client,
+    const char *user, const char *privilege, int *result, char **resultExtra)
+{
+    if (!startBucket || !client || !user || !privilege || !result || !resultExtra)
+        return CYNARA_API_INVALID_PARAM;
+
+    simulateLatency();
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    auto bucketIt = m_buckets.find(startBucket);
+    if (bucketIt == m_buckets.end())
+        return CYNARA_API_BUCKET_NOT_FOUND;
+
+    PolicyResult policy = resolve(bucketIt->second, PolicyKey(client, user, privilege),
+        recursive, 0);
+
+    *resultExtra = nullptr;
+    if (!policy.extra.empty()) {
+        *resultExtra = dupString(policy.extra);
+        if (!*resultExtra)
+            return CYNARA_API_OUT_OF_MEMORY;
+    }
+    *result = policy.result;
+
+    return CYNARA_API_SUCCESS;
+}
+
+int CynaraLocalBackend::listPoliciesDescriptions(
+    struct cynara_admin_policy_descr ***descriptions)
+{
+    static const struct {
+        int result;
+        const char *name;
+    } predefined[] = {
+        {CYNARA_ADMIN_DENY, "Deny"},
+        {CYNARA_ADMIN_ALLOW, "Allow"},
+    };
+    const size_t count = sizeof(predefined) / sizeof(predefined[0]);
+
+    if (!descriptions)
+        return CYNARA_API_INVALID_PARAM;
+
+    simulateLatency();
+
+    auto result = allocNullTerminated<struct cynara_admin_policy_descr>(count);
+    if (!result)
+        return CYNARA_API_OUT_OF_MEMORY;
+
+    for (size_t i = 0; i < count; ++i) {
+        auto descr = static_cast<struct cynara_admin_policy_descr *>(
+            malloc(sizeof(struct cynara_admin_policy_descr)));
+        char *name = descr ? strdup(predefined[i].name) : nullptr;
+        if (!name) {
+            free(descr);
+            for (size_t j = 0; j < i; ++j) {
+                free(result[j]->name);
+                free(result[j]);
+            }
+            free(result);
+            return CYNARA_API_OUT_OF_MEMORY;
+        }
+
+        descr->result = predefined[i].result;
+        descr->name = name;
+        result[i] = descr;
+    }
+
+    *descriptions = result;
+    return CYNARA_API_SUCCESS;
+}
+
+int CynaraLocalBackend::checkAccess(const char *client, const char *session,
+    const char *user, const char *privilege)
+{
+    (void) session;
+
+    if (!client || !user || !privilege)
+        return CYNARA_API_INVALID_PARAM;
+
+    simulateLatency();
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    auto bucketIt = m_buckets.find(CYNARA_ADMIN_DEFAULT_BUCKET);
+    if (bucketIt == m_buckets.end())
+        return CYNARA_API_ACCESS_DENIED;
+
+    PolicyResult policy = resolve(bucketIt->second, PolicyKey(client, user, privilege),
+        true, 0);
+
+    return policy.result == CYNARA_ADMIN_ALLOW ?
+        CYNARA_API_ACCESS_ALLOWED : CYNARA_API_ACCESS_DENIED;
+}
+
+} // namespace SecurityManager
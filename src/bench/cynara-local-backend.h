@@ -0,0 +1,118 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        cynara-local-backend.h
+ * @author      Rafal Krypa <r.krypa@samsung.com>
+ * @version     1.0
+ * @brief       In-process stand-in for Cynara service, for benchmarks
+ */
+
+#ifndef _SECURITY_MANAGER_CYNARA_LOCAL_BACKEND_
+#define _SECURITY_MANAGER_CYNARA_LOCAL_BACKEND_
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <tuple>
+
+#include "cynara-backend.h"
+
+namespace SecurityManager {
+
+/*
+ * In-process stand-in for Cynara service, so that benchmarks and debug builds
+ * of the daemon can run without external services. Implements buckets with default
+ * policies, wildcard matching, bucket links and Cynara rules of choosing
+ * the minimal result. Plugins are not supported: only predefined policy types
+ * are known and anything other than ALLOW is denied on access check.
+ * Every call can be delayed by fixed latency and pseudo-random jitter,
+ * generated from a given seed for repeatable runs.
+ * Policies are kept in memory only.
+ */
+class CynaraLocalBackend : public CynaraAdminBackend, public CynaraClientBackend
+{
+public:
+    CynaraLocalBackend();
+
+    /**
+     * Delay each call by latency plus random value from [0, jitter].
+     */
+    void setLatency(std::chrono::microseconds latency, std::chrono::microseconds jitter,
+        unsigned int seed = 0);
+
+    /**
+     * Create bucket or change default policy of existing one.
+     */
+    void setBucket(const std::string &bucket, int defaultResult);
+
+    /**
+     * Create buckets and links between them, as done by
+     * security-manager-policy-reload for the real service.
+     */
+    void setupDefaultBuckets();
+
+    virtual int setPolicies(const struct cynara_admin_policy *const *policies);
+
+    virtual int listPolicies(const char *bucket, const char *client, const char *user,
+        const char *privilege, struct cynara_admin_policy ***policies);
+
+    virtual int erase(const char *startBucket, int recursive, const char *client,
+        const char *user, const char *privilege);
+
+    virtual int check(const char *startBucket, int recursive, const char *client,
+        const char *user, const char *privilege, int *result, char **resultExtra);
+
+    virtual int listPoliciesDescriptions(struct cynara_admin_policy_descr ***descriptions);
+
+    virtual int checkAccess(const char *client, const char *session, const char *user,
+        const char *privilege);
+
+private:
+    typedef std::tuple<std::string, std::string, std::string> PolicyKey;
+
+    struct PolicyResult {
+        int result;
+        std::string extra;
+    };
+
+    struct Bucket {
+        int defaultResult;
+        std::map<PolicyKey, PolicyResult> policies;
+    };
+
+    static bool filterMatches(const std::string &filter, const std::string &value);
+
+    void simulateLatency();
+
+    PolicyResult resolve(const Bucket &bucket, const PolicyKey &key, bool recursive,
+        unsigned depth);
+
+    static const unsigned MAX_DEPTH = 16;
+
+    std::mutex m_mutex;
+    std::map<std::string, Bucket> m_buckets;
+    std::chrono::microseconds m_latency;
+    std::chrono::microseconds m_jitter;
+    std::mt19937 m_random;
+};
+
+} // namespace SecurityManager
+
+#endif // _SECURITY_MANAGER_CYNARA_LOCAL_BACKEND_
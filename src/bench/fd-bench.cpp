@@ -0,0 +1,159 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        fd-bench.cpp
+ * @author      Rafal Krypa <r.krypa@samsung.com>
+ * @version     1.0
+ * @brief       Timing of socket descriptor enumeration done before relabeling
+ *
+ * The process opens the requested numbers of descriptors, half of them
+ * sockets, and finds the sockets with getSocketFds() of the client library
+ * and with the readdir() based scan it replaced.
+ */
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include <client-socket-fds.h>
+#include <security-manager.h>
+#include "bench-common.h"
+
+namespace po = boost::program_options;
+
+using namespace SecurityManager;
+using Bench::throwErrno;
+
+namespace {
+
+/* Scan of /proc/self/fd as it was done before getSocketFds() */
+int readdirSocketFds(std::vector<int> &fds)
+{
+    DIR *dir = opendir("/proc/self/fd");
+    if (dir == nullptr)
+        return SECURITY_MANAGER_ERROR_UNKNOWN;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        if (!isdigit(entry->d_name[0]))
+            continue;
+
+        int fd = atoi(entry->d_name);
+        struct stat statBuf;
+        if (fstat(fd, &statBuf) == 0 && S_ISSOCK(statBuf.st_mode))
+            fds.push_back(fd);
+    }
+
+    closedir(dir);
+    return SECURITY_MANAGER_SUCCESS;
+}
+
+double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* Average time of one scan in microseconds */
+double timeScan(int (*scan)(std::vector<int> &), size_t iterations, std::vector<int> &fds)
+{
+    double start = now();
+    for (size_t i = 0; i < iterations; ++i) {
+        fds.clear();
+        if (scan(fds) != SECURITY_MANAGER_SUCCESS)
+            throw std::runtime_error("Scan of open descriptors failed");
+    }
+    return (now() - start) / iterations;
+}
+
+/* Open pairs of sockets and files, alternately, until count descriptors are open */
+void openDescriptors(size_t count, size_t &opened)
+{
+    while (opened < count) {
+        if ((opened / 2) % 2) {
+            int sv[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) == -1)
+                throwErrno("socketpair");
+            opened += 2;
+        } else {
+            if (open("/dev/null", O_RDONLY | O_CLOEXEC) == -1)
+                throwErrno("open");
+            ++opened;
+        }
+    }
+}
+
+} // namespace anonymous
+
+int main(int argc, char *argv[])
+{
+    std::vector<size_t> counts;
+    size_t iterations = 2000;
+    po::options_description optDesc("Allowed options");
+    optDesc.add_options()
+        ("fds,f", po::value<std::vector<size_t>>(&counts)->multitoken(),
+            "Numbers of open descriptors (default: 10 100 1000)")
+        ("iterations,i", po::value<size_t>(&iterations), "Number of scans timed")
+        ;
+
+    return Bench::run(argc, argv, optDesc, [&](const po::variables_map &) {
+        if (counts.empty())
+            counts = {10, 100, 1000};
+        std::sort(counts.begin(), counts.end());
+        iterations = std::max<size_t>(iterations, 1);
+
+        struct rlimit limit;
+        if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < counts.back() + 16) {
+            limit.rlim_cur = std::min<rlim_t>(limit.rlim_max, counts.back() + 16);
+            setrlimit(RLIMIT_NOFILE, &limit);
+        }
+
+        // Standard streams are open already
+        size_t opened = 3;
+        bool ok = true;
+        for (size_t count : counts) {
+            openDescriptors(count, opened);
+
+            std::vector<int> expected, actual;
+            double readdirTime = timeScan(readdirSocketFds, iterations, expected);
+            double getdentsTime = timeScan(getSocketFds, iterations, actual);
+
+            std::cout << opened << " descriptors, " << actual.size() << " sockets: readdir " <<
+                readdirTime << " us, getSocketFds " << getdentsTime << " us" << std::endl;
+            if (expected != actual) {
+                std::cout << "  MISMATCH: readdir found " << expected.size() << " sockets" <<
+                    std::endl;
+                ok = false;
+            }
+        }
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    });
+}
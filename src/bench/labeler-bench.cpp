@@ -0,0 +1,156 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        labeler-bench.cpp
+ * @author      Rafal Krypa <r.krypa@samsung.com>
+ * @version     1.0
+ * @brief       Timing of Smack labeling of synthetic application trees
+ *
+ * For each requested size a tree of regular files, some of them executable,
+ * is created in a scratch directory and labeled three times: from scratch,
+ * again with attributes read back and compared, and again with a manifest
+ * of the first run. Numbers of attributes read and written are reported
+ * with the times. Setting security.* attributes requires privileges of
+ * security-manager.
+ */
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <smack-labeler.h>
+#include "bench-common.h"
+
+namespace po = boost::program_options;
+
+using namespace SecurityManager;
+using Bench::throwErrno;
+
+namespace {
+
+const size_t FILES_PER_DIR = 64;
+const size_t DIRS_PER_DIR = 16;
+
+void makeDir(const std::string &path)
+{
+    if (mkdir(path.c_str(), 0755) == -1)
+        throwErrno("Cannot create " + path);
+}
+
+/* Files in directories of FILES_PER_DIR, grouped by DIRS_PER_DIR, every 8th executable */
+void createTree(const std::string &root, size_t files)
+{
+    makeDir(root);
+
+    std::string dir;
+    for (size_t i = 0; i < files; ++i) {
+        size_t leaf = i / FILES_PER_DIR;
+        if (i % FILES_PER_DIR == 0) {
+            std::string parent = root + "/d" + std::to_string(leaf / DIRS_PER_DIR);
+            if (leaf % DIRS_PER_DIR == 0)
+                makeDir(parent);
+            dir = parent + "/d" + std::to_string(leaf % DIRS_PER_DIR);
+            makeDir(dir);
+        }
+
+        std::string path = dir + "/f" + std::to_string(i);
+        int fd = open(path.c_str(), O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC,
+            i % 8 == 0 ? 0755 : 0644);
+        if (fd == -1)
+            throwErrno("Cannot create " + path);
+        close(fd);
+    }
+}
+
+void runLabeler(const std::string &name, const std::string &root,
+    const SmackLabeler::Attributes &attributes, unsigned threads,
+    const std::string &manifest)
+{
+    SmackLabeler labeler(attributes, threads);
+    if (!manifest.empty())
+        labeler.setManifest(manifest);
+
+    auto start = std::chrono::steady_clock::now();
+    labeler.label(root);
+    auto time = std::chrono::steady_clock::now() - start;
+
+    SmackLabeler::Stats stats = labeler.getStats();
+    std::cout << "  " << name << ": " <<
+        std::chrono::duration_cast<std::chrono::microseconds>(time).count() / 1000.0 <<
+        " ms, visited " << stats.visited << ", written " << stats.written <<
+        ", skipped " << stats.skipped << ", getxattr " << stats.attrReads << ", setxattr " <<
+        stats.attrWrites << std::endl;
+}
+
+void benchTree(const std::string &scratch, size_t files,
+    const SmackLabeler::Attributes &attributes, unsigned threads)
+{
+    std::string root = scratch + "/tree-" + std::to_string(files);
+    std::string manifest = scratch + "/manifest-" + std::to_string(files);
+
+    std::cout << files << " files:" << std::endl;
+    try {
+        createTree(root, files);
+        runLabeler("initial", root, attributes, threads, manifest);
+        runLabeler("relabel, attributes compared", root, attributes, threads, std::string());
+        runLabeler("relabel, manifest", root, attributes, threads, manifest);
+    } catch (...) {
+        Bench::removeTree(root);
+        unlink(manifest.c_str());
+        throw;
+    }
+    Bench::removeTree(root);
+    unlink(manifest.c_str());
+}
+
+} // namespace anonymous
+
+int main(int argc, char *argv[])
+{
+    std::vector<size_t> sizes;
+    std::string dir = "/tmp";
+    std::string label = "User::Pkg::bench";
+    unsigned threads = SmackLabeler::MAX_THREADS;
+    po::options_description optDesc("Allowed options");
+    optDesc.add_options()
+        ("files,f", po::value<std::vector<size_t>>(&sizes)->multitoken(),
+            "Numbers of files in labeled trees (default: 1000 10000 100000)")
+        ("dir,d", po::value<std::string>(&dir), "Directory for the trees (default: /tmp)")
+        ("label,l", po::value<std::string>(&label), "Smack label to set")
+        ("threads,t", po::value<unsigned>(&threads), "Maximum number of labeling threads")
+        ("io-uring,u", "Write attributes with io_uring, if supported")
+        ;
+
+    return Bench::run(argc, argv, optDesc, [&](const po::variables_map &vm) {
+        if (sizes.empty())
+            sizes = {1000, 10000, 100000};
+        if (vm.count("io-uring"))
+            SmackLabeler::setBackend(SmackLabeler::Backend::IO_URING);
+
+        Bench::ScratchDir scratch(dir);
+        for (size_t files : sizes)
+            benchTree(scratch.path(), files, {label, true, true}, threads);
+        return EXIT_SUCCESS;
+    });
+}
@@ -0,0 +1,151 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        launch-bench.cpp
+ * @author      Rafal Krypa <r.krypa@samsung.com>
+ * @version     1.0
+ * @brief       Timing of application launch preparation in forked children
+ *
+ * Acts as a launcher of an installed application: forks children that
+ * prepare the application and report how long it took. Launches are timed
+ * with security_manager_prepare_app() and with a launch bundle fetched
+ * before fork and applied in the child. Must be run with privileges of
+ * a launcher, against running security-manager.
+ */
+
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <security-manager.h>
+#include "bench-common.h"
+
+namespace po = boost::program_options;
+
+using namespace SecurityManager;
+using Bench::throwErrno;
+
+namespace {
+
+struct Result {
+    int ret;
+    long us;
+};
+
+long now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Prepare the application in a child, as a launcher would */
+Result launch(const std::function<int()> &prepare)
+{
+    int fds[2];
+    if (pipe(fds) == -1)
+        throwErrno("pipe");
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        close(fds[0]);
+        close(fds[1]);
+        throwErrno("fork");
+    }
+
+    if (pid == 0) {
+        close(fds[0]);
+        Result result;
+        long start = now();
+        result.ret = prepare();
+        result.us = now() - start;
+        ssize_t written = write(fds[1], &result, sizeof(result));
+        _exit(written == sizeof(result) ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    close(fds[1]);
+    Result result = {SECURITY_MANAGER_ERROR_UNKNOWN, 0};
+    if (TEMP_FAILURE_RETRY(read(fds[0], &result, sizeof(result))) != sizeof(result))
+        result.ret = SECURITY_MANAGER_ERROR_UNKNOWN;
+    close(fds[0]);
+    TEMP_FAILURE_RETRY(waitpid(pid, nullptr, 0));
+    return result;
+}
+
+void report(const std::string &name, const std::function<int()> &prepare, size_t launches)
+{
+    std::vector<long> times;
+    size_t failed = 0;
+    for (size_t i = 0; i < launches; ++i) {
+        Result result = launch(prepare);
+        if (result.ret == SECURITY_MANAGER_SUCCESS)
+            times.push_back(result.us);
+        else
+            ++failed;
+    }
+
+    std::cout << name << ": " << times.size() << " launches, " << failed << " failed";
+    if (!times.empty()) {
+        std::sort(times.begin(), times.end());
+        std::cout << ", min " << times.front() << " us, median " << times[times.size() / 2] <<
+            " us, 95th percentile " << times[times.size() * 95 / 100] << " us, max " <<
+            times.back() << " us";
+    }
+    std::cout << std::endl;
+}
+
+} // namespace anonymous
+
+int main(int argc, char *argv[])
+{
+    std::string appId;
+    size_t launches = 100;
+    po::options_description optDesc("Allowed options");
+    optDesc.add_options()
+        ("app-id,a", po::value<std::string>(&appId)->required(),
+            "Identifier of installed application")
+        ("launches,n", po::value<size_t>(&launches), "Number of launches in each mode")
+        ;
+
+    return Bench::run(argc, argv, optDesc, [&](const po::variables_map &) {
+        report("prepare_app", [&appId]() {
+            return security_manager_prepare_app(appId.c_str());
+        }, launches);
+
+        app_launch_bundle *bundle;
+        int ret = security_manager_app_launch_bundle_get(appId.c_str(), &bundle);
+        if (ret != SECURITY_MANAGER_SUCCESS) {
+            std::cerr << "Getting launch bundle failed: " << ret << std::endl;
+            return EXIT_FAILURE;
+        }
+        report("launch bundle applied", [bundle]() {
+            return security_manager_app_launch_bundle_apply(bundle);
+        }, launches);
+        security_manager_app_launch_bundle_free(bundle);
+        return EXIT_SUCCESS;
+    });
+}
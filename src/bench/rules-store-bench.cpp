@@ -0,0 +1,211 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        rules-store-bench.cpp
+ * @author      Rafal Krypa <r.krypa@samsung.com>
+ * @version     1.0
+ * @brief       Timing of boot-time load of Smack rules of synthetic applications
+ *
+ * Rules of synthetic applications are written to per-application and
+ * per-package files in a scratch directory, as they were kept before the
+ * rules store. Boot-time load of those files is compared with load of the
+ * store they are imported to, followed by uninstallation of some of the
+ * applications. Rules are loaded into a file in the scratch directory,
+ * unless --kernel is given.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <string.h>
+#include <sys/smack.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <smack-rules-store.h>
+#include "bench-common.h"
+
+namespace po = boost::program_options;
+
+using namespace SecurityManager;
+using Bench::throwErrno;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double ms(Clock::duration d)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(d).count() / 1000.0;
+}
+
+std::string appId(size_t i)
+{
+    return "bench_app_" + std::to_string(i);
+}
+
+std::string pkgId(size_t i)
+{
+    return "bench_pkg_" + std::to_string(i);
+}
+
+/* Rules files of applications and packages, as written before the rules store */
+void createLegacyFiles(const std::string &dir, size_t apps, size_t rules)
+{
+    if (mkdir(dir.c_str(), 0755) == -1)
+        throwErrno("Cannot create " + dir);
+
+    for (size_t i = 0; i < apps; ++i) {
+        std::string appLabel = "User::App::" + appId(i);
+        std::string pkgLabel = "User::Pkg::" + pkgId(i);
+
+        std::ofstream app(dir + "/app_" + appId(i));
+        for (size_t j = 0; j < rules; ++j)
+            app << appLabel << " bench_object_" << j << " rwxat\n";
+        app << "User " << appLabel << " rwxat\n";
+
+        std::ofstream pkg(dir + "/pkg_" + pkgId(i));
+        pkg << appLabel << " " << pkgLabel << " rwxat\n";
+        pkg << "User " << pkgLabel << " rwxat\n";
+
+        if (!app.good() || !pkg.good())
+            throw std::runtime_error("Cannot write rules files in " + dir);
+    }
+}
+
+/* Load every rules file with its own write, as it was done at boot */
+size_t loadLegacyFiles(const std::string &dir, const std::string &loadPath)
+{
+    int loadFd = open(loadPath.c_str(), O_WRONLY | O_CLOEXEC);
+    if (loadFd == -1)
+        throwErrno("Cannot open " + loadPath);
+
+    DIR *d = opendir(dir.c_str());
+    if (d == nullptr) {
+        close(loadFd);
+        throwErrno("Cannot open " + dir);
+    }
+
+    size_t files = 0;
+    struct dirent *entry;
+    while ((entry = readdir(d)) != nullptr) {
+        if (entry->d_name[0] == '.')
+            continue;
+
+        std::ifstream file(dir + "/" + entry->d_name);
+        std::string rules((std::istreambuf_iterator<char>(file)),
+            std::istreambuf_iterator<char>());
+        if (TEMP_FAILURE_RETRY(write(loadFd, rules.data(), rules.size())) == -1)
+            std::cerr << "Cannot load rules of " << entry->d_name << ": " <<
+                strerror(errno) << std::endl;
+        ++files;
+    }
+
+    closedir(d);
+    close(loadFd);
+    return files;
+}
+
+void run(const std::string &scratch, size_t apps, size_t rules, size_t uninstalls,
+    bool kernel)
+{
+    std::string legacyDir = scratch + "/accesses.d";
+    std::string loadPath = scratch + "/load2";
+    if (kernel) {
+        if (smack_smackfs_path() == nullptr)
+            throw std::runtime_error("Smack filesystem is not mounted");
+        loadPath = std::string(smack_smackfs_path()) + "/load2";
+    }
+
+    auto resetLoadFile = [&]() {
+        if (kernel)
+            return;
+        int fd = open(loadPath.c_str(), O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC, 0644);
+        if (fd == -1)
+            throwErrno("Cannot create " + loadPath);
+        close(fd);
+    };
+
+    createLegacyFiles(legacyDir, apps, rules);
+    std::cout << apps << " applications, " << rules + 3 << " rules each" << std::endl;
+
+    resetLoadFile();
+    auto start = Clock::now();
+    size_t files = loadLegacyFiles(legacyDir, loadPath);
+    std::cout << "  boot load of rules files: " << ms(Clock::now() - start) << " ms, " <<
+        files << " files" << std::endl;
+
+    SmackRulesStore::setPath(scratch + "/security-manager.rules");
+    SmackRulesStore &store = SmackRulesStore::getInstance();
+    SmackRulesStore::Rules removed;
+
+    start = Clock::now();
+    store.get(SmackRulesStore::appOwner(appId(0)), removed);
+    std::cout << "  import of rules files to the store: " << ms(Clock::now() - start) <<
+        " ms" << std::endl;
+
+    resetLoadFile();
+    start = Clock::now();
+    size_t loaded = SmackRulesStore::load(loadPath);
+    std::cout << "  boot load of the store: " << ms(Clock::now() - start) << " ms, " <<
+        loaded << " rules" << std::endl;
+
+    uninstalls = std::min(uninstalls, apps);
+    start = Clock::now();
+    for (size_t i = 0; i < uninstalls; ++i) {
+        SmackRulesStore::Batch batch;
+        store.remove(SmackRulesStore::appOwner(appId(i)), removed);
+        store.remove(SmackRulesStore::pkgOwner(pkgId(i)), removed);
+    }
+    store.sync();
+    std::cout << "  uninstallation of " << uninstalls << " applications: " <<
+        ms(Clock::now() - start) << " ms" << std::endl;
+}
+
+} // namespace anonymous
+
+int main(int argc, char *argv[])
+{
+    size_t apps = 5000;
+    size_t rules = 24;
+    size_t uninstalls = 100;
+    std::string dir = "/tmp";
+    po::options_description optDesc("Allowed options");
+    optDesc.add_options()
+        ("apps,a", po::value<size_t>(&apps), "Number of synthetic applications")
+        ("rules,r", po::value<size_t>(&rules), "Number of additional rules of each application")
+        ("uninstalls,u", po::value<size_t>(&uninstalls), "Number of uninstalled applications")
+        ("dir,d", po::value<std::string>(&dir), "Directory for scratch files (default: /tmp)")
+        ("kernel,k", "Load rules into the kernel, they are left there")
+        ;
+
+    return Bench::run(argc, argv, optDesc, [&](const po::variables_map &vm) {
+        Bench::ScratchDir scratch(dir);
+        run(scratch.path(), apps, rules, uninstalls, vm.count("kernel") > 0);
+        return EXIT_SUCCESS;
+    });
+}
@@ -0,0 +1,631 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        client-async.cpp
+ * @author      Rafal Krypa <r.krypa@samsung.com>
+ * @version     1.0
+ * @brief       Asynchronous requests to security-manager over a persistent connection
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+
+#include <dpl/log/log.h>
+#include <dpl/serialization.h>
+#include <app-snapshot.h>
+#include <client-common.h>
+#include <connection.h>
+#include <message-buffer.h>
+#include <protocols.h>
+
+#include <security-manager.h>
+
+using namespace SecurityManager;
+
+namespace {
+
+typedef std::function<void(unsigned int id, int result, MessageBuffer *response)> Completion;
+
+int toLibResult(int retval)
+{
+    switch (retval) {
+    case SECURITY_MANAGER_API_SUCCESS:
+        return SECURITY_MANAGER_SUCCESS;
+    case SECURITY_MANAGER_API_ERROR_AUTHENTICATION_FAILED:
+        return SECURITY_MANAGER_ERROR_AUTHENTICATION_FAILED;
+    case SECURITY_MANAGER_API_ERROR_ACCESS_DENIED:
+        return SECURITY_MANAGER_ERROR_ACCESS_DENIED;
+    case SECURITY_MANAGER_API_ERROR_INPUT_PARAM:
+        return SECURITY_MANAGER_ERROR_INPUT_PARAM;
+    default:
+        return SECURITY_MANAGER_ERROR_UNKNOWN;
+    }
+}
+
+long long nowMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<long long>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+} // namespace anonymous
+
+/*
+ * Server answers requests of a connection one by one, in the order they were
+ * sent, so responses are matched with pending requests by their position.
+ * Requests cancelled or timed out stay in the queue, without completion,
+ * until their responses arrive.
+ *
+ * Caller watches an epoll descriptor holding the connection socket and
+ * a timer armed for the nearest deadline, so it doesn't change when the
+ * connection is reopened and timeouts don't need caller's attention.
+ */
+struct security_manager_async {
+    struct Request {
+        unsigned int id;
+        long long deadline;  // -1 for none
+        Completion complete; // empty when cancelled or timed out
+    };
+
+    security_manager_async();
+    ~security_manager_async();
+
+    int submit(MessageBuffer &send, int timeoutMs, Completion complete,
+        unsigned int *requestId);
+    int complete(Completion complete, MessageBuffer &response, unsigned int *requestId);
+    bool cancel(unsigned int requestId);
+    int process();
+
+    int m_epollFd;
+    int m_timerFd;
+
+private:
+    unsigned int nextId();
+    int connect();
+    void disconnect(int result);
+    bool flush();
+    bool receive();
+    void dispatch(MessageBuffer &response);
+    void expire();
+    void update();
+
+    int m_sock;
+    bool m_writing;
+    RawBuffer m_out;
+    size_t m_outDone;
+    RawBuffer m_in;
+    std::deque<Request> m_pending;
+    /* Requests completed locally, without the server */
+    std::deque<std::function<void()>> m_ready;
+    unsigned int m_lastId;
+};
+
+security_manager_async::security_manager_async()
+  : m_epollFd(-1)
+  , m_timerFd(-1)
+  , m_sock(-1)
+  , m_writing(false)
+  , m_outDone(0)
+  , m_lastId(0)
+{
+}
+
+security_manager_async::~security_manager_async()
+{
+    if (m_sock != -1)
+        close(m_sock);
+    if (m_timerFd != -1)
+        close(m_timerFd);
+    if (m_epollFd != -1)
+        close(m_epollFd);
+}
+
+unsigned int security_manager_async::nextId()
+{
+    if (++m_lastId == 0)
+        ++m_lastId;
+    return m_lastId;
+}
+
+int security_manager_async::connect()
+{
+    int ret = connectToServer(SERVICE_SOCKET, m_sock);
+    if (ret != SECURITY_MANAGER_API_SUCCESS) {
+        LogError("Error in connectToServer. Error code: " << ret);
+        m_sock = -1;
+        return toLibResult(ret);
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    if (fcntl(m_sock, F_SETFD, FD_CLOEXEC) == -1 ||
+        epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_sock, &ev) == -1) {
+        LogError("Error setting up connection: " << strerror(errno));
+        close(m_sock);
+        m_sock = -1;
+        return SECURITY_MANAGER_ERROR_UNKNOWN;
+    }
+    m_writing = false;
+
+    // Server closes connections after a single response unless told otherwise
+    MessageBuffer send;
+    Serialization::Serialize(send, static_cast<int>(SecurityModuleCall::KEEP_CONNECTION));
+    m_out = send.Pop();
+    m_outDone = 0;
+    m_pending.push_back(Request{0, -1, Completion()});
+    return SECURITY_MANAGER_SUCCESS;
+}
+
+void security_manager_async::disconnect(int result)
+{
+    if (m_sock != -1) {
+        epoll_ctl(m_epollFd, EPOLL_CTL_DEL, m_sock, nullptr);
+        close(m_sock);
+        m_sock = -1;
+    }
+    m_out.clear();
+    m_outDone = 0;
+    m_in.clear();
+
+    // Callbacks may queue new requests, they go to a new connection
+    std::deque<Request> pending;
+    pending.swap(m_pending);
+    for (auto &request : pending)
+        if (request.complete)
+            request.complete(request.id, result, nullptr);
+}
+
+bool security_manager_async::flush()
+{
+    while (m_outDone < m_out.size()) {
+        ssize_t ret = TEMP_FAILURE_RETRY(send(m_sock, &m_out[m_outDone],
+            m_out.size() - m_outDone, MSG_NOSIGNAL));
+        if (ret == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return true;
+            LogError("Error in send: " << strerror(errno));
+            return false;
+        }
+        m_outDone += ret;
+    }
+
+    m_out.clear();
+    m_outDone = 0;
+    return true;
+}
+
+bool security_manager_async::receive()
+{
+    char buffer[2048];
+    bool closed = false;
+
+    for (;;) {
+        ssize_t ret = TEMP_FAILURE_RETRY(read(m_sock, buffer, sizeof(buffer)));
+        if (ret == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            LogError("Error in read: " << strerror(errno));
+            return false;
+        }
+        if (ret == 0) {
+            closed = true;
+            break;
+        }
+        m_in.insert(m_in.end(), buffer, buffer + ret);
+    }
+
+    // Responses received before the connection was closed are still valid
+    size_t offset = 0;
+    while (m_in.size() - offset >= sizeof(size_t)) {
+        size_t size;
+        memcpy(&size, &m_in[offset], sizeof(size));
+        size_t frame = sizeof(size_t) + size;
+        if (m_in.size() - offset < frame)
+            break;
+
+        if (m_pending.empty()) {
+            LogError("Response without a pending request");
+            return false;
+        }
+
+        MessageBuffer response;
+        response.Push(RawBuffer(m_in.begin() + offset, m_in.begin() + offset + frame));
+        offset += frame;
+        dispatch(response);
+    }
+    m_in.erase(m_in.begin(), m_in.begin() + offset);
+
+    if (closed) {
+        if (m_pending.empty())
+            LogDebug("Idle connection closed by server");
+        else
+            LogError("Connection closed by server with pending requests");
+        return false;
+    }
+    return true;
+}
+
+void security_manager_async::dispatch(MessageBuffer &response)
+{
+    unsigned int id = m_pending.front().id;
+    Completion complete = std::move(m_pending.front().complete);
+    m_pending.pop_front();
+    if (!complete)
+        return;
+
+    int retval;
+    Deserialization::Deserialize(response, retval);
+    complete(id, toLibResult(retval), &response);
+}
+
+void security_manager_async::expire()
+{
+    long long now = nowMs();
+
+    // Callbacks may queue new requests, so don't keep references
+    for (size_t i = 0; i < m_pending.size(); ++i) {
+        Request &request = m_pending[i];
+        if (!request.complete || request.deadline == -1 || request.deadline > now)
+            continue;
+
+        unsigned int id = request.id;
+        LogDebug("Request " << id << " timed out");
+        Completion complete = std::move(request.complete);
+        request.complete = Completion();
+        complete(id, SECURITY_MANAGER_ERROR_TIMEOUT, nullptr);
+    }
+}
+
+void security_manager_async::update()
+{
+    if (m_sock != -1) {
+        bool writing = !m_out.empty();
+        if (writing != m_writing) {
+            struct epoll_event ev;
+            memset(&ev, 0, sizeof(ev));
+            ev.events = writing ? EPOLLIN | EPOLLOUT : EPOLLIN;
+            if (epoll_ctl(m_epollFd, EPOLL_CTL_MOD, m_sock, &ev) == 0)
+                m_writing = writing;
+        }
+    }
+
+    long long deadline = -1;
+    for (const auto &request : m_pending)
+        if (request.complete && request.deadline != -1 &&
+            (deadline == -1 || request.deadline < deadline))
+            deadline = request.deadline;
+
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (!m_ready.empty()) {
+        // Earliest possible expiration, to make the descriptor readable now
+        spec.it_value.tv_nsec = 1;
+    } else if (deadline != -1) {
+        spec.it_value.tv_sec = deadline / 1000;
+        spec.it_value.tv_nsec = (deadline % 1000) * 1000000;
+        if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0)
+            spec.it_value.tv_nsec = 1;
+    }
+    if (timerfd_settime(m_timerFd, m_ready.empty() ? TFD_TIMER_ABSTIME : 0,
+            &spec, nullptr) == -1)
+        LogError("Error in timerfd_settime: " << strerror(errno));
+}
+
+int security_manager_async::submit(MessageBuffer &send, int timeoutMs,
+    Completion complete, unsigned int *requestId)
+{
+    if (m_sock == -1) {
+        int ret = connect();
+        if (ret != SECURITY_MANAGER_SUCCESS)
+            return ret;
+    }
+
+    RawBuffer data = send.Pop();
+    m_out.insert(m_out.end(), data.begin(), data.end());
+
+    unsigned int id = nextId();
+    m_pending.push_back(Request{id, timeoutMs < 0 ? -1 : nowMs() + timeoutMs,
+        std::move(complete)});
+    if (requestId)
+        *requestId = id;
+
+    // Errors are reported to the callbacks from process()
+    flush();
+    update();
+    return SECURITY_MANAGER_SUCCESS;
+}
+
+int security_manager_async::complete(Completion complete, MessageBuffer &response,
+    unsigned int *requestId)
+{
+    unsigned int id = nextId();
+    auto data = std::make_shared<MessageBuffer>();
+    data->Push(response.Pop());
+    m_ready.push_back([complete, id, data]() {
+        int retval;
+        Deserialization::Deserialize(*data, retval);
+        complete(id, toLibResult(retval), data.get());
+    });
+    if (requestId)
+        *requestId = id;
+    update();
+    return SECURITY_MANAGER_SUCCESS;
+}
+
+bool security_manager_async::cancel(unsigned int requestId)
+{
+    for (auto &request : m_pending) {
+        if (request.id == requestId && request.complete) {
+            request.complete = Completion();
+            update();
+            return true;
+        }
+    }
+    return false;
+}
+
+int security_manager_async::process()
+{
+    uint64_t expirations;
+    if (TEMP_FAILURE_RETRY(read(m_timerFd, &expirations, sizeof(expirations))) == -1 &&
+        errno != EAGAIN)
+        LogError("Error in read from timer: " << strerror(errno));
+
+    std::deque<std::function<void()>> ready;
+    ready.swap(m_ready);
+    for (auto &callback : ready)
+        callback();
+
+    if (m_sock != -1) {
+        bool ok = true;
+        try {
+            ok = flush() && receive();
+        } catch (const MessageBuffer::Exception::Base &) {
+            LogError("Broken protocol");
+            ok = false;
+        }
+        if (!ok)
+            disconnect(SECURITY_MANAGER_ERROR_UNKNOWN);
+    }
+
+    expire();
+    update();
+    return SECURITY_MANAGER_SUCCESS;
+}
+
+SECURITY_MANAGER_API
+int security_manager_async_new(security_manager_async **pp_async)
+{
+    if (!pp_async)
+        return SECURITY_MANAGER_ERROR_INPUT_PARAM;
+
+    return try_catch([&] {
+        std::unique_ptr<security_manager_async> async(new security_manager_async);
+
+        async->m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+        async->m_timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (async->m_epollFd == -1 || async->m_timerFd == -1) {
+            LogError("Error creating descriptors: " << strerror(errno));
+            return SECURITY_MANAGER_ERROR_UNKNOWN;
+        }
+
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        if (epoll_ctl(async->m_epollFd, EPOLL_CTL_ADD, async->m_timerFd, &ev) == -1) {
+            LogError("Error in epoll_ctl: " << strerror(errno));
+            return SECURITY_MANAGER_ERROR_UNKNOWN;
+        }
+
+        *pp_async = async.release();
+        return SECURITY_MANAGER_SUCCESS;
+    });
+}
+
+SECURITY_MANAGER_API
+void security_manager_async_free(security_manager_async *p_async)
+{
+    delete p_async;
+}
+
+SECURITY_MANAGER_API
+int security_manager_async_get_fd(security_manager_async *p_async, int *fd)
+{
+    if (!p_async || !fd)
+        return SECURITY_MANAGER_ERROR_INPUT_PARAM;
+
+    *fd = p_async->m_epollFd;
+    return SECURITY_MANAGER_SUCCESS;
+}
+
+SECURITY_MANAGER_API
+int security_manager_async_process(security_manager_async *p_async)
+{
+    if (!p_async)
+        return SECURITY_MANAGER_ERROR_INPUT_PARAM;
+
+    return try_catch([&] {
+        return p_async->process();
+    });
+}
+
+SECURITY_MANAGER_API
+int security_manager_async_cancel(security_manager_async *p_async,
+        unsigned int request_id)
+{
+    if (!p_async)
+        return SECURITY_MANAGER_ERROR_INPUT_PARAM;
+
+    return p_async->cancel(request_id) ?
+        SECURITY_MANAGER_SUCCESS : SECURITY_MANAGER_ERROR_INPUT_PARAM;
+}
+
+
+static Completion resultCompletion(security_manager_async_cb callback, void *user_data)
+{
+    return [callback, user_data](unsigned int id, int result, MessageBuffer *) {
+        callback(id, result, user_data);
+    };
+}
+
+SECURITY_MANAGER_API
+int security_manager_async_app_install(security_manager_async *p_async,
+        const app_inst_req *p_req, int timeout_ms,
+        security_manager_async_cb callback, void *user_data,
+        unsigned int *p_request_id)
+{
+    if (!p_async || !p_req || !callback)
+        return SECURITY_MANAGER_ERROR_INPUT_PARAM;
+    if (p_req->appId.empty() || p_req->pkgId.empty())
+        return SECURITY_MANAGER_ERROR_REQ_NOT_COMPLETE;
+
+    return try_catch([&] {
+        MessageBuffer send;
+        Serialization::Serialize(send, static_cast<int>(SecurityModuleCall::APP_INSTALL),
+            p_req->appId, p_req->pkgId, p_req->privileges, p_req->appPaths, p_req->uid);
+        return p_async->submit(send, timeout_ms, resultCompletion(callback, user_data),
+            p_request_id);
+    });
+}
+
+SECURITY_MANAGER_API
+int security_manager_async_app_uninstall(security_manager_async *p_async,
+        const app_inst_req *p_req, int timeout_ms,
+        security_manager_async_cb callback, void *user_data,
+        unsigned int *p_request_id)
+{
+    if (!p_async || !p_req || !callback)
+        return SECURITY_MANAGER_ERROR_INPUT_PARAM;
+    if (p_req->appId.empty())
+        return SECURITY_MANAGER_ERROR_REQ_NOT_COMPLETE;
+
+    return try_catch([&] {
+        MessageBuffer send;
+        Serialization::Serialize(send, static_cast<int>(SecurityModuleCall::APP_UNINSTALL),
+            p_req->appId);
+        return p_async->submit(send, timeout_ms, resultCompletion(callback, user_data),
+            p_request_id);
+    });
+}
+
+SECURITY_MANAGER_API
+int security_manager_async_get_app_pkgid(security_manager_async *p_async,
+        const char *app_id, int timeout_ms,
+        security_manager_async_pkgid_cb callback, void *user_data,
+        unsigned int *p_request_id)
+{
+    if (!p_async || !app_id || !callback)
+        return SECURITY_MANAGER_ERROR_INPUT_PARAM;
+
+    return try_catch([&] {
+        Completion complete = [callback, user_data](unsigned int id, int result,
+                MessageBuffer *response) {
+            std::string pkgId;
+            if (result == SECURITY_MANAGER_SUCCESS) {
+                Deserialization::Deserialize(*response, pkgId);
+                if (pkgId.empty()) {
+                    LogError("Unexpected empty pkgId");
+                    result = SECURITY_MANAGER_ERROR_UNKNOWN;
+                }
+            }
+            callback(id, result, result == SECURITY_MANAGER_SUCCESS ? pkgId.c_str() : nullptr,
+                user_data);
+        };
+
+        std::string pkgId;
+        if (AppSnapshotReader::getInstance().getPkgId(app_id, pkgId)) {
+            LogDebug("pkgId of " << app_id << " found in application snapshot");
+            MessageBuffer response;
+            Serialization::Serialize(response, static_cast<int>(SECURITY_MANAGER_API_SUCCESS),
+                pkgId);
+            return p_async->complete(complete, response, p_request_id);
+        }
+
+        MessageBuffer send;
+        Serialization::Serialize(send, static_cast<int>(SecurityModuleCall::APP_GET_PKGID),
+            std::string(app_id));
+        return p_async->submit(send, timeout_ms, complete, p_request_id);
+    });
+}
+
+SECURITY_MANAGER_API
+int security_manager_async_user_add(security_manager_async *p_async,
+        const user_req *p_req, int timeout_ms,
+        security_manager_async_cb callback, void *user_data,
+        unsigned int *p_request_id)
+{
+    if (!p_async || !p_req || !callback)
+        return SECURITY_MANAGER_ERROR_INPUT_PARAM;
+
+    return try_catch([&] {
+        MessageBuffer send;
+        Serialization::Serialize(send, static_cast<int>(SecurityModuleCall::USER_ADD),
+            p_req->uid, p_req->utype);
+        return p_async->submit(send, timeout_ms, resultCompletion(callback, user_data),
+            p_request_id);
+    });
+}
+
+SECURITY_MANAGER_API
+int security_manager_async_user_delete(security_manager_async *p_async,
+        const user_req *p_req, int timeout_ms,
+        security_manager_async_cb callback, void *user_data,
+        unsigned int *p_request_id)
+{
+    if (!p_async || !p_req || !callback)
+        return SECURITY_MANAGER_ERROR_INPUT_PARAM;
+
+    return try_catch([&] {
+        MessageBuffer send;
+        Serialization::Serialize(send, static_cast<int>(SecurityModuleCall::USER_DELETE),
+            p_req->uid);
+        return p_async->submit(send, timeout_ms, resultCompletion(callback, user_data),
+            p_request_id);
+    });
+}
+
+SECURITY_MANAGER_API
+int security_manager_async_policy_update_send(security_manager_async *p_async,
+        policy_update_req *p_req, int timeout_ms,
+        security_manager_async_cb callback, void *user_data,
+        unsigned int *p_request_id)
+{
+    if (!p_async || !p_req || p_req->units.size() == 0 || !callback)
+        return SECURITY_MANAGER_ERROR_INPUT_PARAM;
+
+    return try_catch([&] {
+        MessageBuffer send;
+        Serialization::Serialize(send, static_cast<int>(SecurityModuleCall::POLICY_UPDATE),
+            p_req->units);
+        return p_async->submit(send, timeout_ms, resultCompletion(callback, user_data),
+            p_request_id);
+    });
+}
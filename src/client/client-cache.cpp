@@ -0,0 +1,104 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        client-cache.cpp
+ * @author      Rafal Krypa <r.krypa@samsung.com>
+ * @version     1.0
+ * @brief       Cache of results of requests to the service
+ */
+
+#include <dpl/log/log.h>
+#include <app-snapshot.h>
+
+#include "client-cache.h"
+
+namespace SecurityManager {
+
+ClientCache::ClientCache()
+    : m_enabled(false), m_generation(0)
+{
+}
+
+ClientCache &ClientCache::getInstance()
+{
+    static ClientCache instance;
+    return instance;
+}
+
+void ClientCache::setEnabled(bool enabled)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_enabled = enabled;
+    if (!enabled)
+        m_entries.clear();
+}
+
+bool ClientCache::validate(uint64_t &generation)
+{
+    if (!m_enabled)
+        return false;
+
+    if (!AppSnapshotReader::getInstance().getGeneration(generation)) {
+        m_entries.clear();
+        return false;
+    }
+
+    if (generation != m_generation) {
+        if (!m_entries.empty())
+            LogDebug("Generation changed to " << generation << ", dropping cached results");
+        m_entries.clear();
+        m_generation = generation;
+    }
+
+    return true;
+}
+
+bool ClientCache::begin(uint64_t &generation)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return validate(generation);
+}
+
+bool ClientCache::get(const std::string &key, Value &value)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint64_t generation;
+    if (!validate(generation))
+        return false;
+
+    auto it = m_entries.find(key);
+    if (it == m_entries.end())
+        return false;
+
+    value = it->second;
+    return true;
+}
+
+void ClientCache::put(const std::string &key, uint64_t generation, const Value &value)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint64_t current;
+    if (!validate(current) || current != generation)
+        return;
+
+    if (m_entries.size() >= CAPACITY)
+        m_entries.clear();
+    m_entries[key] = value;
+}
+
+} // namespace SecurityManager
@@ -26,13 +26,15 @@
  */
 
 #include <cstdio>
+#include <ctime>
 #include <functional>
 #include <memory>
 #include <utility>
+#include <vector>
 
 #include <unistd.h>
 #include <grp.h>
-#include <dirent.h>
+#include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/xattr.h>
@@ -41,9 +43,12 @@
 
 #include <dpl/log/log.h>
 #include <dpl/exception.h>
+#include <app-snapshot.h>
 #include <smack-labels.h>
 #include <message-buffer.h>
+#include <client-cache.h>
 #include <client-common.h>
+#include <client-socket-fds.h>
 #include <protocols.h>
 #include <service_impl.h>
 #include <connection.h>
@@ -66,6 +71,7 @@ static std::map<enum lib_retcode, std::string> lib_retcode_string_map = {
     {SECURITY_MANAGER_ERROR_AUTHENTICATION_FAILED, "User does not have sufficient "
                                                    "rigths to perform an operation"},
     {SECURITY_MANAGER_ERROR_ACCESS_DENIED, "Insufficient privileges"},
+    {SECURITY_MANAGER_ERROR_TIMEOUT, "Request timed out"},
 };
 
 SECURITY_MANAGER_API
@@ -78,6 +84,12 @@ const char *security_manager_strerror(enum lib_retcode rc)
     }
 }
 
+SECURITY_MANAGER_API
+void security_manager_result_cache_enable(int enable)
+{
+    SecurityManager::ClientCache::getInstance().setEnabled(enable != 0);
+}
+
 SECURITY_MANAGER_API
 int security_manager_app_inst_req_new(app_inst_req **pp_req)
 {
@@ -259,24 +271,39 @@ int security_manager_get_app_pkgid(char **pkg_id, const char *app_id)
             return SECURITY_MANAGER_ERROR_INPUT_PARAM;
         }
 
-        //put data into buffer
-        Serialization::Serialize(send, static_cast<int>(SecurityModuleCall::APP_GET_PKGID),
-            std::string(app_id));
+        std::string pkgIdString;
+        ClientCache::Value cached;
+        uint64_t generation;
+        std::string cacheKey = std::string("pkgid:") + app_id;
+        if (AppSnapshotReader::getInstance().getPkgId(app_id, pkgIdString)) {
+            LogDebug("pkgId of " << app_id << " found in application snapshot");
+        } else if (ClientCache::getInstance().get(cacheKey, cached)) {
+            LogDebug("pkgId of " << app_id << " found in cache");
+            pkgIdString = cached.front();
+        } else {
+            bool cacheable = ClientCache::getInstance().begin(generation);
 
-        //send buffer to server
-        int retval = sendToServer(SERVICE_SOCKET, send.Pop(), recv);
-        if (retval != SECURITY_MANAGER_API_SUCCESS) {
-            LogDebug("Error in sendToServer. Error code: " << retval);
-            return SECURITY_MANAGER_ERROR_UNKNOWN;
-        }
+            //put data into buffer
+            Serialization::Serialize(send, static_cast<int>(SecurityModuleCall::APP_GET_PKGID),
+                std::string(app_id));
 
-        //receive response from server
-        Deserialization::Deserialize(recv, retval);
-        if (retval != SECURITY_MANAGER_API_SUCCESS)
-            return SECURITY_MANAGER_ERROR_UNKNOWN;
+            //send buffer to server
+            int retval = sendToServer(SERVICE_SOCKET, send.Pop(), recv);
+            if (retval != SECURITY_MANAGER_API_SUCCESS) {
+                LogDebug("Error in sendToServer. Error code: " << retval);
+                return SECURITY_MANAGER_ERROR_UNKNOWN;
+            }
+
+            //receive response from server
+            Deserialization::Deserialize(recv, retval);
+            if (retval != SECURITY_MANAGER_API_SUCCESS)
+                return SECURITY_MANAGER_ERROR_UNKNOWN;
+
+            Deserialization::Deserialize(recv, pkgIdString);
+            if (cacheable && !pkgIdString.empty())
+                ClientCache::getInstance().put(cacheKey, generation, {pkgIdString});
+        }
 
-        std::string pkgIdString;
-        Deserialization::Deserialize(recv, pkgIdString);
         if (pkgIdString.empty()) {
             LogError("Unexpected empty pkgId");
             return SECURITY_MANAGER_ERROR_UNKNOWN;
@@ -292,60 +319,34 @@ int security_manager_get_app_pkgid(char **pkg_id, const char *app_id)
     });
 }
 
-static bool setup_smack(const char *label)
+static int setup_smack(const char *label, const std::vector<int> *socketFds)
 {
     int labelSize = strlen(label);
 
-    // Set Smack label for open socket file descriptors
-
-    std::unique_ptr<DIR, std::function<int(DIR*)>> dir(
-        opendir("/proc/self/fd"), closedir);
-    if (!dir.get()) {
-        LogError("Unable to read list of open file descriptors: " <<
-            strerror(errno));
-        return SECURITY_MANAGER_ERROR_UNKNOWN;
+    // Set Smack label for open socket file descriptors, all of them unless given
+    std::vector<int> fds;
+    if (socketFds == nullptr) {
+        int ret = SecurityManager::getSocketFds(fds);
+        if (ret != SECURITY_MANAGER_SUCCESS)
+            return ret;
+        socketFds = &fds;
     }
 
-    do {
-        errno = 0;
-        struct dirent *dirEntry = readdir(dir.get());
-        if (dirEntry == nullptr) {
-            if (errno == 0) // NULL return value also signals end of directory
-                break;
-
-            LogError("Unable to read list of open file descriptors: " <<
-                strerror(errno));
+    for (int fd : *socketFds) {
+        int ret = fsetxattr(fd, XATTR_NAME_SMACKIPIN, label, labelSize, 0);
+        if (ret != 0) {
+            LogError("Setting Smack label failed on file descriptor " <<
+                fd << ": " << strerror(errno));
             return SECURITY_MANAGER_ERROR_UNKNOWN;
         }
 
-        // Entries with numerical names specify file descriptors, ignore the rest
-        if (!isdigit(dirEntry->d_name[0]))
-            continue;
-
-        struct stat statBuf;
-        int fd = atoi(dirEntry->d_name);
-        int ret = fstat(fd, &statBuf);
+        ret = fsetxattr(fd, XATTR_NAME_SMACKIPOUT, label, labelSize, 0);
         if (ret != 0) {
-            LogWarning("fstat failed on file descriptor " << fd << ": " <<
-                strerror(errno));
-            continue;
-        }
-        if (S_ISSOCK(statBuf.st_mode)) {
-            ret = fsetxattr(fd, XATTR_NAME_SMACKIPIN, label, labelSize, 0);
-            if (ret != 0) {
-                LogError("Setting Smack label failed on file descriptor " <<
-                    fd << ": " << strerror(errno));
-                return SECURITY_MANAGER_ERROR_UNKNOWN;
-            }
-
-            ret = fsetxattr(fd, XATTR_NAME_SMACKIPOUT, label, labelSize, 0);
-            if (ret != 0) {
-                LogError("Setting Smack label failed on file descriptor " <<
-                    fd << ": " << strerror(errno));
-                return SECURITY_MANAGER_ERROR_UNKNOWN;
-            }
+            LogError("Setting Smack label failed on file descriptor " <<
+                fd << ": " << strerror(errno));
+            return SECURITY_MANAGER_ERROR_UNKNOWN;
         }
-    } while (true);
+    }
 
     // Set Smack label of current process
     smack_set_label_for_self(label);
@@ -353,14 +354,31 @@ static bool setup_smack(const char *label)
     return SECURITY_MANAGER_SUCCESS;
 }
 
-SECURITY_MANAGER_API
-int security_manager_set_process_label_from_appid(const char *app_id)
+static bool get_given_socket_fds(const int *socket_fds, size_t socket_fds_count,
+        std::vector<int> &fds)
+{
+    if (socket_fds == nullptr && socket_fds_count != 0)
+        return false;
+
+    for (size_t i = 0; i < socket_fds_count; ++i) {
+        // Never set Smack xattrs of a file by mistake
+        struct stat statBuf;
+        if (fstat(socket_fds[i], &statBuf) != 0 || !S_ISSOCK(statBuf.st_mode)) {
+            LogError("File descriptor " << socket_fds[i] << " is not an open socket");
+            return false;
+        }
+        fds.push_back(socket_fds[i]);
+    }
+
+    return true;
+}
+
+static int security_manager_set_process_label_internal(const char *app_id,
+        const std::vector<int> *socketFds)
 {
     int ret;
     std::string appLabel;
 
-    LogDebug("security_manager_set_process_label_from_appid() called");
-
     if (smack_smackfs_path() == NULL)
         return SECURITY_MANAGER_SUCCESS;
 
@@ -381,7 +399,7 @@ int security_manager_set_process_label_from_appid(const char *app_id)
         return SECURITY_MANAGER_API_ERROR_NO_SUCH_OBJECT;
     }
 
-    if ((ret = setup_smack(appLabel.c_str())) != SECURITY_MANAGER_SUCCESS) {
+    if ((ret = setup_smack(appLabel.c_str(), socketFds)) != SECURITY_MANAGER_SUCCESS) {
         LogError("Failed to set smack label " << appLabel << " for current process");
         return ret;
     }
@@ -389,12 +407,63 @@ int security_manager_set_process_label_from_appid(const char *app_id)
     return SECURITY_MANAGER_SUCCESS;
 }
 
+SECURITY_MANAGER_API
+int security_manager_set_process_label_from_appid(const char *app_id)
+{
+    LogDebug("security_manager_set_process_label_from_appid() called");
+
+    return security_manager_set_process_label_internal(app_id, nullptr);
+}
+
+SECURITY_MANAGER_API
+int security_manager_set_process_label_from_appid_with_fds(const char *app_id,
+        const int *socket_fds, size_t socket_fds_count)
+{
+    LogDebug("security_manager_set_process_label_from_appid_with_fds() called");
+
+    std::vector<int> fds;
+    if (!get_given_socket_fds(socket_fds, socket_fds_count, fds))
+        return SECURITY_MANAGER_ERROR_INPUT_PARAM;
+
+    return security_manager_set_process_label_internal(app_id, &fds);
+}
+
+static lib_retcode apply_groups(const std::vector<gid_t> &newGroups)
+{
+    //Most processes belong to few groups, don't ask for their number first
+    std::vector<gid_t> groups(32);
+    int ret = getgroups(groups.size(), groups.data());
+    if (ret == -1 && errno == EINVAL) {
+        ret = getgroups(0, nullptr);
+        if (ret != -1) {
+            groups.resize(ret);
+            ret = getgroups(groups.size(), groups.data());
+        }
+    }
+    if (ret == -1) {
+        LogError("Unable to get list of current supplementary groups: " <<
+            strerror(errno));
+        return SECURITY_MANAGER_ERROR_UNKNOWN;
+    }
+    groups.resize(ret);
+    groups.insert(groups.end(), newGroups.begin(), newGroups.end());
+
+    //Apply the modified groups list
+    ret = setgroups(groups.size(), groups.data());
+    if (ret == -1) {
+        LogError("Unable to set list of supplementary groups: " <<
+            strerror(errno));
+        return SECURITY_MANAGER_ERROR_UNKNOWN;
+    }
+
+    return SECURITY_MANAGER_SUCCESS;
+}
+
 SECURITY_MANAGER_API
 int security_manager_set_process_groups_from_appid(const char *app_id)
 {
     using namespace SecurityManager;
     MessageBuffer send, recv;
-    int ret;
 
     LogDebug("security_manager_set_process_groups_from_appid() called");
 
@@ -424,52 +493,16 @@ int security_manager_set_process_groups_from_appid(const char *app_id)
             return SECURITY_MANAGER_ERROR_UNKNOWN;
         }
 
-        //How many new groups?
+        //Get the new groups from server response
         int newGroupsCnt;
         Deserialization::Deserialize(recv, newGroupsCnt);
-
-        //And how many groups do we belong to already?
-        int oldGroupsCnt;
-        ret = getgroups(0, nullptr);
-        if (ret == -1) {
-            LogError("Unable to get list of current supplementary groups: " <<
-                strerror(errno));
-            return SECURITY_MANAGER_ERROR_UNKNOWN;
-        }
-        oldGroupsCnt = ret;
-
-        //Allocate an array for both old and new groups gids
-        std::unique_ptr<gid_t[]> groups(new gid_t[oldGroupsCnt + newGroupsCnt]);
-        if (!groups.get()) {
-            LogError("Memory allocation failed.");
-            return SECURITY_MANAGER_ERROR_MEMORY;
-        }
-
-        //Get the old groups from process
-        ret = getgroups(oldGroupsCnt, groups.get());
-        if (ret == -1) {
-            LogError("Unable to get list of current supplementary groups: " <<
-                strerror(errno));
-            return SECURITY_MANAGER_ERROR_UNKNOWN;
-        }
-
-        //Get the new groups from server response
-        for (int i = 0; i < newGroupsCnt; ++i) {
-            gid_t gid;
+        std::vector<gid_t> newGroups(newGroupsCnt);
+        for (auto &gid : newGroups) {
             Deserialization::Deserialize(recv, gid);
-            groups.get()[oldGroupsCnt + i] = gid;
             LogDebug("Adding process to group " << gid);
         }
 
-        //Apply the modified groups list
-        ret = setgroups(oldGroupsCnt + newGroupsCnt, groups.get());
-        if (ret == -1) {
-            LogError("Unable to get list of current supplementary groups: " <<
-                strerror(errno));
-            return SECURITY_MANAGER_ERROR_UNKNOWN;
-        }
-
-        return SECURITY_MANAGER_SUCCESS;
+        return apply_groups(newGroups);
     });
 }
 
@@ -503,13 +536,88 @@ int security_manager_drop_process_privileges(void)
     return SECURITY_MANAGER_SUCCESS;
 }
 
-SECURITY_MANAGER_API
-int security_manager_prepare_app(const char *app_id)
+struct app_launch_bundle {
+    std::string appId;
+    std::string pkgId;
+    std::string label;
+    std::vector<gid_t> gids;
+};
+
+static lib_retcode security_manager_fetch_launch_bundles(const std::vector<std::string> &appIds,
+        std::vector<app_launch_bundle> &bundles)
+{
+    using namespace SecurityManager;
+    MessageBuffer send, recv;
+
+    //put data into buffer
+    Serialization::Serialize(send, static_cast<int>(SecurityModuleCall::APP_GET_LAUNCH_BUNDLES),
+        appIds);
+
+    //send buffer to server
+    int retval = sendToServer(SERVICE_SOCKET, send.Pop(), recv);
+    if (retval != SECURITY_MANAGER_API_SUCCESS) {
+        LogError("Error in sendToServer. Error code: " << retval);
+        return SECURITY_MANAGER_ERROR_UNKNOWN;
+    }
+
+    //receive response from server
+    Deserialization::Deserialize(recv, retval);
+    if (retval != SECURITY_MANAGER_API_SUCCESS) {
+        LogError("Failed to get launch bundles from security-manager service. Error code: " << retval);
+        return SECURITY_MANAGER_ERROR_UNKNOWN;
+    }
+
+    for (const auto &appId : appIds) {
+        Deserialization::Deserialize(recv, retval);
+        if (retval != SECURITY_MANAGER_API_SUCCESS) {
+            LogWarning("No launch bundle for application " << appId << ". Error code: " << retval);
+            continue;
+        }
+
+        app_launch_bundle bundle;
+        bundle.appId = appId;
+        int gidsCnt;
+        Deserialization::Deserialize(recv, bundle.pkgId);
+        Deserialization::Deserialize(recv, bundle.label);
+        Deserialization::Deserialize(recv, gidsCnt);
+        bundle.gids.resize(gidsCnt);
+        for (auto &gid : bundle.gids)
+            Deserialization::Deserialize(recv, gid);
+        bundles.push_back(std::move(bundle));
+    }
+
+    return SECURITY_MANAGER_SUCCESS;
+}
+
+static int security_manager_apply_launch_bundle(const app_launch_bundle &bundle,
+        const std::vector<int> *socketFds)
+{
+    int ret;
+
+    if (smack_smackfs_path() != NULL) {
+        ret = setup_smack(bundle.label.c_str(), socketFds);
+        if (ret != SECURITY_MANAGER_SUCCESS) {
+            LogError("Failed to set smack label " << bundle.label << " for current process");
+            return ret;
+        }
+    }
+
+    ret = apply_groups(bundle.gids);
+    if (ret != SECURITY_MANAGER_SUCCESS)
+        LogWarning("Unable to setup process groups for application. Privileges with direct access to resources will not work.");
+
+    return security_manager_drop_process_privileges();
+}
+
+static int security_manager_prepare_app_internal(const char *app_id,
+        const std::vector<int> *socketFds)
 {
-    LogDebug("security_manager_prepare_app() called");
     int ret;
 
-    ret = security_manager_set_process_label_from_appid(app_id);
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    ret = security_manager_set_process_label_internal(app_id, socketFds);
     if (ret != SECURITY_MANAGER_SUCCESS)
         return ret;
 
@@ -520,9 +628,97 @@ int security_manager_prepare_app(const char *app_id)
     }
 
     ret = security_manager_drop_process_privileges();
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    LogDebug("Application " << app_id << " prepared in " <<
+        (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000 <<
+        " us");
     return ret;
 }
 
+SECURITY_MANAGER_API
+int security_manager_prepare_app(const char *app_id)
+{
+    LogDebug("security_manager_prepare_app() called");
+
+    return security_manager_prepare_app_internal(app_id, nullptr);
+}
+
+SECURITY_MANAGER_API
+int security_manager_prepare_app_with_fds(const char *app_id,
+        const int *socket_fds, size_t socket_fds_count)
+{
+    LogDebug("security_manager_prepare_app_with_fds() called");
+
+    std::vector<int> fds;
+    if (!get_given_socket_fds(socket_fds, socket_fds_count, fds))
+        return SECURITY_MANAGER_ERROR_INPUT_PARAM;
+
+    return security_manager_prepare_app_internal(app_id, &fds);
+}
+
+SECURITY_MANAGER_API
+int security_manager_app_launch_bundle_get(const char *app_id, app_launch_bundle **pp_bundle)
+{
+    using namespace SecurityManager;
+
+    LogDebug("security_manager_app_launch_bundle_get() called");
+
+    if (!app_id || !pp_bundle)
+        return SECURITY_MANAGER_ERROR_INPUT_PARAM;
+
+    return try_catch([&] {
+        std::vector<app_launch_bundle> bundles;
+        lib_retcode ret = security_manager_fetch_launch_bundles({app_id}, bundles);
+        if (ret != SECURITY_MANAGER_SUCCESS)
+            return ret;
+        if (bundles.empty())
+            return SECURITY_MANAGER_ERROR_UNKNOWN;
+
+        *pp_bundle = new app_launch_bundle(std::move(bundles.front()));
+        return SECURITY_MANAGER_SUCCESS;
+    });
+}
+
+SECURITY_MANAGER_API
+int security_manager_app_launch_bundle_get_pkg_id(const app_launch_bundle *p_bundle,
+        const char **pkg_id)
+{
+    if (!p_bundle || !pkg_id)
+        return SECURITY_MANAGER_ERROR_INPUT_PARAM;
+
+    *pkg_id = p_bundle->pkgId.c_str();
+    return SECURITY_MANAGER_SUCCESS;
+}
+
+SECURITY_MANAGER_API
+int security_manager_app_launch_bundle_get_label(const app_launch_bundle *p_bundle,
+        const char **label)
+{
+    if (!p_bundle || !label)
+        return SECURITY_MANAGER_ERROR_INPUT_PARAM;
+
+    *label = p_bundle->label.c_str();
+    return SECURITY_MANAGER_SUCCESS;
+}
+
+SECURITY_MANAGER_API
+int security_manager_app_launch_bundle_apply(const app_launch_bundle *p_bundle)
+{
+    LogDebug("security_manager_app_launch_bundle_apply() called");
+
+    if (!p_bundle)
+        return SECURITY_MANAGER_ERROR_INPUT_PARAM;
+
+    return security_manager_apply_launch_bundle(*p_bundle, nullptr);
+}
+
+SECURITY_MANAGER_API
+void security_manager_app_launch_bundle_free(app_launch_bundle *p_bundle)
+{
+    delete p_bundle;
+}
+
 SECURITY_MANAGER_API
 int security_manager_user_req_new(user_req **pp_req)
 {
@@ -789,6 +985,152 @@ int security_manager_get_policy(
     return security_manager_get_policy_internal(SecurityModuleCall::GET_POLICY, p_filter, ppp_privs_policy, p_size);
 };
 
+/* Number of entries requested from the server in one page */
+static const unsigned int POLICY_ITERATOR_PAGE_SIZE = 256;
+
+struct policy_iterator {
+    SecurityManager::SecurityModuleCall callType;
+    policy_entry filter;
+    bool started;
+    policy_entry last;
+    bool more;
+    std::vector<policy_entry> page;
+    size_t pos;
+};
+
+static int security_manager_policy_iterator_fetch(policy_iterator *p_iter)
+{
+    using namespace SecurityManager;
+    MessageBuffer send, recv;
+
+    //put request into buffer, next page starts after the last entry seen
+    Serialization::Serialize(send, static_cast<int>(p_iter->callType),
+        p_iter->filter, p_iter->started);
+    if (p_iter->started)
+        Serialization::Serialize(send, p_iter->last);
+    Serialization::Serialize(send, POLICY_ITERATOR_PAGE_SIZE);
+
+    //send it to server
+    int retval = sendToServer(SERVICE_SOCKET, send.Pop(), recv);
+    if (retval != SECURITY_MANAGER_API_SUCCESS) {
+        LogError("Error in sendToServer. Error code: " << retval);
+        return SECURITY_MANAGER_ERROR_UNKNOWN;
+    }
+
+    //receive response from server
+    Deserialization::Deserialize(recv, retval);
+    switch (retval) {
+        case SECURITY_MANAGER_API_SUCCESS: {
+            int entriesCnt = 0;
+            p_iter->page.clear();
+            p_iter->pos = 0;
+            try {
+                Deserialization::Deserialize(recv, entriesCnt);
+                p_iter->page.reserve(entriesCnt);
+                for (int i = 0; i < entriesCnt; ++i)
+                    p_iter->page.emplace_back(recv);
+                Deserialization::Deserialize(recv, p_iter->more);
+            } catch (...) {
+                LogError("Error while parsing server response");
+                p_iter->page.clear();
+                p_iter->more = false;
+                return SECURITY_MANAGER_ERROR_UNKNOWN;
+            }
+            if (!p_iter->page.empty()) {
+                p_iter->last = p_iter->page.back();
+                p_iter->started = true;
+            }
+            return SECURITY_MANAGER_SUCCESS;
+        }
+        case SECURITY_MANAGER_API_ERROR_AUTHENTICATION_FAILED:
+            return SECURITY_MANAGER_ERROR_AUTHENTICATION_FAILED;
+
+        case SECURITY_MANAGER_API_ERROR_ACCESS_DENIED:
+            return SECURITY_MANAGER_ERROR_ACCESS_DENIED;
+
+        default:
+            return SECURITY_MANAGER_ERROR_UNKNOWN;
+    }
+}
+
+static inline int security_manager_policy_iterator_new(
+        SecurityManager::SecurityModuleCall call_type,
+        policy_entry *p_filter,
+        policy_iterator **pp_iter)
+{
+    if (pp_iter == nullptr || p_filter == nullptr)
+        return SECURITY_MANAGER_ERROR_INPUT_PARAM;
+
+    return try_catch([&]() -> int {
+        std::unique_ptr<policy_iterator> iter(new policy_iterator);
+        iter->callType = call_type;
+        iter->filter = *p_filter;
+        iter->started = false;
+        iter->more = false;
+        iter->pos = 0;
+
+        // Fetch the first page right away to report access errors early
+        int ret = security_manager_policy_iterator_fetch(iter.get());
+        if (ret != SECURITY_MANAGER_SUCCESS)
+            return ret;
+
+        *pp_iter = iter.release();
+        return SECURITY_MANAGER_SUCCESS;
+    });
+}
+
+SECURITY_MANAGER_API
+int security_manager_get_policy_iterator(
+        policy_entry *p_filter,
+        policy_iterator **pp_iter)
+{
+    return security_manager_policy_iterator_new(SecurityModuleCall::GET_POLICY_PAGE, p_filter, pp_iter);
+}
+
+SECURITY_MANAGER_API
+int security_manager_get_configured_policy_for_admin_iterator(
+        policy_entry *p_filter,
+        policy_iterator **pp_iter)
+{
+    return security_manager_policy_iterator_new(SecurityModuleCall::GET_CONF_POLICY_ADMIN_PAGE, p_filter, pp_iter);
+}
+
+SECURITY_MANAGER_API
+int security_manager_policy_iterator_next(
+        policy_iterator *p_iter,
+        policy_entry **pp_entry)
+{
+    if (p_iter == nullptr || pp_entry == nullptr)
+        return SECURITY_MANAGER_ERROR_INPUT_PARAM;
+
+    return try_catch([&]() -> int {
+        if (p_iter->pos == p_iter->page.size()) {
+            if (!p_iter->more) {
+                *pp_entry = nullptr;
+                return SECURITY_MANAGER_SUCCESS;
+            }
+
+            int ret = security_manager_policy_iterator_fetch(p_iter);
+            if (ret != SECURITY_MANAGER_SUCCESS)
+                return ret;
+
+            if (p_iter->page.empty()) {
+                *pp_entry = nullptr;
+                return SECURITY_MANAGER_SUCCESS;
+            }
+        }
+
+        *pp_entry = &p_iter->page[p_iter->pos++];
+        return SECURITY_MANAGER_SUCCESS;
+    });
+}
+
+SECURITY_MANAGER_API
+void security_manager_policy_iterator_free(policy_iterator *p_iter)
+{
+    delete p_iter;
+}
+
 SECURITY_MANAGER_API
 int security_manager_policy_entry_new(policy_entry **p_entry)
 {
@@ -913,41 +1255,55 @@ int security_manager_policy_levels_get(char ***levels, size_t *levels_count)
         return SECURITY_MANAGER_ERROR_INPUT_PARAM;
     return try_catch([&] {
 
-        //put data into buffer
-        Serialization::Serialize(send, static_cast<int>(SecurityModuleCall::POLICY_GET_DESCRIPTIONS));
-
-        //send buffer to server
-        int retval = sendToServer(SERVICE_SOCKET, send.Pop(), recv);
-        if (retval != SECURITY_MANAGER_API_SUCCESS) {
-            LogError("Error in sendToServer. Error code: " << retval);
-            return SECURITY_MANAGER_ERROR_UNKNOWN;
-        }
+        std::vector<std::string> vlevels;
+        uint64_t generation;
+        if (ClientCache::getInstance().get("levels", vlevels)) {
+            LogDebug("Policy descriptions found in cache");
+        } else {
+            bool cacheable = ClientCache::getInstance().begin(generation);
 
-        //receive response from server
-        Deserialization::Deserialize(recv, retval);
+            //put data into buffer
+            Serialization::Serialize(send, static_cast<int>(SecurityModuleCall::POLICY_GET_DESCRIPTIONS));
 
-        switch(retval) {
-            case SECURITY_MANAGER_API_SUCCESS:
-                // success - continue
-                break;
-            case SECURITY_MANAGER_API_ERROR_OUT_OF_MEMORY:
-                return SECURITY_MANAGER_ERROR_MEMORY;
-            case SECURITY_MANAGER_API_ERROR_INPUT_PARAM:
-                return SECURITY_MANAGER_ERROR_INPUT_PARAM;
-            default:
+            //send buffer to server
+            int retval = sendToServer(SERVICE_SOCKET, send.Pop(), recv);
+            if (retval != SECURITY_MANAGER_API_SUCCESS) {
+                LogError("Error in sendToServer. Error code: " << retval);
                 return SECURITY_MANAGER_ERROR_UNKNOWN;
+            }
+
+            //receive response from server
+            Deserialization::Deserialize(recv, retval);
+
+            switch(retval) {
+                case SECURITY_MANAGER_API_SUCCESS:
+                    // success - continue
+                    break;
+                case SECURITY_MANAGER_API_ERROR_OUT_OF_MEMORY:
+                    return SECURITY_MANAGER_ERROR_MEMORY;
+                case SECURITY_MANAGER_API_ERROR_INPUT_PARAM:
+                    return SECURITY_MANAGER_ERROR_INPUT_PARAM;
+                default:
+                    return SECURITY_MANAGER_ERROR_UNKNOWN;
+            }
+
+            int count;
+            Deserialization::Deserialize(recv, count);
+            vlevels.resize(count);
+            for (auto &level : vlevels)
+                Deserialization::Deserialize(recv, level);
+
+            if (cacheable)
+                ClientCache::getInstance().put("levels", generation, vlevels);
         }
 
-        int count;
-        Deserialization::Deserialize(recv, count);
-        *levels_count = count;
+        *levels_count = vlevels.size();
         LogInfo("Number of policy descriptions: " << *levels_count);
 
         char **array = new char *[*levels_count];
 
         for (unsigned int i = 0; i < *levels_count; ++i) {
-            std::string level;
-            Deserialization::Deserialize(recv, level);
+            const std::string &level = vlevels[i];
 
             if (level.empty()) {
                 LogError("Unexpected empty level");
@@ -1081,33 +1437,43 @@ int security_manager_groups_get(char ***groups, size_t *groups_count)
         return SECURITY_MANAGER_ERROR_INPUT_PARAM;
     return try_catch([&] {
 
-        //put data into buffer
-        Serialization::Serialize(send, static_cast<int>(SecurityModuleCall::GROUPS_GET));
-
-        //send buffer to server
-        int retval = sendToServer(SERVICE_SOCKET, send.Pop(), recv);
-        if (retval != SECURITY_MANAGER_API_SUCCESS) {
-            LogError("Error in sendToServer. Error code: " << retval);
-            return SECURITY_MANAGER_ERROR_UNKNOWN;
-        }
+        std::vector<std::string> vgroups;
+        uint64_t generation;
+        if (ClientCache::getInstance().get("groups", vgroups)) {
+            LogDebug("Groups found in cache");
+        } else {
+            bool cacheable = ClientCache::getInstance().begin(generation);
 
-        //receive response from server
-        Deserialization::Deserialize(recv, retval);
+            //put data into buffer
+            Serialization::Serialize(send, static_cast<int>(SecurityModuleCall::GROUPS_GET));
 
-        switch(retval) {
-            case SECURITY_MANAGER_API_SUCCESS:
-                // success - continue
-                break;
-            case SECURITY_MANAGER_API_ERROR_OUT_OF_MEMORY:
-                return SECURITY_MANAGER_ERROR_MEMORY;
-            case SECURITY_MANAGER_API_ERROR_INPUT_PARAM:
-                return SECURITY_MANAGER_ERROR_INPUT_PARAM;
-            default:
+            //send buffer to server
+            int retval = sendToServer(SERVICE_SOCKET, send.Pop(), recv);
+            if (retval != SECURITY_MANAGER_API_SUCCESS) {
+                LogError("Error in sendToServer. Error code: " << retval);
                 return SECURITY_MANAGER_ERROR_UNKNOWN;
+            }
+
+            //receive response from server
+            Deserialization::Deserialize(recv, retval);
+
+            switch(retval) {
+                case SECURITY_MANAGER_API_SUCCESS:
+                    // success - continue
+                    break;
+                case SECURITY_MANAGER_API_ERROR_OUT_OF_MEMORY:
+                    return SECURITY_MANAGER_ERROR_MEMORY;
+                case SECURITY_MANAGER_API_ERROR_INPUT_PARAM:
+                    return SECURITY_MANAGER_ERROR_INPUT_PARAM;
+                default:
+                    return SECURITY_MANAGER_ERROR_UNKNOWN;
+            }
+
+            Deserialization::Deserialize(recv, vgroups);
+            if (cacheable)
+                ClientCache::getInstance().put("groups", generation, vgroups);
         }
 
-        std::vector<std::string> vgroups;
-        Deserialization::Deserialize(recv, vgroups);
         const auto vgroups_size = vgroups.size();
         LogInfo("Number of groups: " << vgroups_size);
 
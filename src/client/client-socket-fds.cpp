@@ -0,0 +1,102 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        client-socket-fds.cpp
+ * @author      Rafal Krypa <r.krypa@samsung.com>
+ * @version     1.0
+ * @brief       Enumeration of open socket descriptors of the process
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <dpl/log/log.h>
+
+#include <client-socket-fds.h>
+#include <security-manager.h>
+
+namespace SecurityManager {
+
+/*
+ * Find open socket descriptors of the process. Entries of /proc/self/fd are
+ * read directly with getdents64, without a DIR stream. The directory is opened
+ * anew on every call: a descriptor opened before fork would list the parent's
+ * fds.
+ */
+int getSocketFds(std::vector<int> &fds)
+{
+    int dirFd = open("/proc/self/fd", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd == -1) {
+        LogError("Unable to read list of open file descriptors: " <<
+            strerror(errno));
+        return SECURITY_MANAGER_ERROR_UNKNOWN;
+    }
+
+    char buffer[16384];
+    for (;;) {
+        long nread = syscall(SYS_getdents64, dirFd, buffer, sizeof(buffer));
+        if (nread == -1) {
+            LogError("Unable to read list of open file descriptors: " <<
+                strerror(errno));
+            close(dirFd);
+            return SECURITY_MANAGER_ERROR_UNKNOWN;
+        }
+        if (nread == 0)
+            break;
+
+        for (long pos = 0; pos < nread;) {
+            struct linux_dirent64 {
+                ino64_t d_ino;
+                off64_t d_off;
+                unsigned short d_reclen;
+                unsigned char d_type;
+                char d_name[];
+            } *dirEntry = reinterpret_cast<struct linux_dirent64 *>(buffer + pos);
+            pos += dirEntry->d_reclen;
+
+            // Entries with numerical names specify file descriptors, ignore the rest
+            const char *name = dirEntry->d_name;
+            if (!isdigit(*name))
+                continue;
+            int fd = 0;
+            while (isdigit(*name))
+                fd = fd * 10 + (*name++ - '0');
+            if (fd == dirFd)
+                continue;
+
+            struct stat statBuf;
+            if (fstat(fd, &statBuf) != 0) {
+                LogWarning("fstat failed on file descriptor " << fd << ": " <<
+                    strerror(errno));
+                continue;
+            }
+            if (S_ISSOCK(statBuf.st_mode))
+                fds.push_back(fd);
+        }
+    }
+
+    close(dirFd);
+    return SECURITY_MANAGER_SUCCESS;
+}
+
+} // namespace SecurityManager
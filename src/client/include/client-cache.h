@@ -0,0 +1,86 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        client-cache.h
+ * @author      Rafal Krypa <r.krypa@samsung.com>
+ * @version     1.0
+ * @brief       Cache of results of requests to the service
+ */
+
+#ifndef _SECURITY_MANAGER_CLIENT_CACHE_
+#define _SECURITY_MANAGER_CLIENT_CACHE_
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace SecurityManager {
+
+/*
+ * Results of requests to the service, kept in the process when enabled.
+ * They are tagged with the generation counter published by the service
+ * along with the application snapshot, bumped on every change of
+ * applications or policies and on every service start. All results are
+ * dropped once the counter changes, so a valid lookup costs one atomic load.
+ */
+class ClientCache {
+public:
+    typedef std::vector<std::string> Value;
+
+    static ClientCache &getInstance();
+
+    void setEnabled(bool enabled);
+
+    /**
+     * Start a request whose result may be cached.
+     *
+     * @param[out] generation generation to pass to put() with the result
+     * @return false if results can't be cached now
+     */
+    bool begin(uint64_t &generation);
+
+    /**
+     * @return true if a valid result was found
+     */
+    bool get(const std::string &key, Value &value);
+
+    /**
+     * Remember a result obtained after begin(). It is ignored if anything
+     * changed in the meantime.
+     */
+    void put(const std::string &key, uint64_t generation, const Value &value);
+
+private:
+    /* Entries are dropped all at once when there are too many */
+    static const size_t CAPACITY = 1024;
+
+    ClientCache();
+
+    bool validate(uint64_t &generation);
+
+    std::mutex m_mutex;
+    bool m_enabled;
+    uint64_t m_generation;
+    std::unordered_map<std::string, Value> m_entries;
+};
+
+} // namespace SecurityManager
+
+#endif // _SECURITY_MANAGER_CLIENT_CACHE_
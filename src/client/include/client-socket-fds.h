@@ -0,0 +1,42 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        client-socket-fds.h
+ * @author      Rafal Krypa <r.krypa@samsung.com>
+ * @version     1.0
+ * @brief       Enumeration of open socket descriptors of the process
+ */
+
+#ifndef _SECURITY_MANAGER_CLIENT_SOCKET_FDS_
+#define _SECURITY_MANAGER_CLIENT_SOCKET_FDS_
+
+#include <vector>
+
+namespace SecurityManager {
+
+/*
+ * Find open socket descriptors of the process.
+ *
+ * @param[out] fds - found descriptors are appended here
+ * @return SECURITY_MANAGER_SUCCESS or SECURITY_MANAGER_ERROR_UNKNOWN
+ */
+int getSocketFds(std::vector<int> &fds);
+
+} // namespace SecurityManager
+
+#endif // _SECURITY_MANAGER_CLIENT_SOCKET_FDS_
@@ -0,0 +1,575 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        app-snapshot.cpp
+ * @author      Rafal Krypa <r.krypa@samsung.com>
+ * @version     1.0
+ * @brief       Read-only, memory mapped snapshot of application database
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <grp.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <sys/smack.h>
+#include <linux/xattr.h>
+
+#include <algorithm>
+#include <map>
+#include <utility>
+
+#include <dpl/errno_string.h>
+#include <dpl/log/log.h>
+#include <tzplatform_config.h>
+
+#include "app-snapshot.h"
+#include "privilege_db.h"
+
+namespace SecurityManager {
+
+using namespace AppSnapshot;
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2,
+    "Generation counter must be lock free to be shared between processes");
+
+namespace {
+
+/* Label readable for every process, snapshot holds only data available to all */
+const char *const SNAPSHOT_SMACK_LABEL = "_";
+
+std::string snapshotPath()
+{
+    return tzplatform_mkpath(TZ_SYS_RUN, "security-manager-apps.snapshot");
+}
+
+std::string generationPath()
+{
+    return tzplatform_mkpath(TZ_SYS_RUN, "security-manager-apps.generation");
+}
+
+uint32_t hashString(const char *str, size_t len)
+{
+    /* FNV-1a */
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= static_cast<unsigned char>(str[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+uint32_t align(uint32_t offset)
+{
+    return (offset + 7) & ~7u;
+}
+
+class SnapshotBuilder {
+public:
+    uint32_t addString(const std::string &str)
+    {
+        auto it = m_stringRefs.find(str);
+        if (it != m_stringRefs.end())
+            return it->second;
+
+        uint32_t ref = m_strings.size();
+        uint32_t len = str.size();
+        m_strings.append(reinterpret_cast<const char *>(&len), sizeof(len));
+        m_strings.append(str);
+        m_strings.push_back('\0');
+        m_strings.resize(align(m_strings.size()), '\0');
+        m_stringRefs.insert(std::make_pair(str, ref));
+        return ref;
+    }
+
+    void build(std::string &data, uint64_t generation)
+    {
+        std::vector<std::pair<std::string, std::string>> appPkgIds;
+        std::vector<std::pair<std::string, std::string>> privilegeGroups;
+
+        PrivilegeDb::getInstance().GetAllAppPkgIds(appPkgIds);
+        PrivilegeDb::getInstance().GetAllPrivilegeGroups(privilegeGroups);
+
+        /* The same application may be installed for many users */
+        for (size_t i = 0; i < appPkgIds.size(); ++i) {
+            if (i > 0 && appPkgIds[i - 1].first == appPkgIds[i].first)
+                continue;
+            m_apps.push_back({addString(appPkgIds[i].first), addString(appPkgIds[i].second)});
+        }
+
+        for (const auto &privilegeGroup : privilegeGroups) {
+            struct group *grp = getgrnam(privilegeGroup.second.c_str());
+            if (grp == NULL) {
+                LogError("No such group: " << privilegeGroup.second);
+                continue;
+            }
+
+            uint32_t privilegeRef = addString(privilegeGroup.first);
+            if (m_privilegeGroups.empty() || m_privilegeGroups.back().privilege != privilegeRef)
+                m_privilegeGroups.push_back({privilegeRef,
+                    static_cast<uint32_t>(m_gids.size()), 0});
+
+            m_gids.push_back(grp->gr_gid);
+            ++m_privilegeGroups.back().count;
+        }
+
+        buildAppIndex();
+        layout(data, generation);
+    }
+
+private:
+    void buildAppIndex()
+    {
+        uint32_t size = 1;
+        while (size < 2 * m_apps.size())
+            size <<= 1;
+
+        m_appIndex.assign(size, 0);
+        for (uint32_t i = 0; i < m_apps.size(); ++i) {
+            const char *str = m_strings.data() + m_apps[i].app + sizeof(uint32_t);
+            uint32_t slot = hashString(str, strlen(str)) & (size - 1);
+            while (m_appIndex[slot] != 0)
+                slot = (slot + 1) & (size - 1);
+            m_appIndex[slot] = i + 1;
+        }
+    }
+
+    template <typename T>
+    static void append(std::string &data, uint32_t &offset, uint32_t &count,
+        const std::vector<T> &section)
+    {
+        data.resize(align(data.size()), '\0');
+        offset = data.size();
+        count = section.size();
+        data.append(reinterpret_cast<const char *>(section.data()), section.size() * sizeof(T));
+    }
+
+    void layout(std::string &data, uint64_t generation)
+    {
+        Header header;
+        memset(&header, 0, sizeof(header));
+        data.assign(sizeof(header), '\0');
+
+        header.stringsOffset = data.size();
+        header.stringsSize = m_strings.size();
+        data.append(m_strings);
+
+        append(data, header.appsOffset, header.appsCount, m_apps);
+        append(data, header.appIndexOffset, header.appIndexSize, m_appIndex);
+        append(data, header.privilegeGroupsOffset, header.privilegeGroupsCount, m_privilegeGroups);
+        append(data, header.gidsOffset, header.gidsCount, m_gids);
+
+        header.magic = MAGIC;
+        header.version = VERSION;
+        header.generation = generation;
+        header.size = data.size();
+        memcpy(&data[0], &header, sizeof(header));
+    }
+
+    std::string m_strings;
+    std::map<std::string, uint32_t> m_stringRefs;
+    std::vector<AppEntry> m_apps;
+    std::vector<uint32_t> m_appIndex;
+    std::vector<PrivilegeGroupsEntry> m_privilegeGroups;
+    std::vector<uint32_t> m_gids;
+};
+
+void setSmackLabel(int fd, const std::string &path)
+{
+    if (smack_smackfs_path() == NULL)
+        return;
+
+    if (fsetxattr(fd, XATTR_NAME_SMACK, SNAPSHOT_SMACK_LABEL,
+            strlen(SNAPSHOT_SMACK_LABEL), 0) != 0)
+        LogWarning("Cannot set Smack label of " << path << ": " << GetErrnoString(errno));
+}
+
+void writeFile(int fd, const std::string &path, const std::string &data)
+{
+    const char *buf = data.data();
+    size_t left = data.size();
+
+    while (left > 0) {
+        ssize_t ret = TEMP_FAILURE_RETRY(write(fd, buf, left));
+        if (ret < 0) {
+            LogError("Cannot write " << path << ": " << GetErrnoString(errno));
+            ThrowMsg(AppSnapshotException::FileError, "Cannot write " << path);
+        }
+        buf += ret;
+        left -= ret;
+    }
+}
+
+class GenerationCounter {
+public:
+    static GenerationCounter &getInstance()
+    {
+        static GenerationCounter instance;
+        return instance;
+    }
+
+    uint64_t get()
+    {
+        map();
+        return m_generation->value.load(std::memory_order_relaxed);
+    }
+
+    void set(uint64_t generation)
+    {
+        map();
+        m_generation->value.store(generation, std::memory_order_release);
+    }
+
+private:
+    GenerationCounter() : m_generation(nullptr) {}
+
+    void map()
+    {
+        if (m_generation != nullptr)
+            return;
+
+        std::string path = generationPath();
+        int fd = TEMP_FAILURE_RETRY(open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644));
+        if (fd < 0) {
+            LogError("Cannot open " << path << ": " << GetErrnoString(errno));
+            ThrowMsg(AppSnapshotException::FileError, "Cannot open " << path);
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 ||
+                (static_cast<size_t>(st.st_size) < sizeof(Generation) &&
+                 ftruncate(fd, sizeof(Generation)) != 0)) {
+            LogError("Cannot resize " << path << ": " << GetErrnoString(errno));
+            close(fd);
+            ThrowMsg(AppSnapshotException::FileError, "Cannot resize " << path);
+        }
+        setSmackLabel(fd, path);
+
+        void *ptr = mmap(NULL, sizeof(Generation), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (ptr == MAP_FAILED) {
+            LogError("Cannot map " << path << ": " << GetErrnoString(errno));
+            ThrowMsg(AppSnapshotException::FileError, "Cannot map " << path);
+        }
+
+        m_generation = static_cast<Generation *>(ptr);
+        m_generation->magic = GENERATION_MAGIC;
+    }
+
+    Generation *m_generation;
+};
+
+std::mutex writerMutex;
+bool snapshotOutdated = false;
+
+} // namespace anonymous
+
+void AppSnapshotWriter::publish()
+{
+    std::lock_guard<std::mutex> lock(writerMutex);
+    GenerationCounter &counter = GenerationCounter::getInstance();
+    uint64_t generation = counter.get() + 1;
+
+    std::string data;
+    SnapshotBuilder().build(data, generation);
+
+    std::string path = snapshotPath();
+    std::string tmpPath = path + ".XXXXXX";
+    int fd = mkostemp(&tmpPath[0], O_CLOEXEC);
+    if (fd < 0) {
+        LogError("Cannot create " << tmpPath << ": " << GetErrnoString(errno));
+        ThrowMsg(AppSnapshotException::FileError, "Cannot create " << tmpPath);
+    }
+
+    try {
+        writeFile(fd, tmpPath, data);
+        if (fchmod(fd, 0644) != 0) {
+            LogError("Cannot chmod " << tmpPath << ": " << GetErrnoString(errno));
+            ThrowMsg(AppSnapshotException::FileError, "Cannot chmod " << tmpPath);
+        }
+        setSmackLabel(fd, tmpPath);
+        close(fd);
+        fd = -1;
+
+        if (rename(tmpPath.c_str(), path.c_str()) != 0) {
+            LogError("Cannot rename " << tmpPath << ": " << GetErrnoString(errno));
+            ThrowMsg(AppSnapshotException::FileError, "Cannot rename " << tmpPath);
+        }
+    } catch (...) {
+        if (fd >= 0)
+            close(fd);
+        unlink(tmpPath.c_str());
+        throw;
+    }
+
+    counter.set(generation);
+    snapshotOutdated = false;
+    LogDebug("Published application snapshot, generation " << generation <<
+        ", " << data.size() << " bytes");
+}
+
+void AppSnapshotWriter::markChanged()
+{
+    std::lock_guard<std::mutex> lock(writerMutex);
+    snapshotOutdated = true;
+
+    try {
+        GenerationCounter &counter = GenerationCounter::getInstance();
+        counter.set(counter.get() + 1);
+    } catch (const AppSnapshotException::Base &e) {
+        LogError("Cannot bump snapshot generation: " << e.DumpToString());
+    }
+}
+
+bool AppSnapshotWriter::isOutdated()
+{
+    std::lock_guard<std::mutex> lock(writerMutex);
+    return snapshotOutdated;
+}
+
+void AppSnapshotWriter::invalidate()
+{
+    std::lock_guard<std::mutex> lock(writerMutex);
+    std::string path = snapshotPath();
+    snapshotOutdated = false;
+
+    if (unlink(path.c_str()) != 0 && errno != ENOENT)
+        LogError("Cannot remove " << path << ": " << GetErrnoString(errno));
+
+    try {
+        GenerationCounter &counter = GenerationCounter::getInstance();
+        counter.set(counter.get() + 1);
+    } catch (const AppSnapshotException::Base &e) {
+        LogError("Cannot bump snapshot generation: " << e.DumpToString());
+    }
+}
+
+AppSnapshotReader::AppSnapshotReader()
+    : m_generation(nullptr), m_data(nullptr), m_size(0), m_checkedGeneration(0)
+{
+}
+
+AppSnapshotReader::~AppSnapshotReader()
+{
+    unmapSnapshot();
+    if (m_generation != nullptr)
+        munmap(const_cast<Generation *>(m_generation), sizeof(Generation));
+}
+
+AppSnapshotReader &AppSnapshotReader::getInstance()
+{
+    static AppSnapshotReader instance;
+    return instance;
+}
+
+bool AppSnapshotReader::mapGeneration()
+{
+    std::string path = generationPath();
+    int fd = TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    void *ptr = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(Generation))
+        ptr = mmap(NULL, sizeof(Generation), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED)
+        return false;
+
+    m_generation = static_cast<const Generation *>(ptr);
+    if (m_generation->magic != GENERATION_MAGIC) {
+        munmap(ptr, sizeof(Generation));
+        m_generation = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
+bool AppSnapshotReader::mapSnapshot()
+{
+    std::string path = snapshotPath();
+    int fd = TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd < 0) {
+        LogDebug("Application snapshot not available: " << GetErrnoString(errno));
+        return false;
+    }
+
+    struct stat st;
+    void *ptr = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(Header))
+        ptr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED)
+        return false;
+
+    m_data = static_cast<const char *>(ptr);
+    m_size = st.st_size;
+
+    const Header *hdr = header();
+    auto fits = [&](uint32_t offset, uint64_t bytes) {
+        return offset % 4 == 0 && offset + bytes <= m_size;
+    };
+    if (hdr->magic != MAGIC || hdr->version != VERSION || hdr->size != m_size ||
+            hdr->generation < m_checkedGeneration ||
+            !fits(hdr->stringsOffset, hdr->stringsSize) ||
+            !fits(hdr->appsOffset, uint64_t(hdr->appsCount) * sizeof(AppEntry)) ||
+            !fits(hdr->appIndexOffset, uint64_t(hdr->appIndexSize) * sizeof(uint32_t)) ||
+            (hdr->appIndexSize & (hdr->appIndexSize - 1)) != 0 || hdr->appIndexSize == 0 ||
+            !fits(hdr->privilegeGroupsOffset,
+                uint64_t(hdr->privilegeGroupsCount) * sizeof(PrivilegeGroupsEntry)) ||
+            !fits(hdr->gidsOffset, uint64_t(hdr->gidsCount) * sizeof(uint32_t))) {
+        LogWarning("Ignoring invalid or outdated application snapshot");
+        unmapSnapshot();
+        return false;
+    }
+
+    LogDebug("Mapped application snapshot, generation " << hdr->generation);
+    return true;
+}
+
+void AppSnapshotReader::unmapSnapshot()
+{
+    if (m_data != nullptr)
+        munmap(const_cast<char *>(m_data), m_size);
+    m_data = nullptr;
+    m_size = 0;
+}
+
+bool AppSnapshotReader::refresh()
+{
+    if (m_generation == nullptr && !mapGeneration())
+        return false;
+
+    uint64_t generation = m_generation->value.load(std::memory_order_acquire);
+    if (m_data != nullptr && generation <= header()->generation)
+        return true;
+    if (m_data == nullptr && generation == m_checkedGeneration)
+        return false;
+
+    unmapSnapshot();
+    m_checkedGeneration = generation;
+    return mapSnapshot();
+}
+
+const Header *AppSnapshotReader::header() const
+{
+    return reinterpret_cast<const Header *>(m_data);
+}
+
+template <typename T>
+const T *AppSnapshotReader::section(uint32_t offset) const
+{
+    return reinterpret_cast<const T *>(m_data + offset);
+}
+
+bool AppSnapshotReader::stringAt(uint32_t ref, const char *&str, uint32_t &len) const
+{
+    const Header *hdr = header();
+    if (ref % 4 != 0 || uint64_t(ref) + sizeof(uint32_t) > hdr->stringsSize)
+        return false;
+
+    len = *section<uint32_t>(hdr->stringsOffset + ref);
+    if (uint64_t(ref) + sizeof(uint32_t) + len >= hdr->stringsSize)
+        return false;
+
+    str = m_data + hdr->stringsOffset + ref + sizeof(uint32_t);
+    return true;
+}
+
+int AppSnapshotReader::compareString(uint32_t ref, const std::string &str) const
+{
+    const char *data = "";
+    uint32_t len = 0;
+    stringAt(ref, data, len);
+
+    int cmp = memcmp(data, str.data(), std::min<size_t>(len, str.size()));
+    if (cmp != 0)
+        return cmp;
+    return (len > str.size()) - (len < str.size());
+}
+
+bool AppSnapshotReader::getGeneration(uint64_t &generation)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_generation == nullptr && !mapGeneration())
+        return false;
+
+    generation = m_generation->value.load(std::memory_order_acquire);
+    return true;
+}
+
+bool AppSnapshotReader::getPkgId(const std::string &appId, std::string &pkgId)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!refresh())
+        return false;
+
+    const Header *hdr = header();
+    const AppEntry *apps = section<AppEntry>(hdr->appsOffset);
+    const uint32_t *index = section<uint32_t>(hdr->appIndexOffset);
+    uint32_t mask = hdr->appIndexSize - 1;
+
+    for (uint32_t slot = hashString(appId.data(), appId.size()) & mask, probes = 0;
+            index[slot] != 0 && probes <= mask; slot = (slot + 1) & mask, ++probes) {
+        uint32_t i = index[slot] - 1;
+        if (i >= hdr->appsCount || compareString(apps[i].app, appId) != 0)
+            continue;
+
+        const char *str;
+        uint32_t len;
+        if (!stringAt(apps[i].pkg, str, len))
+            return false;
+        pkgId.assign(str, len);
+        return true;
+    }
+
+    return false;
+}
+
+bool AppSnapshotReader::getPrivilegeGids(const std::string &privilege, std::vector<gid_t> &gids)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!refresh())
+        return false;
+
+    const Header *hdr = header();
+    const PrivilegeGroupsEntry *begin = section<PrivilegeGroupsEntry>(hdr->privilegeGroupsOffset);
+    const PrivilegeGroupsEntry *end = begin + hdr->privilegeGroupsCount;
+    const PrivilegeGroupsEntry *it = std::lower_bound(begin, end, privilege,
+        [&](const PrivilegeGroupsEntry &entry, const std::string &privilege) {
+            return compareString(entry.privilege, privilege) < 0;
+        });
+
+    gids.clear();
+    if (it == end || compareString(it->privilege, privilege) != 0)
+        return true;
+
+    const uint32_t *snapshotGids = section<uint32_t>(hdr->gidsOffset);
+    for (uint32_t i = it->first; i < it->first + it->count && i < hdr->gidsCount; ++i)
+        gids.push_back(snapshotGids[i]);
+
+    return true;
+}
+
+} // namespace SecurityManager
@@ -45,6 +45,9 @@ namespace {
 
 const int POLL_TIMEOUT = -1;
 
+/* Largest accepted response, protects the client from a bogus length prefix */
+const size_t RESPONSE_SIZE_MAX = 64 * 1024 * 1024;
+
 int waitForSocket(int sock, int event, int timeout) {
     int retval;
     pollfd desc[1];
@@ -65,6 +68,40 @@ int waitForSocket(int sock, int event, int timeout) {
     return retval;
 }
 
+/*
+ * Read exactly given number of bytes from non-blocking socket. Data already
+ * received is read right away, poll is only needed when there is none.
+ */
+int readFromSocket(int sock, void *data, size_t size) {
+    char *ptr = static_cast<char *>(data);
+
+    while (size > 0) {
+        ssize_t temp = TEMP_FAILURE_RETRY(read(sock, ptr, size));
+        if (-1 == temp) {
+            int err = errno;
+            if (err == EAGAIN || err == EWOULDBLOCK) {
+                if (0 >= waitForSocket(sock, POLLIN, POLL_TIMEOUT)) {
+                    LogError("Error in poll(POLLIN)");
+                    return SECURITY_MANAGER_API_ERROR_SOCKET;
+                }
+                continue;
+            }
+            LogError("Error in read: " << strerror(err));
+            return SECURITY_MANAGER_API_ERROR_SOCKET;
+        }
+
+        if (0 == temp) {
+            LogError("Read return 0/Connection closed by server(?)");
+            return SECURITY_MANAGER_API_ERROR_SOCKET;
+        }
+
+        ptr += temp;
+        size -= temp;
+    }
+
+    return SECURITY_MANAGER_API_SUCCESS;
+}
+
 class SockRAII {
 public:
     SockRAII()
@@ -157,6 +194,12 @@ public:
         return m_sock;
     }
 
+    int Release() {
+        int sock = m_sock;
+        m_sock = -1;
+        return sock;
+    }
+
 private:
     int m_sock;
 };
@@ -169,7 +212,6 @@ int sendToServer(char const * const interface, const RawBuffer &send, MessageBuf
     int ret;
     SockRAII sock;
     ssize_t done = 0;
-    char buffer[2048];
 
     if (SECURITY_MANAGER_API_SUCCESS != (ret = sock.Connect(interface))) {
         LogError("Error in SockRAII");
@@ -190,26 +232,37 @@ int sendToServer(char const * const interface, const RawBuffer &send, MessageBuf
         done += temp;
     }
 
-    do {
-        if (0 >= waitForSocket(sock.Get(), POLLIN, POLL_TIMEOUT)) {
-            LogError("Error in poll(POLLIN)");
-            return SECURITY_MANAGER_API_ERROR_SOCKET;
-        }
-        ssize_t temp = TEMP_FAILURE_RETRY(read(sock.Get(), buffer, 2048));
-        if (-1 == temp) {
-            int err = errno;
-            LogError("Error in read: " << strerror(err));
-            return SECURITY_MANAGER_API_ERROR_SOCKET;
-        }
+    // Read the length prefix first, so that the whole message can be read
+    // into a single buffer and handed over to MessageBuffer without copying
+    size_t size;
+    if (SECURITY_MANAGER_API_SUCCESS != (ret = readFromSocket(sock.Get(), &size, sizeof(size))))
+        return ret;
 
-        if (0 == temp) {
-            LogError("Read return 0/Connection closed by server(?)");
-            return SECURITY_MANAGER_API_ERROR_SOCKET;
-        }
+    if (size > RESPONSE_SIZE_MAX) {
+        LogError("Response of " << size << " bytes exceeds limit of " << RESPONSE_SIZE_MAX);
+        return SECURITY_MANAGER_API_ERROR_BAD_REQUEST;
+    }
+
+    RawBuffer message(sizeof(size) + size);
+    memcpy(&message[0], &size, sizeof(size));
+    if (SECURITY_MANAGER_API_SUCCESS !=
+            (ret = readFromSocket(sock.Get(), &message[sizeof(size)], size)))
+        return ret;
+
+    recv.Push(std::move(message));
+    return SECURITY_MANAGER_API_SUCCESS;
+}
+
+int connectToServer(char const * const interface, int &sock) {
+    int ret;
+    SockRAII sockRAII;
+
+    if (SECURITY_MANAGER_API_SUCCESS != (ret = sockRAII.Connect(interface))) {
+        LogError("Error in SockRAII");
+        return ret;
+    }
 
-        RawBuffer raw(buffer, buffer+temp);
-        recv.Push(raw);
-    } while(!recv.Ready());
+    sock = sockRAII.Release();
     return SECURITY_MANAGER_API_SUCCESS;
 }
 
@@ -21,9 +21,19 @@
  * @brief       Wrapper class for Cynara interface
  */
 
+#include <algorithm>
 #include <cstring>
+#include <limits>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <linux/futex.h>
+#include <tzplatform_config.h>
 #include "cynara.h"
 
+#include <dpl/errno_string.h>
 #include <dpl/log/log.h>
 
 namespace SecurityManager {
@@ -204,6 +214,290 @@ CynaraAdminPolicy::~CynaraAdminPolicy()
     free(this->result_extra);
 }
 
+CynaraAdminPolicyBatch::CynaraAdminPolicyBatch()
+    : m_blockUsed(0)
+    , m_blockSize(0)
+{
+}
+
+size_t CynaraAdminPolicyBatch::CStrHash::operator()(const char *str) const
+{
+    /* FNV-1a */
+    size_t hash = 2166136261u;
+    for (; *str; ++str) {
+        hash ^= static_cast<unsigned char>(*str);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+bool CynaraAdminPolicyBatch::CStrEqual::operator()(const char *a, const char *b) const
+{
+    return strcmp(a, b) == 0;
+}
+
+char *CynaraAdminPolicyBatch::intern(const std::string &str)
+{
+    auto it = m_strings.find(str.c_str());
+    if (it != m_strings.end())
+        return const_cast<char *>(*it);
+
+    size_t len = str.size() + 1;
+    if (m_blocks.empty() || m_blockUsed + len > m_blockSize) {
+        m_blockSize = std::max(len, ARENA_BLOCK_SIZE);
+        m_blocks.emplace_back(new char[m_blockSize]);
+        m_blockUsed = 0;
+    }
+
+    char *ptr = m_blocks.back().get() + m_blockUsed;
+    memcpy(ptr, str.c_str(), len);
+    m_blockUsed += len;
+    m_strings.insert(ptr);
+    return ptr;
+}
+
+void CynaraAdminPolicyBatch::add(const std::string &client, const std::string &user,
+    const std::string &privilege, int operation, const std::string &bucket)
+{
+    struct cynara_admin_policy policy;
+    policy.bucket = intern(bucket);
+    policy.client = intern(client);
+    policy.user = intern(user);
+    policy.privilege = intern(privilege);
+    policy.result = operation;
+    policy.result_extra = nullptr;
+    m_policies.push_back(policy);
+}
+
+void CynaraAdminPolicyBatch::add(const std::string &client, const std::string &user,
+    const std::string &privilege, const std::string &goToBucket, const std::string &bucket)
+{
+    struct cynara_admin_policy policy;
+    policy.bucket = intern(bucket);
+    policy.client = intern(client);
+    policy.user = intern(user);
+    policy.privilege = intern(privilege);
+    policy.result = CYNARA_ADMIN_BUCKET;
+    policy.result_extra = intern(goToBucket);
+    m_policies.push_back(policy);
+}
+
+const struct cynara_admin_policy *const *CynaraAdminPolicyBatch::data() const
+{
+    m_pointers.clear();
+    m_pointers.reserve(m_policies.size() + 1);
+    for (const auto &policy : m_policies)
+        m_pointers.push_back(&policy);
+    m_pointers.push_back(nullptr);
+
+    return m_pointers.data();
+}
+
+void CynaraAdminPolicyBatch::clear()
+{
+    m_policies.clear();
+    m_pointers.clear();
+    m_strings.clear();
+    m_blocks.clear();
+    m_blockUsed = 0;
+    m_blockSize = 0;
+}
+
+double CynaraCacheStats::hitRatio() const
+{
+    uint64_t lookups = hits + misses;
+    return lookups ? static_cast<double>(hits) / lookups : 0.0;
+}
+
+namespace {
+
+/* Policy database of Cynara service, rewritten on every change of policies */
+const char *const CYNARA_DB_DIR = "/var/cynara/db";
+
+} // namespace anonymous
+
+CynaraDecisionCache::CynaraDecisionCache(size_t capacity, SessionPolicy sessionPolicy)
+    : m_capacity(capacity)
+    , m_sessionPolicy(sessionPolicy)
+    , m_stats()
+    , m_missLatency(std::chrono::steady_clock::duration::zero())
+    , m_timedMisses(0)
+    , m_epoch(0)
+    , m_watchFd(-1)
+{
+}
+
+CynaraDecisionCache &CynaraDecisionCache::getInstance()
+{
+    static CynaraDecisionCache cache;
+    return cache;
+}
+
+std::string CynaraDecisionCache::makeKey(const std::string &label, const std::string &user,
+    const std::string &privilege, const std::string &session) const
+{
+    std::string key;
+    key.reserve(label.size() + user.size() + privilege.size() + session.size() + 3);
+    key.append(label).push_back('\0');
+    key.append(user).push_back('\0');
+    key.append(privilege);
+    if (m_sessionPolicy == SessionPolicy::PerSession)
+        key.append(1, '\0').append(session);
+    return key;
+}
+
+bool CynaraDecisionCache::get(const std::string &label, const std::string &user,
+    const std::string &privilege, const std::string &session, bool &allowed)
+{
+    std::string key = makeKey(label, user, privilege, session);
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    if (m_watchFd == -1)
+        return false;
+
+    auto it = m_entries.find(key);
+    if (it == m_entries.end()) {
+        ++m_stats.misses;
+        return false;
+    }
+
+    ++m_stats.hits;
+    if (m_timedMisses)
+        m_stats.savedLatency += std::chrono::duration_cast<std::chrono::microseconds>(
+            m_missLatency / m_timedMisses);
+
+    m_lru.splice(m_lru.begin(), m_lru, it->second);
+    allowed = it->second->allowed;
+    return true;
+}
+
+uint64_t CynaraDecisionCache::epoch()
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return m_epoch;
+}
+
+void CynaraDecisionCache::put(const std::string &label, const std::string &user,
+    const std::string &privilege, const std::string &session, bool allowed,
+    uint64_t epoch, std::chrono::steady_clock::duration latency)
+{
+    std::string key = makeKey(label, user, privilege, session);
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    if (m_watchFd == -1)
+        return;
+
+    m_missLatency += latency;
+    ++m_timedMisses;
+
+    if (epoch != m_epoch) {
+        LogDebug("Policy changed while asking Cynara, not caching the decision");
+        return;
+    }
+
+    auto it = m_entries.find(key);
+    if (it != m_entries.end()) {
+        it->second->allowed = allowed;
+        m_lru.splice(m_lru.begin(), m_lru, it->second);
+        return;
+    }
+
+    if (m_entries.size() >= m_capacity) {
+        m_entries.erase(m_lru.back().key);
+        m_lru.pop_back();
+    }
+
+    m_lru.push_front(Entry{key, label, user, privilege, allowed});
+    m_entries[key] = m_lru.begin();
+}
+
+void CynaraDecisionCache::invalidate(const std::string &label, const std::string &user,
+    const std::string &privilege)
+{
+    auto matches = [](const std::string &pattern, const std::string &value) {
+        return pattern == CYNARA_ADMIN_WILDCARD || pattern == CYNARA_ADMIN_ANY ||
+            pattern == value;
+    };
+
+    std::lock_guard<std::mutex> guard(m_mutex);
+    ++m_epoch;
+    for (auto it = m_lru.begin(); it != m_lru.end();) {
+        if (matches(label, it->label) && matches(user, it->user) &&
+                matches(privilege, it->privilege)) {
+            m_entries.erase(it->key);
+            it = m_lru.erase(it);
+            ++m_stats.invalidations;
+        } else
+            ++it;
+    }
+}
+
+void CynaraDecisionCache::flush()
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    LogDebug("Flushing Cynara decision cache, " << m_entries.size() << " entries");
+    ++m_epoch;
+    m_entries.clear();
+    m_lru.clear();
+    ++m_stats.flushes;
+}
+
+int CynaraDecisionCache::StartWatching()
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    if (m_watchFd != -1)
+        return m_watchFd;
+
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd == -1) {
+        LogError("Cannot initialize inotify: " << GetErrnoString(errno));
+        return -1;
+    }
+
+    // Cynara saves its database by writing new files and renaming them
+    if (inotify_add_watch(fd, CYNARA_DB_DIR,
+            IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE) == -1) {
+        LogError("Cannot watch " << CYNARA_DB_DIR << ", Cynara decisions won't be cached: " <<
+            GetErrnoString(errno));
+        close(fd);
+        return -1;
+    }
+
+    m_watchFd = fd;
+    ++m_epoch;
+    m_entries.clear();
+    m_lru.clear();
+    return m_watchFd;
+}
+
+void CynaraDecisionCache::ProcessWatchEvents(const std::vector<unsigned char> &events)
+{
+    // Every event in the database directory may be a policy change
+    if (!events.empty()) {
+        LogDebug("Cynara database changed");
+        flush();
+    }
+}
+
+CynaraCacheStats CynaraDecisionCache::getStats()
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    CynaraCacheStats stats = m_stats;
+    stats.entries = m_entries.size();
+    return stats;
+}
+
+void CynaraDecisionCache::logStats()
+{
+    CynaraCacheStats stats = getStats();
+    LogInfo("Cynara decision cache: entries: " << stats.entries <<
+        ", hits: " << stats.hits << ", misses: " << stats.misses <<
+        ", hit ratio: " << stats.hitRatio() <<
+        ", saved latency: " << stats.savedLatency.count() << " us" <<
+        ", invalidations: " << stats.invalidations << ", flushes: " << stats.flushes);
+}
+
 static bool checkCynaraError(int result, const std::string &msg)
 {
     switch (result) {
@@ -236,17 +530,250 @@ static bool checkCynaraError(int result, const std::string &msg)
 CynaraAdmin::TypeToDescriptionMap CynaraAdmin::TypeToDescription;
 CynaraAdmin::DescriptionToTypeMap CynaraAdmin::DescriptionToType;
 
+namespace {
+
+std::string pendingPoliciesMarkerPath()
+{
+    return tzplatform_mkpath(TZ_SYS_DB, ".security-manager-cynara.pending");
+}
+
+bool markPendingPolicies()
+{
+    std::string path = pendingPoliciesMarkerPath();
+    int fd = TEMP_FAILURE_RETRY(open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0600));
+    if (fd == -1) {
+        LogError("Cannot create " << path << ": " << GetErrnoString(errno));
+        return false;
+    }
+    int ret = fsync(fd);
+    close(fd);
+    if (ret == -1)
+        return false;
+
+    // Make the new directory entry durable as well
+    std::string dir = path.substr(0, path.rfind('/'));
+    fd = TEMP_FAILURE_RETRY(open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (fd == -1)
+        return false;
+    ret = fsync(fd);
+    close(fd);
+    return ret == 0;
+}
+
+/* Default backend, connected to Cynara service with libcynara-admin */
+class CynaraAdminLibraryBackend : public CynaraAdminBackend
+{
+public:
+    CynaraAdminLibraryBackend()
+    {
+        checkCynaraError(
+            cynara_admin_initialize(&m_CynaraAdmin),
+            "Cannot connect to Cynara administrative interface.");
+    }
+
+    virtual ~CynaraAdminLibraryBackend()
+    {
+        cynara_admin_finish(m_CynaraAdmin);
+    }
+
+    virtual int setPolicies(const struct cynara_admin_policy *const *policies)
+    {
+        return cynara_admin_set_policies(m_CynaraAdmin, policies);
+    }
+
+    virtual int listPolicies(const char *bucket, const char *client, const char *user,
+        const char *privilege, struct cynara_admin_policy ***policies)
+    {
+        return cynara_admin_list_policies(m_CynaraAdmin, bucket, client, user,
+            privilege, policies);
+    }
+
+    virtual int erase(const char *startBucket, int recursive, const char *client,
+        const char *user, const char *privilege)
+    {
+        return cynara_admin_erase(m_CynaraAdmin, startBucket, recursive, client,
+            user, privilege);
+    }
+
+    virtual int check(const char *startBucket, int recursive, const char *client,
+        const char *user, const char *privilege, int *result, char **resultExtra)
+    {
+        return cynara_admin_check(m_CynaraAdmin, startBucket, recursive, client,
+            user, privilege, result, resultExtra);
+    }
+
+    virtual int listPoliciesDescriptions(struct cynara_admin_policy_descr ***descriptions)
+    {
+        return cynara_admin_list_policies_descriptions(m_CynaraAdmin, descriptions);
+    }
+
+private:
+    struct cynara_admin *m_CynaraAdmin;
+};
+
+} // namespace anonymous
+
+unsigned int CynaraAdmin::s_updateWindowMs = 0;
+std::shared_ptr<CynaraAdminBackend> CynaraAdmin::s_backend;
+
 CynaraAdmin::CynaraAdmin()
-    : m_policyDescriptionsInitialized(false)
+    : m_backend(s_backend ? s_backend : std::make_shared<CynaraAdminLibraryBackend>())
+    , m_policyDescriptionsInitialized(false)
+    , m_updateTimerFd(-1)
+    , m_pendingMarked(false)
+    , m_pendingMarkHolds(0)
 {
-    checkCynaraError(
-        cynara_admin_initialize(&m_CynaraAdmin),
-        "Cannot connect to Cynara administrative interface.");
+
+    if (s_updateWindowMs) {
+        m_updateTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (m_updateTimerFd == -1)
+            LogError("Cannot create timer, policy updates won't be coalesced: " <<
+                GetErrnoString(errno));
+    }
 }
 
 CynaraAdmin::~CynaraAdmin()
 {
-    cynara_admin_finish(m_CynaraAdmin);
+    try {
+        FlushPendingPolicies();
+    } catch (...) {
+        LogError("Unexpected error while sending queued policies to Cynara");
+    }
+}
+
+void CynaraAdmin::setUpdateWindow(unsigned int windowMs)
+{
+    s_updateWindowMs = windowMs;
+}
+
+void CynaraAdmin::setBackend(std::shared_ptr<CynaraAdminBackend> backend)
+{
+    s_backend = std::move(backend);
+}
+
+bool CynaraAdmin::HasLostPolicies()
+{
+    return access(pendingPoliciesMarkerPath().c_str(), F_OK) == 0;
+}
+
+void CynaraAdmin::ClearLostPolicies()
+{
+    std::string path = pendingPoliciesMarkerPath();
+    if (unlink(path.c_str()) == -1 && errno != ENOENT)
+        LogError("Cannot remove " << path << ": " << GetErrnoString(errno));
+}
+
+void CynaraAdmin::ArmUpdateTimer(bool arm)
+{
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (arm) {
+        spec.it_value.tv_sec = s_updateWindowMs / 1000;
+        spec.it_value.tv_nsec = (s_updateWindowMs % 1000) * 1000000L;
+    }
+
+    if (timerfd_settime(m_updateTimerFd, 0, &spec, nullptr) == -1)
+        LogError("Cannot set policy update timer: " << GetErrnoString(errno));
+}
+
+bool CynaraAdmin::MarkPendingPolicies()
+{
+    std::lock_guard<std::recursive_mutex> guard(m_mutex);
+
+    if (!m_pendingMarked)
+        m_pendingMarked = markPendingPolicies();
+    if (m_pendingMarked)
+        ++m_pendingMarkHolds;
+    return m_pendingMarked;
+}
+
+void CynaraAdmin::ReleasePendingMark()
+{
+    std::lock_guard<std::recursive_mutex> guard(m_mutex);
+
+    if (m_pendingMarkHolds > 0)
+        --m_pendingMarkHolds;
+    else
+        LogWarning("Marker of pending policies released without holding it");
+
+    ClearUnusedMark();
+}
+
+void CynaraAdmin::ClearUnusedMark()
+{
+    if (!m_pendingMarked || m_pendingMarkHolds > 0 || !m_pendingPolicies.empty())
+        return;
+
+    ClearLostPolicies();
+    m_pendingMarked = false;
+}
+
+void CynaraAdmin::QueueAppPolicy(const std::string &label, const std::string &user,
+    const std::vector<std::string> &oldPrivileges,
+    const std::vector<std::string> &newPrivileges)
+{
+    std::lock_guard<std::recursive_mutex> guard(m_mutex);
+
+    if (m_updateTimerFd == -1) {
+        UpdateAppPolicy(label, user, oldPrivileges, newPrivileges);
+        return;
+    }
+
+    // Take over the hold of the marker from MarkPendingPolicies()
+    bool durable = m_pendingMarked;
+    if (m_pendingMarkHolds > 0)
+        --m_pendingMarkHolds;
+    else
+        LogWarning("Policy update queued without marking it as pending first");
+
+    PrivilegeChanges changes;
+    CalculateAppPolicy(label, user, oldPrivileges, newPrivileges, changes);
+    if (changes.empty()) {
+        ClearUnusedMark();
+        return;
+    }
+
+    // Without the marker a crash would lose queued updates, don't defer them
+    if (durable && m_pendingPolicies.empty())
+        ArmUpdateTimer(true);
+
+    for (const auto &change : changes)
+        m_pendingPolicies[std::make_tuple(label, user, change.first)] = change.second;
+
+    LogDebug("Queued " << changes.size() << " policies, pending: " << m_pendingPolicies.size());
+
+    if (!durable || m_pendingPolicies.size() >= POLICY_QUEUE_MAX)
+        FlushPendingPolicies();
+}
+
+void CynaraAdmin::FlushPendingPolicies()
+{
+    std::lock_guard<std::recursive_mutex> guard(m_mutex);
+
+    if (m_pendingPolicies.empty())
+        return;
+
+    ArmUpdateTimer(false);
+
+    CynaraAdminPolicyBatch policies;
+    const std::string &bucket = Buckets.at(Bucket::MANIFESTS);
+    for (const auto &pending : m_pendingPolicies)
+        policies.add(std::get<0>(pending.first), std::get<1>(pending.first),
+            std::get<2>(pending.first), pending.second, bucket);
+
+    try {
+        SetPolicies(policies.data(), policies.size());
+    } catch (const CynaraException::Base &e) {
+        LogError("Cannot send " << policies.size() << " queued policies to Cynara, "
+            "will retry: " << e.DumpToString());
+        ArmUpdateTimer(true);
+        return;
+    }
+
+    m_pendingPolicies.clear();
+
+    // Updates already committed to database, but not queued yet still need the marker
+    ClearUnusedMark();
 }
 
 CynaraAdmin &CynaraAdmin::getInstance()
@@ -257,6 +784,9 @@ CynaraAdmin &CynaraAdmin::getInstance()
 
 void CynaraAdmin::SetPolicies(const std::vector<CynaraAdminPolicy> &policies)
 {
+    std::lock_guard<std::recursive_mutex> guard(m_mutex);
+    FlushPendingPolicies();
+
     if (policies.empty()) {
         LogDebug("no policies to set in Cynara.");
         return;
@@ -264,32 +794,63 @@ void CynaraAdmin::SetPolicies(const std::vector<CynaraAdminPolicy> &policies)
 
     std::vector<const struct cynara_admin_policy *> pp_policies(policies.size() + 1);
 
-    LogDebug("Sending " << policies.size() << " policies to Cynara");
-    for (std::size_t i = 0; i < policies.size(); ++i) {
+    for (std::size_t i = 0; i < policies.size(); ++i)
         pp_policies[i] = static_cast<const struct cynara_admin_policy *>(&policies[i]);
+
+    pp_policies[policies.size()] = nullptr;
+
+    SetPolicies(pp_policies.data(), policies.size());
+}
+
+void CynaraAdmin::SetPolicies(const CynaraAdminPolicyBatch &policies)
+{
+    std::lock_guard<std::recursive_mutex> guard(m_mutex);
+    FlushPendingPolicies();
+
+    if (policies.empty()) {
+        LogDebug("no policies to set in Cynara.");
+        return;
+    }
+
+    SetPolicies(policies.data(), policies.size());
+}
+
+void CynaraAdmin::SetPolicies(const struct cynara_admin_policy *const *pp_policies,
+    size_t count)
+{
+    std::lock_guard<std::recursive_mutex> guard(m_mutex);
+
+    LogDebug("Sending " << count << " policies to Cynara");
+    for (std::size_t i = 0; i < count; ++i) {
         LogDebug("policies[" << i << "] = {" <<
             ".bucket = " << pp_policies[i]->bucket << ", " <<
             ".client = " << pp_policies[i]->client << ", " <<
             ".user = " << pp_policies[i]->user << ", " <<
             ".privilege = " << pp_policies[i]->privilege << ", " <<
             ".result = " << pp_policies[i]->result << ", " <<
-            ".result_extra = " << pp_policies[i]->result_extra << "}");
+            ".result_extra = " <<
+                (pp_policies[i]->result_extra ? pp_policies[i]->result_extra : "") << "}");
     }
 
-    pp_policies[policies.size()] = nullptr;
+    int ret = m_backend->setPolicies(pp_policies);
 
-    checkCynaraError(
-        cynara_admin_set_policies(m_CynaraAdmin, pp_policies.data()),
-        "Error while updating Cynara policy.");
+    /* Policies may be partially applied on error, invalidate anyway */
+    for (std::size_t i = 0; i < count; ++i)
+        CynaraDecisionCache::getInstance().invalidate(pp_policies[i]->client,
+            pp_policies[i]->user, pp_policies[i]->privilege);
+
+    checkCynaraError(ret, "Error while updating Cynara policy.");
 }
 
-void CynaraAdmin::UpdateAppPolicy(
+void CynaraAdmin::CalculateAppPolicy(
     const std::string &label,
     const std::string &user,
     const std::vector<std::string> &oldPrivileges,
-    const std::vector<std::string> &newPrivileges)
+    const std::vector<std::string> &newPrivileges,
+    PrivilegeChanges &changes)
 {
-    std::vector<CynaraAdminPolicy> policies;
+    const int allow = static_cast<int>(CynaraAdminPolicy::Operation::Allow);
+    const int remove = static_cast<int>(CynaraAdminPolicy::Operation::Delete);
 
     // Perform sort-merge join on oldPrivileges and newPrivileges.
     // Assume that they are already sorted and without duplicates.
@@ -307,16 +868,12 @@ void CynaraAdmin::UpdateAppPolicy(
         } else if (compare < 0) {
             LogDebug("(user = " << user << " label = " << label << ") " <<
                 "removing privilege " << *oldIter);
-            policies.push_back(CynaraAdminPolicy(label, user, *oldIter,
-                    static_cast<int>(CynaraAdminPolicy::Operation::Delete),
-                    Buckets.at(Bucket::MANIFESTS)));
+            changes.emplace_back(*oldIter, remove);
             ++oldIter;
         } else {
             LogDebug("(user = " << user << " label = " << label << ") " <<
                 "adding privilege " << *newIter);
-            policies.push_back(CynaraAdminPolicy(label, user, *newIter,
-                    static_cast<int>(CynaraAdminPolicy::Operation::Allow),
-                    Buckets.at(Bucket::MANIFESTS)));
+            changes.emplace_back(*newIter, allow);
             ++newIter;
         }
     }
@@ -324,18 +881,30 @@ void CynaraAdmin::UpdateAppPolicy(
     for (; oldIter != oldPrivileges.end(); ++oldIter) {
         LogDebug("(user = " << user << " label = " << label << ") " <<
             "removing privilege " << *oldIter);
-        policies.push_back(CynaraAdminPolicy(label, user, *oldIter,
-                    static_cast<int>(CynaraAdminPolicy::Operation::Delete),
-                    Buckets.at(Bucket::MANIFESTS)));
+        changes.emplace_back(*oldIter, remove);
     }
 
     for (; newIter != newPrivileges.end(); ++newIter) {
         LogDebug("(user = " << user << " label = " << label << ") " <<
             "adding privilege " << *newIter);
-        policies.push_back(CynaraAdminPolicy(label, user, *newIter,
-                    static_cast<int>(CynaraAdminPolicy::Operation::Allow),
-                    Buckets.at(Bucket::MANIFESTS)));
+        changes.emplace_back(*newIter, allow);
     }
+}
+
+void CynaraAdmin::UpdateAppPolicy(
+    const std::string &label,
+    const std::string &user,
+    const std::vector<std::string> &oldPrivileges,
+    const std::vector<std::string> &newPrivileges)
+{
+    CynaraAdminPolicyBatch policies;
+    const std::string &bucket = Buckets.at(Bucket::MANIFESTS);
+    PrivilegeChanges changes;
+
+    CalculateAppPolicy(label, user, oldPrivileges, newPrivileges, changes);
+
+    for (const auto &change : changes)
+        policies.add(label, user, change.first, change.second, bucket);
 
     SetPolicies(policies);
 }
@@ -343,7 +912,7 @@ void CynaraAdmin::UpdateAppPolicy(
 void CynaraAdmin::UserInit(uid_t uid, security_manager_user_type userType)
 {
     Bucket bucket;
-    std::vector<CynaraAdminPolicy> policies;
+    CynaraAdminPolicyBatch policies;
 
     switch (userType) {
         case SM_USER_TYPE_SYSTEM:
@@ -365,11 +934,11 @@ void CynaraAdmin::UserInit(uid_t uid, security_manager_user_type userType)
             ThrowMsg(CynaraException::InvalidParam, "User type incorrect");
     }
 
-    policies.push_back(CynaraAdminPolicy(CYNARA_ADMIN_WILDCARD,
-                                            std::to_string(static_cast<unsigned int>(uid)),
-                                            CYNARA_ADMIN_WILDCARD,
-                                            Buckets.at(bucket),
-                                            Buckets.at(Bucket::MAIN)));
+    policies.add(CYNARA_ADMIN_WILDCARD,
+                 std::to_string(static_cast<unsigned int>(uid)),
+                 CYNARA_ADMIN_WILDCARD,
+                 Buckets.at(bucket),
+                 Buckets.at(Bucket::MAIN));
 
     CynaraAdmin::getInstance().SetPolicies(policies);
 }
@@ -416,8 +985,12 @@ void CynaraAdmin::ListPolicies(
 {
     struct cynara_admin_policy ** pp_policies = nullptr;
 
+    std::lock_guard<std::recursive_mutex> guard(m_mutex);
+
+    FlushPendingPolicies();
+
     checkCynaraError(
-        cynara_admin_list_policies(m_CynaraAdmin, bucketName.c_str(), appId.c_str(),
+        m_backend->listPolicies(bucketName.c_str(), appId.c_str(),
             user.c_str(), privilege.c_str(), &pp_policies),
         "Error while getting list of policies for bucket: " + bucketName);
 
@@ -434,9 +1007,16 @@ void CynaraAdmin::ListPolicies(
 void CynaraAdmin::EmptyBucket(const std::string &bucketName, bool recursive, const std::string &client,
     const std::string &user, const std::string &privilege)
 {
-    checkCynaraError(
-        cynara_admin_erase(m_CynaraAdmin, bucketName.c_str(), static_cast<int>(recursive),
-            client.c_str(), user.c_str(), privilege.c_str()),
+    std::lock_guard<std::recursive_mutex> guard(m_mutex);
+
+    FlushPendingPolicies();
+
+    int ret = m_backend->erase(bucketName.c_str(), static_cast<int>(recursive),
+        client.c_str(), user.c_str(), privilege.c_str());
+
+    CynaraDecisionCache::getInstance().invalidate(client, user, privilege);
+
+    checkCynaraError(ret,
         "Error while emptying bucket: " + bucketName + ", filter (C, U, P): " +
             client + ", " + user + ", " + privilege);
 }
@@ -445,12 +1025,14 @@ void CynaraAdmin::FetchCynaraPolicyDescriptions(bool forceRefresh)
 {
     struct cynara_admin_policy_descr **descriptions = nullptr;
 
+    std::lock_guard<std::recursive_mutex> guard(m_mutex);
+
     if (!forceRefresh && m_policyDescriptionsInitialized)
         return;
 
     // fetch
     checkCynaraError(
-        cynara_admin_list_policies_descriptions(m_CynaraAdmin, &descriptions),
+        m_backend->listPoliciesDescriptions(&descriptions),
         "Error while getting list of policies descriptions from Cynara.");
 
     if (descriptions[0] == nullptr) {
@@ -482,6 +1064,7 @@ void CynaraAdmin::FetchCynaraPolicyDescriptions(bool forceRefresh)
 
 void CynaraAdmin::ListPoliciesDescriptions(std::vector<std::string> &policiesDescriptions)
 {
+    std::lock_guard<std::recursive_mutex> guard(m_mutex);
     FetchCynaraPolicyDescriptions(false);
 
     for (const auto &it : TypeToDescription)
@@ -490,6 +1073,7 @@ void CynaraAdmin::ListPoliciesDescriptions(std::vector<std::string> &policiesDes
 
 std::string CynaraAdmin::convertToPolicyDescription(const int policyType, bool forceRefresh)
 {
+    std::lock_guard<std::recursive_mutex> guard(m_mutex);
     FetchCynaraPolicyDescriptions(forceRefresh);
 
     return TypeToDescription.at(policyType);
@@ -497,6 +1081,7 @@ std::string CynaraAdmin::convertToPolicyDescription(const int policyType, bool f
 
 int CynaraAdmin::convertToPolicyType(const std::string &policy, bool forceRefresh)
 {
+    std::lock_guard<std::recursive_mutex> guard(m_mutex);
     FetchCynaraPolicyDescriptions(forceRefresh);
 
     return DescriptionToType.at(policy);
@@ -506,8 +1091,12 @@ void CynaraAdmin::Check(const std::string &label, const std::string &user, const
 {
     char *resultExtraCstr = nullptr;
 
+    std::lock_guard<std::recursive_mutex> guard(m_mutex);
+
+    FlushPendingPolicies();
+
     checkCynaraError(
-        cynara_admin_check(m_CynaraAdmin, bucket.c_str(), recursive, label.c_str(),
+        m_backend->check(bucket.c_str(), recursive, label.c_str(),
             user.c_str(), privilege.c_str(), &result, &resultExtraCstr),
         "Error while asking cynara admin API for permission for app label: " + label + ", user: "
             + user + " privilege: " + privilege + " bucket: " + bucket);
@@ -542,46 +1131,213 @@ int CynaraAdmin::GetPrivilegeManagerMaxLevel(const std::string &label, const std
     return result;
 }
 
-Cynara::Cynara()
+std::string CynaraAdminPolicyEvaluator::makeKey(const std::string &client,
+    const std::string &user, const std::string &privilege)
+{
+    std::string key;
+    key.reserve(client.size() + user.size() + privilege.size() + 2);
+    key.append(client).push_back('\0');
+    key.append(user).push_back('\0');
+    key.append(privilege);
+    return key;
+}
+
+CynaraAdminPolicyEvaluator::CynaraAdminPolicyEvaluator(Scope scope)
+    : m_scope(scope)
+{
+}
+
+void CynaraAdminPolicyEvaluator::listPolicies(const std::string &bucket,
+    const std::string &client, const std::string &user, BucketPolicies &bucketPolicies)
+{
+    if (!bucketPolicies.listed.insert(makeKey(client, user, std::string())).second)
+        return;
+
+    std::vector<CynaraAdminPolicy> policies;
+    CynaraAdmin::getInstance().ListPolicies(bucket, client, user, CYNARA_ADMIN_ANY, policies);
+    LogDebug("Listed " << policies.size() << " policies from bucket " << bucket <<
+        " for client " << client << ", user " << user);
+
+    for (const auto &policy : policies) {
+        PolicyResult &result = bucketPolicies.policies[
+            makeKey(policy.client, policy.user, policy.privilege)];
+        result.result = policy.result;
+        if (policy.result == CYNARA_ADMIN_BUCKET && policy.result_extra)
+            result.bucket = policy.result_extra;
+    }
+}
+
+CynaraAdminPolicyEvaluator::BucketPolicies &CynaraAdminPolicyEvaluator::getBucket(
+    const std::string &bucket, const std::string &label, const std::string &user)
+{
+    BucketPolicies &bucketPolicies = m_buckets[bucket];
+
+    if (m_scope == Scope::WholeBuckets) {
+        listPolicies(bucket, CYNARA_ADMIN_ANY, CYNARA_ADMIN_ANY, bucketPolicies);
+        return bucketPolicies;
+    }
+
+    /* Listing filters match literally, so wildcard policies are listed separately */
+    const std::string wildcard(CYNARA_ADMIN_WILDCARD);
+    listPolicies(bucket, label, user, bucketPolicies);
+    listPolicies(bucket, label, wildcard, bucketPolicies);
+    listPolicies(bucket, wildcard, user, bucketPolicies);
+    listPolicies(bucket, wildcard, wildcard, bucketPolicies);
+    return bucketPolicies;
+}
+
+int CynaraAdminPolicyEvaluator::resolve(const std::string &bucket,
+    const std::string &label, const std::string &user, const std::string &privilege,
+    unsigned depth)
 {
-    int ret;
+    /* Cynara doesn't allow loops of buckets, guard against them anyway */
+    if (depth > MAX_DEPTH)
+        ThrowMsg(CynaraException::OperationFailed,
+            "Too deep nesting of Cynara buckets at: " + bucket);
+
+    BucketPolicies &bucketPolicies = getBucket(bucket, label, user);
+    const std::string wildcard(CYNARA_ADMIN_WILDCARD);
+    bool hasMinimal = false;
+    int minimal = CYNARA_ADMIN_NONE;
+
+    for (int i = 0; i < 8; ++i) {
+        auto it = bucketPolicies.policies.find(makeKey(
+            (i & 1) ? wildcard : label,
+            (i & 2) ? wildcard : user,
+            (i & 4) ? wildcard : privilege));
+        if (it == bucketPolicies.policies.end())
+            continue;
+
+        int result = it->second.result;
+        if (result == CYNARA_ADMIN_DENY)
+            return result;
 
-    ret = eventfd(0, 0);
-    if (ret == -1) {
-        LogError("Error while creating eventfd: " << strerror(errno));
-        ThrowMsg(CynaraException::UnknownError, "Error while creating eventfd");
+        if (result == CYNARA_ADMIN_BUCKET) {
+            result = resolve(it->second.bucket, label, user, privilege, depth + 1);
+            if (result == CYNARA_ADMIN_NONE)
+                continue;
+        }
+
+        if (!hasMinimal || result < minimal)
+            minimal = result;
+        hasMinimal = true;
     }
 
-    // Poll the eventfd for reading
-    pollFds[0].fd = ret;
-    pollFds[0].events = POLLIN;
+    if (hasMinimal)
+        return minimal;
 
-    // Temporary, will be replaced by cynara fd when available
-    pollFds[1].fd = pollFds[0].fd;
+    if (!bucketPolicies.hasDefault) {
+        /* No policy matches this key, so non-recursive check yields the default */
+        std::string resultExtra;
+        CynaraAdmin::getInstance().Check(label, user, privilege, bucket,
+            bucketPolicies.defaultResult, resultExtra, false);
+        bucketPolicies.hasDefault = true;
+    }
+
+    return bucketPolicies.defaultResult;
+}
+
+int CynaraAdminPolicyEvaluator::Check(const std::string &label, const std::string &user,
+    const std::string &privilege, const std::string &bucket)
+{
+    return resolve(bucket, label, user, privilege, 0);
+}
+
+int CynaraAdminPolicyEvaluator::GetPrivilegeManagerCurrLevel(const std::string &label,
+    const std::string &user, const std::string &privilege)
+{
+    return Check(label, user, privilege,
+        CynaraAdmin::Buckets.at(Bucket::PRIVACY_MANAGER));
+}
+
+int CynaraAdminPolicyEvaluator::GetPrivilegeManagerMaxLevel(const std::string &label,
+    const std::string &user, const std::string &privilege)
+{
+    return Check(label, user, privilege, CynaraAdmin::Buckets.at(Bucket::MAIN));
+}
+
+namespace {
+
+/* Longest wait for Cynara socket in Mode::Inline before checking it again */
+const int INLINE_POLL_TIMEOUT_MS = 100;
+
+} // namespace anonymous
+
+Cynara::Mode Cynara::configuredMode = Cynara::Mode::Inline;
+std::shared_ptr<CynaraClientBackend> Cynara::configuredBackend;
+
+Cynara::Cynara(Mode mode, std::shared_ptr<CynaraClientBackend> backend)
+    : mode(mode)
+    , backend(std::move(backend))
+    , cynara(nullptr)
+{
+    pollFds[0].fd = -1;
+    pollFds[0].events = 0;
+    pollFds[1].fd = -1;
     pollFds[1].events = 0;
 
+    // Checks are answered synchronously by the backend
+    if (this->backend)
+        return;
+
+    slots.reset(new CompletionSlot[std::numeric_limits<cynara_check_id>::max() + 1]);
+    for (size_t i = 0; i <= std::numeric_limits<cynara_check_id>::max(); ++i)
+        slots[i].state.store(SLOT_FREE, std::memory_order_relaxed);
+
+    if (mode == Mode::Thread) {
+        int ret = eventfd(0, 0);
+        if (ret == -1) {
+            LogError("Error while creating eventfd: " << strerror(errno));
+            ThrowMsg(CynaraException::UnknownError, "Error while creating eventfd");
+        }
+
+        // Poll the eventfd for reading
+        pollFds[0].fd = ret;
+        pollFds[0].events = POLLIN;
+    }
+
+    // pollFds[1] will be set to cynara fd when available
     checkCynaraError(
         cynara_async_initialize(&cynara, nullptr, &Cynara::statusCallback, &(pollFds[1])),
         "Cannot connect to Cynara policy interface.");
 
-    thread = std::thread(&Cynara::run, this);
+    if (mode == Mode::Thread)
+        thread = std::thread(&Cynara::run, this);
 }
 
 Cynara::~Cynara()
 {
-    LogDebug("Sending terminate event to Cynara thread");
-    terminate.store(true);
-    threadNotifyPut();
-    thread.join();
+    if (backend)
+        return;
+
+    if (mode == Mode::Thread) {
+        LogDebug("Sending terminate event to Cynara thread");
+        terminate.store(true);
+        threadNotifyPut();
+        thread.join();
+    }
 
     // Critical section
     std::lock_guard<std::mutex> guard(mutex);
     cynara_async_finish(cynara);
+
+    if (pollFds[0].fd != -1)
+        close(pollFds[0].fd);
+}
+
+void Cynara::setMode(Mode mode)
+{
+    configuredMode = mode;
+}
+
+void Cynara::setBackend(std::shared_ptr<CynaraClientBackend> backend)
+{
+    configuredBackend = std::move(backend);
 }
 
 Cynara &Cynara::getInstance()
 {
-    static Cynara cynara;
+    static Cynara cynara(configuredMode, configuredBackend);
     return cynara;
 }
 
@@ -609,6 +1365,8 @@ void Cynara::statusCallback(int oldFd, int newFd, cynara_async_status status,
         "Status = " << status << ", oldFd = " << oldFd << ", newFd = " << newFd);
 
     if (newFd == -1) {
+        // Old descriptor is closed, don't let poll() report it as invalid
+        cynaraFd->fd = -1;
         cynaraFd->events = 0;
     } else {
         cynaraFd->fd = newFd;
@@ -630,37 +1388,78 @@ void Cynara::responseCallback(cynara_check_id checkId,
 {
     LogDebug("Response for received for Cynara check id: " << checkId);
 
-    auto promise = static_cast<std::promise<bool>*>(ptr);
+    auto self = static_cast<Cynara *>(ptr);
 
     switch (cause) {
     case CYNARA_CALL_CAUSE_ANSWER:
         LogDebug("Cynara cause: ANSWER: " << response);
-        promise->set_value(response);
+        self->slotComplete(checkId,
+            response == CYNARA_API_ACCESS_ALLOWED ? SLOT_ALLOWED : SLOT_DENIED);
         break;
 
     case CYNARA_CALL_CAUSE_CANCEL:
         LogDebug("Cynara cause: CANCEL");
-        promise->set_value(CYNARA_API_ACCESS_DENIED);
+        self->slotComplete(checkId, SLOT_DENIED);
         break;
 
     case CYNARA_CALL_CAUSE_FINISH:
         LogDebug("Cynara cause: FINISH");
-        promise->set_value(CYNARA_API_ACCESS_DENIED);
+        self->slotComplete(checkId, SLOT_DENIED);
         break;
 
     case CYNARA_CALL_CAUSE_SERVICE_NOT_AVAILABLE:
         LogError("Cynara cause: SERVICE_NOT_AVAILABLE");
-
-        try {
-            ThrowMsg(CynaraException::ServiceNotAvailable,
-                "Cynara service not available");
-        } catch (...) {
-            promise->set_exception(std::current_exception());
-        }
+        self->slotComplete(checkId, SLOT_NOT_AVAILABLE);
         break;
     }
 }
 
+void Cynara::slotArm(cynara_check_id checkId)
+{
+    auto &state = slots[checkId].state;
+
+    /*
+     * Cynara may reuse check id as soon as the answer is delivered,
+     * previous submitter may not have picked it up yet.
+     */
+    uint32_t expected = SLOT_FREE;
+    while (!state.compare_exchange_weak(expected, SLOT_PENDING,
+            std::memory_order_acq_rel)) {
+        expected = SLOT_FREE;
+        std::this_thread::yield();
+    }
+}
+
+void Cynara::slotComplete(cynara_check_id checkId, uint32_t result)
+{
+    auto &state = slots[checkId].state;
+
+    uint32_t expected = SLOT_PENDING;
+    if (!state.compare_exchange_strong(expected, result, std::memory_order_acq_rel)) {
+        LogWarning("Unexpected answer for Cynara check id " << checkId);
+        return;
+    }
+
+    if (mode == Mode::Thread)
+        syscall(SYS_futex, &state, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+}
+
+uint32_t Cynara::slotWait(cynara_check_id checkId)
+{
+    auto &state = slots[checkId].state;
+    uint32_t result;
+
+    while ((result = state.load(std::memory_order_acquire)) == SLOT_PENDING) {
+        if (mode == Mode::Inline)
+            processInline(checkId);
+        else
+            syscall(SYS_futex, &state, FUTEX_WAIT_PRIVATE, SLOT_PENDING, nullptr, nullptr, 0);
+    }
+
+    state.store(SLOT_FREE, std::memory_order_release);
+    return result;
+}
+
 void Cynara::run()
 {
     LogInfo("Cynara thread started");
@@ -696,39 +1495,120 @@ void Cynara::run()
     }
 }
 
+void Cynara::processInline(cynara_check_id checkId)
+{
+    struct pollfd cynaraFd;
+
+    {
+        // Critical section
+        std::lock_guard<std::mutex> guard(mutex);
+
+        // Answer may have been processed by other thread while we were waiting for the lock
+        if (slots[checkId].state.load(std::memory_order_acquire) != SLOT_PENDING)
+            return;
+
+        cynaraFd = pollFds[1];
+    }
+
+    /*
+     * Wait without the lock, other threads need it to send their checks.
+     * Descriptor may be replaced meanwhile, so the wait is bounded and
+     * the caller comes back with the current one.
+     */
+    if (poll(&cynaraFd, 1, INLINE_POLL_TIMEOUT_MS) == -1) {
+        if (errno != EINTR)
+            LogError("Unexpected error returned by poll: " << strerror(errno));
+        return;
+    }
+    if (cynaraFd.revents == 0)
+        return;
+
+    // Critical section
+    std::lock_guard<std::mutex> guard(mutex);
+
+    // Other thread might have processed the same event already
+    if (slots[checkId].state.load(std::memory_order_acquire) != SLOT_PENDING ||
+            poll(&pollFds[1], 1, 0) <= 0)
+        return;
+
+    try {
+        checkCynaraError(cynara_async_process(cynara),
+            "Unexpected error returned by cynara_async_process");
+    } catch (const CynaraException::Base &e) {
+        LogError("Error while processing Cynara events: " << e.DumpToString());
+    }
+}
+
 bool Cynara::check(const std::string &label, const std::string &privilege,
         const std::string &user, const std::string &session)
 {
     LogDebug("check: client = " << label << ", user = " << user <<
         ", privilege = " << privilege << ", session = " << session);
 
-    std::promise<bool> promise;
-    auto future = promise.get_future();
+    CynaraDecisionCache &decisionCache = CynaraDecisionCache::getInstance();
+    bool allowed;
+    if (decisionCache.get(label, user, privilege, session, allowed)) {
+        LogDebug("Cynara decision cache hit: " << allowed);
+        return allowed;
+    }
+
+    uint64_t epoch = decisionCache.epoch();
+    auto start = std::chrono::steady_clock::now();
+    cynara_check_id checkId;
 
-    // Critical section
+    if (backend) {
+        allowed = checkCynaraError(
+            backend->checkAccess(label.c_str(), session.c_str(), user.c_str(),
+                privilege.c_str()),
+            "Cannot check permission with Cynara.");
+        decisionCache.put(label, user, privilege, session, allowed, epoch,
+            std::chrono::steady_clock::now() - start);
+        return allowed;
+    }
+
+    // Critical section, Cynara async client is not thread safe
     {
         std::lock_guard<std::mutex> guard(mutex);
 
         int ret = cynara_async_check_cache(cynara,
             label.c_str(), session.c_str(), user.c_str(), privilege.c_str());
 
-        if (ret != CYNARA_API_CACHE_MISS)
-            return checkCynaraError(ret, "Error while checking Cynara cache");
+        if (ret != CYNARA_API_CACHE_MISS) {
+            allowed = checkCynaraError(ret, "Error while checking Cynara cache");
+            decisionCache.put(label, user, privilege, session, allowed, epoch,
+                std::chrono::steady_clock::now() - start);
+            return allowed;
+        }
 
         LogDebug("Cynara cache miss");
 
-        cynara_check_id check_id;
         checkCynaraError(
             cynara_async_create_request(cynara,
                 label.c_str(), session.c_str(), user.c_str(), privilege.c_str(),
-                &check_id, &Cynara::responseCallback, &promise),
+                &checkId, &Cynara::responseCallback, this),
             "Cannot check permission with Cynara.");
 
-        threadNotifyPut();
-        LogDebug("Waiting for response to Cynara query id " << check_id);
+        // Answer can't be processed before we release the lock
+        slotArm(checkId);
+        if (mode == Mode::Thread)
+            threadNotifyPut();
+        LogDebug("Waiting for response to Cynara query id " << checkId);
+    }
+
+    switch (slotWait(checkId)) {
+    case SLOT_ALLOWED:
+        allowed = true;
+        break;
+    case SLOT_DENIED:
+        allowed = false;
+        break;
+    default:
+        ThrowMsg(CynaraException::ServiceNotAvailable, "Cynara service not available");
     }
 
-    return future.get();
+    decisionCache.put(label, user, privilege, session, allowed, epoch,
+        std::chrono::steady_clock::now() - start);
+    return allowed;
 }
 
 } // namespace SecurityManager
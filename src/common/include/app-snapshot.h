@@ -0,0 +1,192 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        app-snapshot.h
+ * @author      Rafal Krypa <r.krypa@samsung.com>
+ * @version     1.0
+ * @brief       Read-only, memory mapped snapshot of application database
+ */
+
+#ifndef _SECURITY_MANAGER_APP_SNAPSHOT_
+#define _SECURITY_MANAGER_APP_SNAPSHOT_
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <dpl/exception.h>
+#include <dpl/noncopyable.h>
+
+namespace SecurityManager {
+
+/*
+ * Snapshot of application database published by the daemon shortly after
+ * committed changes. It holds app -> pkg mapping and privilege -> gid mapping,
+ * data that any process can get from the daemon anyway. Privileges of
+ * packages are not included: they tell which users installed what.
+ * The file is never modified in place: new version is written to a temporary
+ * file and renamed over the old one. Separate, small generation file is
+ * updated in place on every change, so clients can detect an outdated
+ * snapshot with a single atomic load.
+ *
+ * All offsets are in bytes from the beginning of the snapshot file.
+ * Strings are stored as 32-bit length followed by bytes and a terminating NUL,
+ * string references are offsets relative to the string section.
+ */
+namespace AppSnapshot {
+
+const uint32_t MAGIC = 0x50414d53; /* "SMAP" */
+const uint32_t VERSION = 2;
+
+struct Header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t generation;
+    uint32_t size;
+    uint32_t stringsOffset;
+    uint32_t stringsSize;
+    uint32_t appsOffset;              /* AppEntry[], sorted by app */
+    uint32_t appsCount;
+    uint32_t appIndexOffset;          /* uint32_t[], open addressing hash of apps */
+    uint32_t appIndexSize;            /* power of two, slot holds app index + 1 */
+    uint32_t privilegeGroupsOffset;   /* PrivilegeGroupsEntry[], sorted by privilege */
+    uint32_t privilegeGroupsCount;
+    uint32_t gidsOffset;              /* uint32_t[] group ids */
+    uint32_t gidsCount;
+};
+
+struct AppEntry {
+    uint32_t app;
+    uint32_t pkg;
+};
+
+struct PrivilegeGroupsEntry {
+    uint32_t privilege;
+    uint32_t first;                   /* index in gids */
+    uint32_t count;
+};
+
+const uint32_t GENERATION_MAGIC = 0x4e454753; /* "SGEN" */
+
+struct Generation {
+    uint32_t magic;
+    uint32_t reserved;
+    std::atomic<uint64_t> value;
+};
+
+} // namespace AppSnapshot
+
+class AppSnapshotException {
+public:
+    DECLARE_EXCEPTION_TYPE(SecurityManager::Exception, Base)
+    DECLARE_EXCEPTION_TYPE(Base, FileError)
+};
+
+class AppSnapshotWriter {
+public:
+    /**
+     * Build snapshot from PrivilegeDb, publish it and bump generation counter.
+     *
+     * @throws AppSnapshotException::FileError
+     * @throws PrivilegeDb::Exception::Base
+     */
+    static void publish();
+
+    /**
+     * Bump generation counter after a committed change and mark the snapshot
+     * outdated, without rebuilding it. Clients drop data of older generations
+     * and fall back to IPC until publish() is called, so a burst of changes
+     * can be published once.
+     */
+    static void markChanged();
+
+    /**
+     * @return true if changes were marked since the last publish()
+     */
+    static bool isOutdated();
+
+    /**
+     * Remove published snapshot and bump generation counter, forcing clients
+     * to fall back to IPC. Used when snapshot couldn't be refreshed.
+     */
+    static void invalidate();
+};
+
+class AppSnapshotReader : public Noncopyable {
+public:
+    ~AppSnapshotReader();
+
+    static AppSnapshotReader &getInstance();
+
+    /**
+     * Look up package id of an application.
+     *
+     * @param appId application identifier
+     * @param[out] pkgId package identifier
+     * @return true if snapshot is available and application was found in it
+     */
+    bool getPkgId(const std::string &appId, std::string &pkgId);
+
+    /**
+     * Get group ids assigned to a privilege.
+     *
+     * @param privilege privilege identifier
+     * @param[out] gids list of group ids
+     * @return true if snapshot is available
+     */
+    bool getPrivilegeGids(const std::string &privilege, std::vector<gid_t> &gids);
+
+    /**
+     * Get current value of the generation counter, bumped on every change
+     * of applications or their policies. Data obtained from the daemon
+     * at a given generation is valid until the counter changes.
+     *
+     * @param[out] generation current generation
+     * @return true if generation counter is available
+     */
+    bool getGeneration(uint64_t &generation);
+
+private:
+    AppSnapshotReader();
+
+    bool refresh();
+    bool mapGeneration();
+    bool mapSnapshot();
+    void unmapSnapshot();
+
+    const AppSnapshot::Header *header() const;
+    bool stringAt(uint32_t ref, const char *&str, uint32_t &len) const;
+    int compareString(uint32_t ref, const std::string &str) const;
+
+    template <typename T>
+    const T *section(uint32_t offset) const;
+
+    std::mutex m_mutex;
+    const AppSnapshot::Generation *m_generation;
+    const char *m_data;
+    size_t m_size;
+    uint64_t m_checkedGeneration;
+};
+
+} // namespace SecurityManager
+
+#endif // _SECURITY_MANAGER_APP_SNAPSHOT_
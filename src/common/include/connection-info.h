@@ -34,6 +34,8 @@ namespace SecurityManager
     struct ConnectionInfo {
         InterfaceID interfaceID;
         MessageBuffer buffer;
+        /* Connection is not closed after a response, client sends more requests */
+        bool keepOpen = false;
     };
 
     typedef std::map<int, ConnectionInfo> ConnectionInfoMap;
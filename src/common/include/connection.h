@@ -42,6 +42,12 @@ typedef std::vector<unsigned char> RawBuffer;
 
 int sendToServer(char const * const interface, const RawBuffer &send, MessageBuffer &recv);
 
+/*
+ * Open a non-blocking connection to the server for a caller that keeps it
+ * between requests and polls it on its own. The caller owns the descriptor.
+ */
+int connectToServer(char const * const interface, int &sock);
+
 /*
  * sendToServerAncData is special case when we want to receive file descriptor
  * passed by Security Manager on behalf of calling process. We can't get it with
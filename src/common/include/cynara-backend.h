@@ -0,0 +1,74 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/*
+ * @file        cynara-backend.h
+ * @author      Rafal Krypa <r.krypa@samsung.com>
+ * @version     1.0
+ * @brief       Interfaces of backends of Cynara wrapper classes
+ */
+
+#ifndef _SECURITY_MANAGER_CYNARA_BACKEND_
+#define _SECURITY_MANAGER_CYNARA_BACKEND_
+
+#include <cynara-admin.h>
+#include <cynara-admin-types.h>
+#include <cynara-error.h>
+
+namespace SecurityManager {
+
+/*
+ * Administrative operations used by CynaraAdmin.
+ * Contract (arguments, allocation of results, return codes) is the same
+ * as of corresponding cynara_admin_* functions.
+ */
+class CynaraAdminBackend
+{
+public:
+    virtual ~CynaraAdminBackend() {}
+
+    virtual int setPolicies(const struct cynara_admin_policy *const *policies) = 0;
+
+    virtual int listPolicies(const char *bucket, const char *client, const char *user,
+        const char *privilege, struct cynara_admin_policy ***policies) = 0;
+
+    virtual int erase(const char *startBucket, int recursive, const char *client,
+        const char *user, const char *privilege) = 0;
+
+    virtual int check(const char *startBucket, int recursive, const char *client,
+        const char *user, const char *privilege, int *result, char **resultExtra) = 0;
+
+    virtual int listPoliciesDescriptions(struct cynara_admin_policy_descr ***descriptions) = 0;
+};
+
+/*
+ * Synchronous permission checks, used by Cynara in place of the asynchronous
+ * client library. Returns CYNARA_API_ACCESS_ALLOWED, CYNARA_API_ACCESS_DENIED
+ * or negative error code.
+ */
+class CynaraClientBackend
+{
+public:
+    virtual ~CynaraClientBackend() {}
+
+    virtual int checkAccess(const char *client, const char *session, const char *user,
+        const char *privilege) = 0;
+};
+
+} // namespace SecurityManager
+
+#endif // _SECURITY_MANAGER_CYNARA_BACKEND_
@@ -30,14 +30,23 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+#include <atomic>
 #include <mutex>
 #include <thread>
-#include <future>
+#include <memory>
+#include <chrono>
+#include <cstdint>
+#include <tuple>
+#include <utility>
 
 #include <poll.h>
 #include <sys/eventfd.h>
 
 #include "security-manager.h"
+#include "cynara-backend.h"
 
 namespace SecurityManager {
 
@@ -95,6 +104,181 @@ struct CynaraAdminPolicy : cynara_admin_policy
     ~CynaraAdminPolicy();
 };
 
+/**
+ * Batch of Cynara policies keeping all strings in a single arena.
+ * Repeated strings (labels, users, buckets, privileges) are stored once.
+ * Exposes NULL terminated array of policies, ready for cynara_admin_set_policies.
+ */
+class CynaraAdminPolicyBatch
+{
+public:
+    CynaraAdminPolicyBatch();
+
+    CynaraAdminPolicyBatch(const CynaraAdminPolicyBatch &that) = delete;
+    CynaraAdminPolicyBatch& operator=(const CynaraAdminPolicyBatch &that) = delete;
+
+    void add(const std::string &client, const std::string &user,
+        const std::string &privilege, int operation,
+        const std::string &bucket = std::string(CYNARA_ADMIN_DEFAULT_BUCKET));
+
+    void add(const std::string &client, const std::string &user,
+        const std::string &privilege, const std::string &goToBucket,
+        const std::string &bucket = std::string(CYNARA_ADMIN_DEFAULT_BUCKET));
+
+    size_t size() const { return m_policies.size(); }
+    bool empty() const { return m_policies.empty(); }
+
+    /**
+     * Get NULL terminated array of pointers to policies.
+     * Valid until next modification of the batch.
+     */
+    const struct cynara_admin_policy *const *data() const;
+
+    void clear();
+
+private:
+    struct CStrHash {
+        size_t operator()(const char *str) const;
+    };
+
+    struct CStrEqual {
+        bool operator()(const char *a, const char *b) const;
+    };
+
+    char *intern(const std::string &str);
+
+    static const size_t ARENA_BLOCK_SIZE = 4096;
+
+    std::vector<std::unique_ptr<char[]>> m_blocks;
+    size_t m_blockUsed;
+    size_t m_blockSize;
+    std::unordered_set<const char *, CStrHash, CStrEqual> m_strings;
+    std::vector<struct cynara_admin_policy> m_policies;
+    mutable std::vector<const struct cynara_admin_policy *> m_pointers;
+};
+
+struct CynaraCacheStats
+{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t invalidations;
+    uint64_t flushes;
+    size_t entries;
+    /* Estimated time saved by cache hits, based on average miss latency */
+    std::chrono::microseconds savedLatency;
+
+    double hitRatio() const;
+};
+
+/**
+ * Bounded LRU cache of Cynara decisions, consulted by Cynara::check before
+ * going to Cynara. Entries are dropped by CynaraAdmin whenever policies
+ * matching them are changed. Policies may also be changed by other Cynara
+ * admins, so the whole cache is flushed when Cynara database changes on disk.
+ * Caching is enabled only while that database is watched, see StartWatching().
+ *
+ * Policies may have plugin types, which answer depending on client session.
+ * Session is therefore a part of the key, unless SessionPolicy::Shared
+ * is selected.
+ */
+class CynaraDecisionCache
+{
+public:
+    enum class SessionPolicy {
+        Shared,
+        PerSession,
+    };
+
+    static CynaraDecisionCache &getInstance();
+
+    /**
+     * Look up cached decision.
+     *
+     * @param[out] allowed cached decision
+     * @return true on cache hit
+     */
+    bool get(const std::string &label, const std::string &user,
+        const std::string &privilege, const std::string &session, bool &allowed);
+
+    /**
+     * Get current invalidation epoch. It must be taken before asking Cynara
+     * and passed to put(), so that decisions made before policy change are
+     * not stored.
+     */
+    uint64_t epoch();
+
+    /**
+     * Store decision obtained from Cynara.
+     *
+     * @param epoch invalidation epoch from before asking Cynara
+     * @param latency time spent on getting the decision from Cynara
+     */
+    void put(const std::string &label, const std::string &user,
+        const std::string &privilege, const std::string &session, bool allowed,
+        uint64_t epoch, std::chrono::steady_clock::duration latency);
+
+    /**
+     * Drop decisions matched by a policy. CYNARA_ADMIN_WILDCARD and
+     * CYNARA_ADMIN_ANY match any value.
+     */
+    void invalidate(const std::string &label, const std::string &user,
+        const std::string &privilege);
+
+    /**
+     * Drop all decisions, to be used after external policy reload.
+     */
+    void flush();
+
+    /**
+     * Start watching Cynara database for changes and enable caching.
+     * Returned descriptor becomes readable after the database is changed,
+     * ProcessWatchEvents() is to be called then.
+     *
+     * @return inotify descriptor or -1 on error, caching stays disabled then
+     */
+    int StartWatching();
+
+    /**
+     * Handle change notifications read from the watch descriptor, flush the
+     * cache if Cynara database has changed.
+     *
+     * @param[in] events - inotify events read from descriptor returned by StartWatching()
+     */
+    void ProcessWatchEvents(const std::vector<unsigned char> &events);
+
+    CynaraCacheStats getStats();
+
+    void logStats();
+
+private:
+    struct Entry {
+        std::string key;
+        std::string label;
+        std::string user;
+        std::string privilege;
+        bool allowed;
+    };
+
+    typedef std::list<Entry> EntryList;
+
+    CynaraDecisionCache(size_t capacity = 1024,
+        SessionPolicy sessionPolicy = SessionPolicy::PerSession);
+
+    std::string makeKey(const std::string &label, const std::string &user,
+        const std::string &privilege, const std::string &session) const;
+
+    const size_t m_capacity;
+    const SessionPolicy m_sessionPolicy;
+    std::mutex m_mutex;
+    EntryList m_lru;
+    std::unordered_map<std::string, EntryList::iterator> m_entries;
+    CynaraCacheStats m_stats;
+    std::chrono::steady_clock::duration m_missLatency;
+    uint64_t m_timedMisses;
+    uint64_t m_epoch;
+    int m_watchFd;
+};
+
 class CynaraAdmin
 {
 public:
@@ -117,6 +301,14 @@ public:
      */
     void SetPolicies(const std::vector<CynaraAdminPolicy> &policies);
 
+    /**
+     * Update Cynara policies from a batch.
+     * Caller must have permission to access Cynara administrative socket.
+     *
+     * @param policies batch of policies to send to Cynara
+     */
+    void SetPolicies(const CynaraAdminPolicyBatch &policies);
+
     /**
      * Update Cynara policies for the package and the user, using two vectors
      * of privileges: privileges set before (and already enabled in Cynara)
@@ -139,6 +331,94 @@ public:
         const std::vector<std::string> &oldPrivileges,
         const std::vector<std::string> &newPrivileges);
 
+    /**
+     * Set time window for coalescing application policy updates queued with
+     * QueueAppPolicy(). Must be called before first use of CynaraAdmin.
+     * Zero (the default) disables coalescing.
+     *
+     * @param windowMs coalescing window in milliseconds
+     */
+    static void setUpdateWindow(unsigned int windowMs);
+
+    /**
+     * Replace connection to Cynara administrative interface with given
+     * backend. Must be called before first call to getInstance().
+     *
+     * @param backend backend to be used instead of libcynara-admin
+     */
+    static void setBackend(std::shared_ptr<CynaraAdminBackend> backend);
+
+    /**
+     * Descriptor that becomes readable when queued policies should be sent,
+     * FlushPendingPolicies() is to be called then.
+     *
+     * @return timer descriptor or -1 if coalescing is disabled
+     */
+    int GetUpdateTimerDescriptor() const { return m_updateTimerFd; }
+
+    /**
+     * @return true if application policy updates are coalesced
+     */
+    bool IsCoalescingUpdates() const { return m_updateTimerFd != -1; }
+
+    /**
+     * Create and sync the persistent marker of pending policy updates, so
+     * that after a crash they can be restored from PrivilegeDb. Must be called
+     * before committing a change to PrivilegeDb that will be followed by
+     * QueueAppPolicy(). Each successful call keeps the marker in place until
+     * the matching QueueAppPolicy() is queued and flushed. If the commit
+     * fails, the hold has to be released with ReleasePendingMark().
+     *
+     * @return true if the marker is durable and the update may be queued,
+     *         false if it has to be sent to Cynara right away
+     */
+    bool MarkPendingPolicies();
+
+    /**
+     * Release the hold of the marker taken by MarkPendingPolicies(), when
+     * the change is rolled back and QueueAppPolicy() won't follow.
+     */
+    void ReleasePendingMark();
+
+    /**
+     * Queue update of Cynara policies for the package and the user, computed
+     * as in UpdateAppPolicy(). Must be called after the change is committed
+     * to PrivilegeDb, so Cynara never sees a change that may be rolled back,
+     * and after MarkPendingPolicies() succeeded before the commit.
+     * Queued updates are sent in a single call when the window expires, when
+     * POLICY_QUEUE_MAX of them are pending or before any other administrative
+     * operation on Cynara. The marker is removed once all of them are sent.
+     * Without coalescing it is equivalent to UpdateAppPolicy().
+     * Errors of sending are logged and the updates are retried later.
+     *
+     * @param label application Smack label
+     * @param user user identifier
+     * @param oldPrivileges previously enabled privileges for the package.
+     *        Must be sorted and without duplicates.
+     * @param newPrivileges currently enabled privileges for the package.
+     *        Must be sorted and without duplicates.
+     */
+    void QueueAppPolicy(const std::string &label, const std::string &user,
+        const std::vector<std::string> &oldPrivileges,
+        const std::vector<std::string> &newPrivileges);
+
+    /**
+     * Send all queued application policy updates to Cynara. On failure they
+     * stay queued and sending is retried after the window.
+     */
+    void FlushPendingPolicies();
+
+    /**
+     * Check whether queued policy updates were left unsent by previous
+     * instance of the service.
+     */
+    static bool HasLostPolicies();
+
+    /**
+     * Remove the marker of unsent policy updates, after they are restored.
+     */
+    static void ClearLostPolicies();
+
     /**
      * Depending on user type, create link between MAIN bucket and appropriate
      * USER_TYPE_* bucket for newly added user uid to apply permissions for that
@@ -270,6 +550,30 @@ public:
 private:
     CynaraAdmin();
 
+    typedef std::vector<std::pair<std::string, int>> PrivilegeChanges;
+
+    /**
+     * Calculate privileges to be added to and removed from Cynara.
+     */
+    static void CalculateAppPolicy(const std::string &label, const std::string &user,
+        const std::vector<std::string> &oldPrivileges,
+        const std::vector<std::string> &newPrivileges,
+        PrivilegeChanges &changes);
+
+    void ArmUpdateTimer(bool arm);
+
+    /* Remove the marker if no update is queued and no hold of it remains */
+    void ClearUnusedMark();
+
+    /**
+     * Send NULL terminated array of policies to Cynara and drop cached
+     * decisions affected by them.
+     *
+     * @param policies array of policies
+     * @param count number of policies in the array
+     */
+    void SetPolicies(const struct cynara_admin_policy *const *policies, size_t count);
+
     /**
      * Empty bucket using filter - matching rules will be removed
      *
@@ -289,20 +593,146 @@ private:
      */
     void FetchCynaraPolicyDescriptions(bool forceRefresh = false);
 
-    struct cynara_admin *m_CynaraAdmin;
+    static std::shared_ptr<CynaraAdminBackend> s_backend;
+    std::shared_ptr<CynaraAdminBackend> m_backend;
 
     static TypeToDescriptionMap TypeToDescription;
     static DescriptionToTypeMap DescriptionToType;
     bool m_policyDescriptionsInitialized;
+
+    static const size_t POLICY_QUEUE_MAX = 1024;
+    static unsigned int s_updateWindowMs;
+
+    /*
+     * Guards the backend handle, queued policies and cached descriptions.
+     * Queued policies are flushed by a timer in the main thread while
+     * services call other methods, which in turn flush the queue.
+     */
+    std::recursive_mutex m_mutex;
+
+    /* Owned by SocketManager once registered there */
+    int m_updateTimerFd;
+    std::map<std::tuple<std::string, std::string, std::string>, int> m_pendingPolicies;
+    bool m_pendingMarked;
+    unsigned int m_pendingMarkHolds;
+};
+
+/**
+ * In-memory evaluator of Cynara administrative checks, for bulk queries.
+ * Each bucket is listed from Cynara once, on first use, and bucket chains are
+ * then resolved locally with Cynara semantics: policies matching the key
+ * exactly or by wildcard are considered, DENY wins immediately, links to other
+ * buckets are followed with NONE results ignored and the minimal result is
+ * returned. Default policy of a bucket is used when nothing matches, it is
+ * fetched from Cynara once per bucket.
+ *
+ * With Scope::ClientAndUser only policies that can match the checked client
+ * and user are listed, so that a query touching a few clients doesn't pay for
+ * listing whole buckets.
+ *
+ * Listed buckets are not refreshed, so the evaluator should live only as long
+ * as a single request.
+ */
+class CynaraAdminPolicyEvaluator
+{
+public:
+    enum class Scope {
+        WholeBuckets,   // list every bucket once, for checks spanning most of the policy
+        ClientAndUser,  // list only policies of the checked client and user
+    };
+
+    explicit CynaraAdminPolicyEvaluator(Scope scope = Scope::WholeBuckets);
+
+    CynaraAdminPolicyEvaluator(const CynaraAdminPolicyEvaluator &that) = delete;
+    CynaraAdminPolicyEvaluator& operator=(const CynaraAdminPolicyEvaluator &that) = delete;
+
+    /**
+     * Equivalent of recursive CynaraAdmin::Check, returning policy result.
+     *
+     * @param label application Smack label
+     * @param user user identifier (uid)
+     * @param privilege privilege identifier
+     * @param bucket name of the bucket to start the search at
+     * @return policy result
+     */
+    int Check(const std::string &label, const std::string &user,
+        const std::string &privilege, const std::string &bucket);
+
+    /**
+     * Equivalent of CynaraAdmin::GetPrivilegeManagerCurrLevel.
+     */
+    int GetPrivilegeManagerCurrLevel(const std::string &label, const std::string &user,
+        const std::string &privilege);
+
+    /**
+     * Equivalent of CynaraAdmin::GetPrivilegeManagerMaxLevel.
+     */
+    int GetPrivilegeManagerMaxLevel(const std::string &label, const std::string &user,
+        const std::string &privilege);
+
+private:
+    struct PolicyResult {
+        int result;
+        std::string bucket;
+    };
+
+    struct BucketPolicies {
+        BucketPolicies() : hasDefault(false), defaultResult(CYNARA_ADMIN_NONE) {}
+
+        std::unordered_map<std::string, PolicyResult> policies;
+        std::unordered_set<std::string> listed;
+        bool hasDefault;
+        int defaultResult;
+    };
+
+    static std::string makeKey(const std::string &client, const std::string &user,
+        const std::string &privilege);
+
+    void listPolicies(const std::string &bucket, const std::string &client,
+        const std::string &user, BucketPolicies &bucketPolicies);
+
+    BucketPolicies &getBucket(const std::string &bucket, const std::string &label,
+        const std::string &user);
+
+    int resolve(const std::string &bucket, const std::string &label,
+        const std::string &user, const std::string &privilege, unsigned depth);
+
+    static const unsigned MAX_DEPTH = 16;
+
+    Scope m_scope;
+    std::unordered_map<std::string, BucketPolicies> m_buckets;
 };
 
 class Cynara
 {
 public:
+    enum class Mode {
+        /* Dedicated thread polls Cynara socket, checks wait for its answers */
+        Thread,
+        /* Checking thread polls Cynara socket and processes answers inline */
+        Inline,
+    };
+
     ~Cynara();
 
     static Cynara &getInstance();
 
+    /**
+     * Select how Cynara socket is serviced.
+     * Must be called before first call to getInstance().
+     *
+     * @param mode integration mode, Mode::Inline by default
+     */
+    static void setMode(Mode mode);
+
+    /**
+     * Answer checks with given backend instead of libcynara-client-async.
+     * Must be called before first call to getInstance().
+     *
+     * @param backend backend to be used for checks
+     */
+    static void setBackend(std::shared_ptr<CynaraClientBackend> backend);
+
     /**
      * Ask Cynara for permission.
      *
@@ -316,7 +746,7 @@ public:
         const std::string &user, const std::string &session);
 
 private:
-    Cynara();
+    Cynara(Mode mode, std::shared_ptr<CynaraClientBackend> backend);
 
     static void statusCallback(int oldFd, int newFd,
         cynara_async_status status, void *ptr);
@@ -329,11 +759,41 @@ private:
     void threadNotifyPut();
     void threadNotifyGet();
 
+    void processInline(cynara_check_id checkId);
+
+    /*
+     * Completion slot for a Cynara request, indexed by cynara_check_id.
+     * Submitting thread arms it, thread processing Cynara events stores
+     * the answer (waking the submitter with futex in Mode::Thread)
+     * and submitter frees the slot after reading it.
+     */
+    enum SlotState : uint32_t {
+        SLOT_FREE,
+        SLOT_PENDING,
+        SLOT_ALLOWED,
+        SLOT_DENIED,
+        SLOT_NOT_AVAILABLE,
+    };
+
+    struct CompletionSlot {
+        std::atomic<uint32_t> state;
+    };
+
+    void slotArm(cynara_check_id checkId);
+    void slotComplete(cynara_check_id checkId, uint32_t state);
+    uint32_t slotWait(cynara_check_id checkId);
+
+    static Mode configuredMode;
+    static std::shared_ptr<CynaraClientBackend> configuredBackend;
+
+    const Mode mode;
+    const std::shared_ptr<CynaraClientBackend> backend;
     cynara_async *cynara;
     struct pollfd pollFds[2];
     std::mutex mutex;
     std::thread thread;
     std::atomic<bool> terminate{false};
+    std::unique_ptr<CompletionSlot[]> slots;
 };
 
 } // namespace SecurityManager
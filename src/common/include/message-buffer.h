@@ -25,9 +25,10 @@
 #ifndef _SECURITY_MANAGER_SOCKET_BUFFER_
 #define _SECURITY_MANAGER_SOCKET_BUFFER_
 
+#include <string.h>
+
 #include <vector>
 
-#include <dpl/binary_queue.h>
 #include <dpl/exception.h>
 #include <dpl/serialization.h>
 
@@ -45,11 +46,21 @@ public:
     };
 
     MessageBuffer()
-      : m_bytesLeft(0)
+      : m_readPos(0)
+      , m_bytesLeft(0)
     {}
 
     void Push(const RawBuffer &data);
 
+    /*
+     * Take over a buffer with received data, without copying it.
+     */
+    void Push(RawBuffer &&data);
+
+    /*
+     * Hand over the written message, prefixed with its size. The data is
+     * kept contiguous with room for the prefix, so it is moved out, not copied.
+     */
     RawBuffer Pop();
 
     bool Ready();
@@ -59,19 +70,30 @@ public:
     virtual void Write(size_t num, const void *bytes);
 
 protected:
+    /* Reserved for a new message, enough for most requests and responses */
+    static const size_t INITIAL_CAPACITY = 256;
+
+    inline size_t Size() const {
+        return m_buffer.size() - m_readPos;
+    }
 
     inline void CountBytesLeft() {
         if (m_bytesLeft > 0)
             return;  // we already counted m_bytesLeft nothing to do
 
-        if (m_buffer.Size() < sizeof(size_t))
+        if (Size() < sizeof(size_t))
             return;  // we cannot count m_bytesLeft because buffer is too small
 
-        m_buffer.FlattenConsume(&m_bytesLeft, sizeof(size_t));
+        memcpy(&m_bytesLeft, m_buffer.data() + m_readPos, sizeof(size_t));
+        m_readPos += sizeof(size_t);
     }
 
+    void Append(const unsigned char *bytes, size_t num);
+
+    /* Data before m_readPos is already consumed (or reserved for the size) */
+    RawBuffer m_buffer;
+    size_t m_readPos;
     size_t m_bytesLeft;
-    SecurityManager::BinaryQueue m_buffer;
 };
 
 } // namespace SecurityManager
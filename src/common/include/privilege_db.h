@@ -34,6 +34,9 @@
 #include <map>
 #include <stdbool.h>
 #include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
 
 #include <dpl/db/sql_connection.h>
 #include <tzplatform_config.h>
@@ -62,7 +65,12 @@ enum class StmtType {
     EInsertPrivilegeToMap,
     EGetPrivilegesMappings,
     EDeletePrivilegesToMap,
-    EGetGroups
+    EGetGroups,
+    EGetAllAppPkgIds,
+    EGetAllPrivilegeGroups,
+    EGetAllAppPrivileges,
+    EGetUserAppsAfter,
+    EGetAppsAfter
 };
 
 class PrivilegeDb {
@@ -113,6 +121,13 @@ private:
                                             " AND privilege_name IN (SELECT privilege_name FROM privilege_to_map)"},
         { StmtType::EDeletePrivilegesToMap, "DELETE FROM privilege_to_map"},
         { StmtType::EGetGroups, "SELECT DISTINCT group_name FROM privilege_group_view" },
+        { StmtType::EGetAllAppPkgIds, "SELECT DISTINCT app_name, pkg_name FROM app_pkg_view ORDER BY app_name" },
+        { StmtType::EGetAllPrivilegeGroups, "SELECT DISTINCT privilege_name, group_name FROM privilege_group_view"
+                                            " ORDER BY privilege_name, group_name" },
+        { StmtType::EGetAllAppPrivileges, "SELECT app_name, uid, privilege_name FROM app_privilege_view"
+                                          " ORDER BY app_name, uid, privilege_name" },
+        { StmtType::EGetUserAppsAfter, "SELECT name FROM app WHERE uid=? AND name>? ORDER BY name LIMIT ?" },
+        { StmtType::EGetAppsAfter, "SELECT DISTINCT name FROM app WHERE name>? ORDER BY name LIMIT ?" },
     };
 
     /**
@@ -276,6 +291,33 @@ public:
      * @exception DB::SqlConnection::Exception::InternalError on internal error
      */
     void GetUserApps(uid_t uid, std::vector<std::string> &apps);
+
+    /**
+     * Retrieve a sorted chunk of apps assigned to user, for listing them in parts
+     *
+     * @param uid - user identifier
+     * @param after - only apps with identifiers sorting after this one are returned
+     * @param limit - maximum number of returned apps
+     * @param[out] apps - list of apps assigned to user, ordered by identifier,
+     *                    this parameter do not need to be empty, but
+     *                    it is being overwritten during function call.
+     * @exception DB::SqlConnection::Exception::InternalError on internal error
+     */
+    void GetUserApps(uid_t uid, const std::string &after, unsigned int limit,
+        std::vector<std::string> &apps);
+
+    /**
+     * Retrieve a sorted chunk of apps installed for any user, for listing them in parts
+     *
+     * @param after - only apps with identifiers sorting after this one are returned
+     * @param limit - maximum number of returned apps
+     * @param[out] apps - list of distinct app identifiers in sorted order,
+     *                    this parameter do not need to be empty, but
+     *                    it is being overwritten during function call.
+     * @exception DB::SqlConnection::Exception::InternalError on internal error
+     */
+    void GetApps(const std::string &after, unsigned int limit,
+        std::vector<std::string> &apps);
     /**
      * Retrieve a list of all application ids for a package id
      *
@@ -331,6 +373,33 @@ public:
      * @exception DB::SqlConnection::Exception::InternalError on internal error
      */
     void GetGroups(std::vector<std::string> &grp_names);
+
+    /**
+     * Retrieve all (application id, package id) pairs, sorted by application id
+     *
+     * @param[out] appPkgIds - list of application and package id pairs
+     * @exception DB::SqlConnection::Exception::InternalError on internal error
+     */
+    void GetAllAppPkgIds(std::vector<std::pair<std::string, std::string>> &appPkgIds);
+
+    /**
+     * Retrieve all (privilege, group name) pairs, sorted by privilege
+     *
+     * @param[out] privilegeGroups - list of privilege and group name pairs
+     * @exception DB::SqlConnection::Exception::InternalError on internal error
+     */
+    void GetAllPrivilegeGroups(
+        std::vector<std::pair<std::string, std::string>> &privilegeGroups);
+
+    /**
+     * Retrieve all (application id, uid, privilege) triples,
+     * sorted by application id, uid and privilege
+     *
+     * @param[out] appPrivileges - list of application privileges for all users
+     * @exception DB::SqlConnection::Exception::InternalError on internal error
+     */
+    void GetAllAppPrivileges(
+        std::vector<std::tuple<std::string, uid_t, std::string>> &appPrivileges);
 };
 
 } //namespace SecurityManager
@@ -138,9 +138,19 @@ enum class SecurityModuleCall
     POLICY_GET_DESCRIPTIONS,
     GET_PRIVILEGES_MAPPING,
     GROUPS_GET,
+    GET_POLICY_PAGE,
+    GET_CONF_POLICY_ADMIN_PAGE,
+    KEEP_CONNECTION,
+    APP_GET_LAUNCH_BUNDLES,
     NOOP = 0x90,
 };
 
+/* Upper limit of entries returned in a single page of policy listing */
+const unsigned int POLICY_PAGE_SIZE_MAX = 1024;
+
+/* Upper limit of applications in a single launch bundles request */
+const unsigned int LAUNCH_BUNDLES_MAX = 256;
+
 enum class MasterSecurityModuleCall
 {
     CYNARA_UPDATE_POLICY,
@@ -27,9 +27,11 @@
 #include <unistd.h>
 #include <sys/types.h>
 
+#include <limits>
 #include <unordered_set>
 
 #include "security-manager.h"
+#include "smack-labels.h"
 
 namespace SecurityManager {
 
@@ -51,6 +53,18 @@ public:
     ServiceImpl();
     virtual ~ServiceImpl();
 
+    /**
+    * Publish memory mapped snapshot of application database for clients.
+    * On failure the old snapshot is withdrawn, so that clients use IPC.
+    */
+    static void publishAppSnapshot(void);
+
+    /**
+    * Bring application policies in Cynara in line with the database, after
+    * queued Cynara updates were lost by previous instance of the service.
+    */
+    static void restoreAppPolicies(void);
+
     /**
     * Process application installation request.
     *
@@ -102,6 +116,24 @@ public:
     int getAppGroups(const std::string &appId, uid_t uid, pid_t pid, bool isSlave,
             std::unordered_set<gid_t> &gids);
 
+    /**
+    * Process query for everything needed to launch the application:
+    * its package, Smack label and supplementary groups, as returned
+    * by getAppGroups().
+    *
+    * @param[in]  appId application identifier
+    * @param[in]  uid id of the requesting user
+    * @param[in]  pid id of the requesting process (to construct Cynara session id)
+    * @param[in]  isSlave Indicates if function should be called under slave mode
+    * @param[out] pkgId package of the application
+    * @param[out] label Smack label of the application
+    * @param[out] gids returned set of allowed group ids
+    *
+    * @return API return code, as defined in protocols.h
+    */
+    int getAppLaunchBundle(const std::string &appId, uid_t uid, pid_t pid, bool isSlave,
+            std::string &pkgId, SmackLabelCache::Label &label, std::unordered_set<gid_t> &gids);
+
     /**
     * Process user adding request.
     *
@@ -153,6 +185,24 @@ public:
     */
     int getConfiguredPolicy(bool forAdmin, const policy_entry &filter, uid_t uid, pid_t pid, const std::string &smackLabel, std::vector<policy_entry> &policyEntries);
 
+    /**
+    * Fetch a page of admin enforced policies, listed application by application:
+    * policies of the wildcard client first and then policies of installed
+    * applications in order of their identifiers. Policies of clients that are
+    * neither the wildcard nor an installed application are not listed.
+    *
+    * @param[in] filter filter for limiting the query
+    * @param[in] uid identifier of queried user
+    * @param[in] pid PID of requesting process
+    * @param[out] policyEntries vector of policy entries with result
+    * @param[in] after last entry of the previous page, nullptr for the first page
+    * @param[in] limit maximum number of entries to return
+    *
+    * @return API return code, as defined in protocols.h
+    */
+    int getConfiguredPolicyPage(const policy_entry &filter, uid_t uid, pid_t pid, const std::string &smackLabel, std::vector<policy_entry> &policyEntries,
+        const policy_entry *after, size_t limit);
+
     /**
     * Fetch all privileges for all apps installed for specific user.
     *
@@ -161,10 +211,16 @@ public:
     * @param[in] uid identifier of queried user
     * @param[in] pid PID of requesting process
     * @param[out] policyEntries vector of policy entries with result
+    * @param[in] after last entry of the previous page, nullptr to start from the beginning
+    * @param[in] limit maximum number of entries to return
+    *
+    * Entries are ordered by user, application and privilege, so a page can be
+    * resumed after the given entry without enumerating the ones before it.
     *
     * @return API return code, as defined in protocols.h
     */
-    int getPolicy(const policy_entry &filter, uid_t uid, pid_t pid, const std::string &smackLabel, std::vector<policy_entry> &policyEntries);
+    int getPolicy(const policy_entry &filter, uid_t uid, pid_t pid, const std::string &smackLabel, std::vector<policy_entry> &policyEntries,
+        const policy_entry *after = nullptr, size_t limit = std::numeric_limits<size_t>::max());
 
     /**
     * Process getting policy descriptions list.
@@ -0,0 +1,236 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/**
+ * @file        smack-labeler.h
+ * @author      Rafal Krypa <r.krypa@samsung.com>
+ * @version     1.0
+ * @brief       Recursive Smack labeling of directory trees
+ *
+ */
+#ifndef _SMACK_LABELER_H_
+#define _SMACK_LABELER_H_
+
+#include <sys/stat.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <smack-exceptions.h>
+
+namespace SecurityManager {
+
+/**
+ * Sets Smack extended attributes on a directory tree.
+ *
+ * Each directory is a unit of work: its entries are labeled and its
+ * subdirectories are queued as new units. A queued directory is opened
+ * without following symbolic links and must be the same inode that was
+ * found by its parent, so that a directory swapped for a link while queued
+ * is reported instead of labeled through the link. Labeling starts on the calling
+ * thread. When the tree turns out to be large (more entries visited than
+ * the threshold), helper threads are started and take units from the queue
+ * of the calling thread (work stealing), each worker using its own queue
+ * for units it discovers.
+ *
+ * Errors don't stop the walk. After it is finished, the error on the first
+ * path in lexicographic order is reported, so that the same tree always
+ * results in the same error regardless of scheduling.
+ *
+ * Attributes are written with synchronous lsetxattr() calls (the default)
+ * or, where supported by the kernel, submitted in batches to io_uring owned
+ * by each worker. io_uring sets them on descriptors of regular files and
+ * directories opened without following links, other entries are labeled
+ * synchronously.
+ *
+ * Attributes already having the right value are not written again. They
+ * are read only if a manifest is used or the root of the tree already has
+ * the label, a tree labeled for the first time is written without reads.
+ * Optional manifest remembers inode number and ctime of entries labeled
+ * by previous run with the same attributes. Entries that haven't changed
+ * since then are skipped without reading their attributes.
+ */
+class SmackLabeler
+{
+public:
+    struct Attributes {
+        /* SMACK64 of all entries and SMACK64EXEC of executables */
+        std::string label;
+        /* Set SMACK64TRANSMUTE on directories */
+        bool transmute;
+        /* Set SMACK64EXEC on regular executable files */
+        bool executables;
+    };
+
+    struct Stats {
+        /* Entries found in the tree */
+        size_t visited;
+        /* Entries that had at least one attribute written */
+        size_t written;
+        /* Entries that already had all attributes set */
+        size_t skipped;
+        /* Attributes read to compare them with the new values */
+        size_t attrReads;
+        /* Attributes written */
+        size_t attrWrites;
+    };
+
+    enum class Backend {
+        /* lsetxattr() for every attribute */
+        SYSCALL,
+        /* IORING_OP_FSETXATTR, falls back to SYSCALL if not supported */
+        IO_URING,
+    };
+
+    static const unsigned MAX_THREADS = 4;
+    static const size_t PARALLEL_THRESHOLD = 2048;
+
+    /**
+     * @param[in] attributes - attributes to set on the tree
+     * @param[in] maxThreads - maximum number of threads labeling the tree,
+     *            including the calling thread
+     * @param[in] parallelThreshold - number of visited entries after which
+     *            helper threads are started
+     */
+    SmackLabeler(const Attributes &attributes, unsigned maxThreads = MAX_THREADS,
+        size_t parallelThreshold = PARALLEL_THRESHOLD);
+    ~SmackLabeler();
+
+    /**
+     * Select how attributes are written by labelers created afterwards.
+     * Backend::SYSCALL is used by default.
+     *
+     * @param[in] backend - backend to use
+     */
+    static void setBackend(Backend backend);
+
+    /**
+     * Label file or directory tree, recursively.
+     * Symbolic links are labeled, but not followed.
+     *
+     * @param[in] path - root of the tree
+     * @throws SmackException::FileError
+     */
+    void label(const std::string &path);
+
+    /**
+     * Use manifest of previously labeled entries. Must be called before
+     * label(), the manifest is updated after the tree is labeled without
+     * errors. Missing, damaged or outdated manifest is ignored.
+     *
+     * @param[in] manifestPath - path to the manifest file
+     */
+    void setManifest(const std::string &manifestPath);
+
+    /**
+     * @return counters of entries processed by label()
+     */
+    Stats getStats() const;
+
+private:
+    class XattrWriter;
+    class SyscallXattrWriter;
+    class IoUringXattrWriter;
+
+    struct XattrOp {
+        const char *name;
+        const std::string *value;
+    };
+
+    struct ManifestEntry {
+        std::string path;
+        ino_t ino;
+        struct timespec ctime;
+    };
+
+    struct Unit {
+        std::string path;
+        dev_t dev;
+        ino_t ino;
+    };
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Unit> units;
+        /* Accessed only by the worker owning it */
+        std::vector<ManifestEntry> manifest;
+        std::unique_ptr<XattrWriter> writer;
+    };
+
+    typedef std::unordered_map<std::string, std::pair<ino_t, struct timespec>> Manifest;
+
+    std::string manifestHeader() const;
+    void saveManifest();
+    bool inManifest(const std::string &path, const struct stat &st) const;
+    bool xattrMatches(const std::string &path, const char *name, const std::string &value);
+
+    void run(unsigned self);
+    bool takeUnit(unsigned self, Unit &unit);
+    void pushUnit(unsigned self, std::string &&path, const struct stat &st);
+    void processDirectory(unsigned self, const Unit &unit);
+    void labelEntry(unsigned self, int dirFd, const char *name, const std::string &path,
+        const struct stat &st);
+    void entryWritten(unsigned self, const std::string &path);
+    void recordManifest(unsigned self, const std::string &path, const struct stat &st);
+    XattrWriter &getWriter(unsigned self);
+    void flushWriter(unsigned self);
+    void reportError(const std::string &path, const std::string &message);
+    void startHelpers();
+
+    static Backend s_backend;
+
+    const Attributes m_attributes;
+    const unsigned m_maxThreads;
+    const size_t m_parallelThreshold;
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::vector<std::thread> m_helpers;
+    /* Queued units and units being processed */
+    std::atomic<size_t> m_pending;
+    std::atomic<size_t> m_visited;
+    std::atomic<size_t> m_written;
+    std::atomic<size_t> m_skipped;
+    std::atomic<size_t> m_attrReads;
+    std::atomic<size_t> m_attrWrites;
+    std::atomic<bool> m_parallel;
+    /* Read attributes before writing them, set by label() */
+    bool m_compare;
+
+    std::mutex m_idleMutex;
+    std::condition_variable m_idleCond;
+
+    std::mutex m_errorMutex;
+    size_t m_errorCount;
+    std::string m_errorPath;
+    std::string m_errorMessage;
+
+    std::string m_root;
+    std::string m_manifestPath;
+    Manifest m_manifest;
+};
+
+} // namespace SecurityManager
+
+#endif /* _SMACK_LABELER_H_ */
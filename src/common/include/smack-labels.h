@@ -26,12 +26,77 @@
 #ifndef _SMACK_LABELS_H_
 #define _SMACK_LABELS_H_
 
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <smack-exceptions.h>
+#include <smack-labeler.h>
 #include <security-manager.h>
 
 namespace SecurityManager {
+
+struct SmackLabelCacheStats
+{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t flushes;
+    size_t entries;
+    /* Estimated memory used by keys, labels and table nodes */
+    size_t bytes;
+};
+
+/**
+ * Interning table of generated Smack labels, keyed by label kind,
+ * identifier and zone. Labels are validated once, when generated, and
+ * shared as immutable strings afterwards. Holders of a label keep it valid
+ * after it's dropped from the table. The table is bounded, it's flushed
+ * when full. For use by the service only: its mutex must not be taken in
+ * a forked child of a multithreaded process.
+ */
+class SmackLabelCache
+{
+public:
+    enum class Kind {
+        APP,
+        PKG,
+        PKG_RO,
+    };
+
+    typedef std::shared_ptr<const std::string> Label;
+
+    static SmackLabelCache &getInstance();
+
+    /**
+     * Get label of given kind for application or package identifier.
+     *
+     * @param[in] kind - kind of the label
+     * @param[in] id - application identifier for Kind::APP, package identifier otherwise
+     * @param[in] zoneId - ID of zone for which label is generated, empty for host
+     * @return zone-specific label
+     * @throws SmackException::InvalidLabel
+     */
+    Label get(Kind kind, const std::string &id, const std::string &zoneId = std::string());
+
+    void flush();
+
+    SmackLabelCacheStats getStats();
+
+    void logStats();
+
+private:
+    SmackLabelCache(size_t capacity = 8192);
+
+    static std::string generate(Kind kind, const std::string &id);
+
+    const size_t m_capacity;
+    std::mutex m_mutex;
+    std::unordered_map<std::string, Label> m_labels;
+    SmackLabelCacheStats m_stats;
+};
+
 namespace SmackLabels {
 
 /**
@@ -42,10 +107,26 @@ namespace SmackLabels {
  * @param pathType[in] type of path to setup. See description of
  *         app_install_path_type in security-manager.h for details
  * @param zoneId[in] ID of zone for which label should be set
+ * @return counters of labeled entries
  */
-void setupPath(const std::string &pkgId, const std::string &path,
+SmackLabeler::Stats setupPath(const std::string &pkgId, const std::string &path,
     app_install_path_type pathType, const std::string &zoneId);
 
+/**
+ * Keep manifests of labeled paths, so that entries unchanged since
+ * previous installation are skipped by setupPath(). Disabled by default.
+ *
+ * @return true on success, false if manifests directory can't be created
+ */
+bool enableManifests();
+
+/**
+ * Remove manifests of labeled paths of a package.
+ *
+ * @param pkgId[in] package identifier
+ */
+void removeManifests(const std::string &pkgId);
+
 /**
  * Sets Smack labels on a <ROOT_APP>/<pkg_id> non-recursively
  *
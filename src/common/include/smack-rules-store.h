@@ -0,0 +1,206 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/**
+ * @file        smack-rules-store.h
+ * @author      Rafal Krypa <r.krypa@samsung.com>
+ * @version     1.0
+ * @brief       Persistent storage of Smack rules of applications and packages
+ *
+ */
+#ifndef _SMACK_RULES_STORE_H_
+#define _SMACK_RULES_STORE_H_
+
+#include <sys/types.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <smack-exceptions.h>
+
+namespace SecurityManager {
+
+/**
+ * Smack rules of all applications and packages, kept in a single file.
+ *
+ * Rules are grouped by owner (application or package) and indexed by it
+ * in memory. Every change is appended to the file as a transaction
+ * replacing all rules of one owner, so that updates don't rewrite the
+ * whole file. Transactions are terminated by a commit record, incomplete
+ * transaction at the end of the file is discarded. Once the file holds
+ * too many outdated records, it is compacted: written again with current
+ * rules only and atomically replaced.
+ *
+ * Setting the same rules again doesn't write anything. Appended changes
+ * are synced to disk right away, unless made within a Batch: then they
+ * are synced together when the outermost batch ends.
+ *
+ * Rules stored in per-application and per-package files in accesses.d
+ * by previous versions are imported when the store is created.
+ */
+class SmackRulesStore
+{
+public:
+    struct Rule {
+        std::string subject;
+        std::string object;
+        std::string permissions;
+    };
+
+    typedef std::vector<Rule> Rules;
+
+    /**
+     * Scope in which changes of the store are not synced to disk one by
+     * one, but all together when the outermost batch is destroyed.
+     * Errors of that sync are only logged, call sync() to handle them.
+     */
+    class Batch
+    {
+    public:
+        Batch();
+        ~Batch();
+
+        Batch(const Batch &) = delete;
+        Batch &operator=(const Batch &) = delete;
+    };
+
+    static SmackRulesStore &getInstance();
+
+    /**
+     * Use another file as the store, instead of the one in TZ_SYS_SMACK.
+     * Legacy rules files are then imported from accesses.d next to it.
+     * Meant for benchmarks, must be called before the store is used.
+     *
+     * @param[in] path - path of the store file
+     */
+    static void setPath(const std::string &path);
+
+    /**
+     * @return owner name of application rules
+     */
+    static std::string appOwner(const std::string &appId);
+
+    /**
+     * @return owner name of package rules
+     */
+    static std::string pkgOwner(const std::string &pkgId);
+
+    /**
+     * Get rules of an owner.
+     *
+     * @param[in] owner - owner of the rules
+     * @param[out] rules - rules of the owner
+     * @return false if the owner has no rules
+     * @throws SmackException::FileError
+     */
+    bool get(const std::string &owner, Rules &rules);
+
+    /**
+     * Replace all rules of an owner. Empty rules remove the owner.
+     *
+     * @param[in] owner - owner of the rules
+     * @param[in] rules - new rules of the owner
+     * @throws SmackException::FileError
+     */
+    void set(const std::string &owner, const Rules &rules);
+
+    /**
+     * Remove all rules of an owner.
+     *
+     * @param[in] owner - owner of the rules
+     * @param[out] rules - removed rules
+     * @return false if the owner had no rules
+     * @throws SmackException::FileError
+     */
+    bool remove(const std::string &owner, Rules &rules);
+
+    /**
+     * Rewrite the file with current rules only.
+     *
+     * @throws SmackException::FileError
+     */
+    void compact();
+
+    /**
+     * Sync changes appended to the file to disk.
+     *
+     * @throws SmackException::FileError
+     */
+    void sync();
+
+    /**
+     * Load rules of all owners from the file into the kernel, in large
+     * writes to smackfs. Meant to be run at boot, without the service.
+     * Missing file is not an error, there are no rules to load then.
+     *
+     * @return number of rules loaded
+     * @throws SmackException::FileError
+     */
+    static size_t loadToKernel();
+
+    /**
+     * Load rules of all owners from the file into given Smack load
+     * interface, like loadToKernel() does with load2 of smackfs.
+     *
+     * @param[in] loadPath - path of the load interface
+     * @return number of rules loaded
+     * @throws SmackException::FileError
+     */
+    static size_t load(const std::string &loadPath);
+
+private:
+    typedef std::map<std::string, Rules> Index;
+
+    /* Records appended after compaction, before the next one is due */
+    static const size_t COMPACT_THRESHOLD = 4096;
+
+    SmackRulesStore();
+    ~SmackRulesStore();
+
+    static std::string storePath();
+    static std::string legacyPath();
+    static bool parse(const std::string &path, Index &index, size_t &records,
+        off_t &committed);
+    static size_t countRules(const Index &index);
+
+    void ensureLoaded();
+    void importLegacy(std::vector<std::string> &files);
+    void rewrite();
+    void syncFile();
+    void commit(const std::string &owner, const Rules &rules);
+
+    static std::string s_path;
+
+    std::mutex m_mutex;
+    bool m_loaded;
+    int m_fd;
+    Index m_index;
+    /* Records in the file, including outdated ones */
+    size_t m_records;
+    /* Rules in the index */
+    size_t m_rules;
+    /* Nesting level of Batch scopes */
+    unsigned m_batchDepth;
+    /* Changes appended, but not synced */
+    bool m_dirty;
+};
+
+} // namespace SecurityManager
+
+#endif /* _SMACK_RULES_STORE_H_ */
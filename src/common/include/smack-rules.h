@@ -25,27 +25,123 @@
 #ifndef _SMACK_RULES_H_
 #define _SMACK_RULES_H_
 
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <string>
 #include <smack-exceptions.h>
+#include <smack-rules-store.h>
 
 struct smack_accesses;
 
 namespace SecurityManager {
 
+/**
+ * Application rules template, parsed into rules with placeholder slots
+ * for application and package labels.
+ *
+ * Template file is compiled on first use. Once StartWatching() is called,
+ * the compiled template is kept and compiled again only after the file
+ * changes. Without the watch it is compiled on every use.
+ */
+class SmackRulesTemplate
+{
+public:
+    /* Text before a placeholder and the placeholder following it */
+    struct Piece {
+        enum class Slot {
+            NONE,
+            APP_LABEL,
+            PKG_LABEL,
+        };
+
+        std::string literal;
+        Slot slot;
+    };
+
+    typedef std::vector<Piece> Label;
+
+    struct Rule {
+        Label subject;
+        Label object;
+        std::string permissions;
+    };
+
+    typedef std::vector<Rule> Rules;
+
+    static SmackRulesTemplate &getInstance();
+
+    /**
+     * Parse template rules.
+     *
+     * @param[in] templateRules - lines of rules template
+     * @return compiled rules
+     */
+    static std::shared_ptr<const Rules> compile(const std::vector<std::string> &templateRules);
+
+    /**
+     * Get compiled rules from the template file.
+     *
+     * @return compiled rules
+     */
+    std::shared_ptr<const Rules> get();
+
+    /**
+     * Start watching the template file for changes.
+     * Returned descriptor becomes readable after the file is changed,
+     * ProcessWatchEvents() is to be called then.
+     *
+     * @return inotify descriptor or -1 on error
+     */
+    int StartWatching();
+
+    /**
+     * Handle change notifications read from the watch descriptor, drop
+     * compiled template if the file has changed.
+     *
+     * @param[in] events - inotify events read from descriptor returned by StartWatching()
+     */
+    void ProcessWatchEvents(const std::vector<unsigned char> &events);
+
+private:
+    SmackRulesTemplate();
+
+    static std::shared_ptr<const Rules> load();
+
+    std::mutex m_mutex;
+    std::shared_ptr<const Rules> m_rules;
+    /* Owned by SocketManager once registered there */
+    int m_watchFd;
+};
+
 class SmackRules
 {
 public:
+    /* Counters of rule writes to the kernel */
+    struct Stats {
+        /* Rules written with new or changed permissions */
+        size_t applied;
+        /* Rules removed */
+        size_t cleared;
+        /* Rules already in the kernel with the same permissions */
+        size_t unchanged;
+
+        Stats &operator+=(const Stats &other);
+    };
+
     SmackRules();
     virtual ~SmackRules();
 
     void add(const std::string &subject, const std::string &object,
             const std::string &permissions);
+    void add(const SmackRulesStore::Rules &rules);
     void addModify(const std::string &subject, const std::string &object,
             const std::string &allowPermissions, const std::string &denyPermissions);
     void loadFromFile(const std::string &path);
     void addFromTemplate(const std::vector<std::string> &templateRules,
         const std::string &appId, const std::string &pkgId, const std::string &zoneId);
+    void addFromTemplate(const SmackRulesTemplate::Rules &templateRules,
+        const std::string &appId, const std::string &pkgId, const std::string &zoneId);
     void addFromTemplateFile(const std::string &appId, const std::string &pkgId,
             const std::string &zoneId);
 
@@ -53,6 +149,11 @@ public:
     void clear() const;
     void saveToFile(const std::string &path) const;
 
+    /**
+     * @return rules added with add() and addFromTemplate*(), in order
+     */
+    const SmackRulesStore::Rules &getRules() const;
+
     /**
      * Create cross dependencies for all applications in a package
      *
@@ -65,31 +166,46 @@ public:
     void generatePackageCrossDeps(const std::vector<std::string> &pkgContents,
             const std::string &zoneId);
 
+    /**
+     * Create cross dependencies between an application and all other
+     * applications in its package.
+     *
+     * @param[in] appId - application for which rules are generated
+     * @param[in] pkgContents - a list of all applications inside the package
+     * @param[in] zoneId - ID of zone which requested application install
+     */
+    void generateAppCrossDeps(const std::string &appId,
+            const std::vector<std::string> &pkgContents, const std::string &zoneId);
+
     /**
      * Install package-specific smack rules.
      *
      * Function creates smack rules using predefined template. Rules are applied
-     * to the kernel and saved on persistent storage so they are loaded on system boot.
+     * to the kernel and saved in SmackRulesStore so they are loaded on system boot.
+     * Only rules that differ from the ones saved before are written to the kernel.
      *
      * @param[in] appId - application id that is beeing installed
      * @param[in] pkgId - package id that the application is in
      * @param[in] pkgContents - a list of all applications in the package
+     * @return counters of kernel rule writes
      */
-    static void installApplicationRules(const std::string &appId, const std::string &pkgId,
+    static Stats installApplicationRules(const std::string &appId, const std::string &pkgId,
         const std::vector<std::string> &pkgContents);
 
     /**
      * Install package-specific smack rules.
      *
      * Function creates smack rules using predefined template. Rules are applied
-     * to the kernel and saved on persistent storage so they are loaded on system boot.
+     * to the kernel and saved in SmackRulesStore so they are loaded on system boot.
+     * Only rules that differ from the ones saved before are written to the kernel.
      *
      * @param[in] appId - application id that is beeing installed
      * @param[in] pkgId - package id that the application is in
      * @param[in] pkgContents - a list of all applications in the package
      * @param[in] zoneId - ID of zone which requested application install
+     * @return counters of kernel rule writes
      */
-    static void installApplicationRules(const std::string &appId, const std::string &pkgId,
+    static Stats installApplicationRules(const std::string &appId, const std::string &pkgId,
         const std::vector<std::string> &pkgContents, const std::string &zoneId);
     /**
      * Uninstall package-specific smack rules.
@@ -98,8 +214,9 @@ public:
      * and removes them from the persistent storage.
      *
      * @param[in] pkgId - package identifier
+     * @return counters of kernel rule writes
      */
-    static void uninstallPackageRules(const std::string &pkgId);
+    static Stats uninstallPackageRules(const std::string &pkgId);
 
     /* FIXME: Remove this function if real pkgId instead of "User" label will be used
      * in generateAppLabel(). */
@@ -113,10 +230,12 @@ public:
     *
     * @param[in] appId - application id
     * @param[in] pkgId - package id that the application belongs to
-    * @param[in] appsInPkg - a list of other applications in the same package id that the application belongs to
+    * @param[in] appsInPkg - a list of applications in the same package id that the application
+    *            belongs to, still including the application if it remains installed for other users
     * @param[in] zoneId - ID of zone which requested application uninstall
+    * @return counters of kernel rule writes
     */
-    static void uninstallApplicationRules(const std::string &appId, const std::string &pkgId,
+    static Stats uninstallApplicationRules(const std::string &appId, const std::string &pkgId,
             std::vector<std::string> appsInPkg, const std::string &zoneId);
 
     /**
@@ -129,44 +248,54 @@ public:
      * @param[in] pkgId - id of the package to update
      * @param[in] pkgContents - a list of all applications in the package
      * @param[in] zoneId - ID of zone which requested application uninstall
+     * @return counters of kernel rule writes
      */
-    static void updatePackageRules(const std::string &pkgId,
+    static Stats updatePackageRules(const std::string &pkgId,
             const std::vector<std::string> &pkgContents, const std::string &zoneId);
 
 private:
     /**
-     * Create a path for package rules
+     * Update package rules after installation or uninstallation of a single
+     * application. Only rules between this application and other applications
+     * in the package are applied to or removed from the kernel and replaced
+     * in package rules of the store.
      *
+     * @param[in] appId - application that was installed or uninstalled
+     * @param[in] pkgId - id of the package to update
+     * @param[in] pkgContents - a list of all applications in the package,
+     *            without the application if it was uninstalled
+     * @param[in] zoneId - ID of zone which requested the operation
+     * @return counters of kernel rule writes
      */
-    static std::string getPackageRulesFilePath(const std::string &pkgId);
-
-    /**
-     * Create a path for application rules
-     */
-    static std::string getApplicationRulesFilePath(const std::string &appId);
+    static Stats updatePackageRulesForApp(const std::string &appId, const std::string &pkgId,
+            const std::vector<std::string> &pkgContents, const std::string &zoneId);
 
     /**
-     * Uninstall rules inside a specified file path
+     * Uninstall rules of a store owner
      *
      * This is a utility function that will clear all
-     * rules in the file specified by path
+     * rules of the owner in the kernel and remove them
+     * from the store
      *
-     * @param[in] path - path to the file that contains the rules
+     * @param[in] owner - owner of the rules in SmackRulesStore
      */
-    static void uninstallRules (const std::string &path);
+    static Stats uninstallRules (const std::string &owner);
 
     /**
-     * Helper method: replace all occurrences of \ref needle in \ref haystack
-     * with \ref replace.
+     * Bring kernel rules from the old set to the new one. Rules missing in
+     * the new set are cleared, new rules and rules with changed permissions
+     * are applied, the rest is not written at all. Rules lost by the kernel
+     * are restored with security-manager-cmd --load-rules.
      *
-     * @param[in,out] haystack string to modify
-     * @param needle string to find in \ref haystack
-     * @param replace string to replace \ref needle with
+     * @param[in] oldRules - rules currently in the kernel
+     * @param[in] newRules - rules that should be in the kernel
+     * @return counters of kernel rule writes
      */
-    static void strReplace(std::string &haystack, const std::string &needle,
-            const std::string &replace);
+    static Stats applyDiff(const SmackRulesStore::Rules &oldRules,
+            const SmackRulesStore::Rules &newRules);
 
     smack_accesses *m_handle;
+    SmackRulesStore::Rules m_rules;
 };
 
 } // namespace SecurityManager
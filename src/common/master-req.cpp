@@ -28,6 +28,7 @@
 
 #include "message-buffer.h"
 #include "connection.h"
+#include "cynara.h"
 
 namespace SecurityManager {
 namespace MasterReq {
@@ -47,6 +48,10 @@ int CynaraPolicyUpdate(const std::string &appId,  const std::string &uidstr,
     if (ret == SECURITY_MANAGER_API_SUCCESS)
         Deserialization::Deserialize(retBuf, ret);
 
+    /* Master changed Cynara policy, decisions cached in slave are stale */
+    if (ret == SECURITY_MANAGER_API_SUCCESS)
+        CynaraDecisionCache::getInstance().flush();
+
     return ret;
 }
 
@@ -63,6 +68,9 @@ int CynaraUserInit(const uid_t uidAdded, int userType)
     if (ret == SECURITY_MANAGER_API_SUCCESS)
         Deserialization::Deserialize(retBuf, ret);
 
+    if (ret == SECURITY_MANAGER_API_SUCCESS)
+        CynaraDecisionCache::getInstance().flush();
+
     return ret;
 }
 
@@ -79,6 +87,9 @@ int CynaraUserRemove(const uid_t uidDeleted)
     if (ret == SECURITY_MANAGER_API_SUCCESS)
         Deserialization::Deserialize(retBuf, ret);
 
+    if (ret == SECURITY_MANAGER_API_SUCCESS)
+        CynaraDecisionCache::getInstance().flush();
+
     return ret;
 }
 
@@ -131,6 +142,9 @@ int PolicyUpdate(const std::vector<policy_entry> &policyEntries, uid_t uid, pid_
     if (ret == SECURITY_MANAGER_API_SUCCESS)
         Deserialization::Deserialize(retBuf, ret);
 
+    if (ret == SECURITY_MANAGER_API_SUCCESS)
+        CynaraDecisionCache::getInstance().flush();
+
     return ret;
 }
 
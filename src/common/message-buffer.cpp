@@ -28,16 +28,43 @@
 
 namespace SecurityManager {
 
+void MessageBuffer::Append(const unsigned char *bytes, size_t num) {
+    if (m_readPos > 0 && m_readPos >= Size()) {
+        // drop consumed data rather than let the buffer grow
+        m_buffer.erase(m_buffer.begin(), m_buffer.begin() + m_readPos);
+        m_readPos = 0;
+    }
+    m_buffer.insert(m_buffer.end(), bytes, bytes + num);
+}
+
 void MessageBuffer::Push(const RawBuffer &data) {
-    m_buffer.AppendCopy(&data[0], data.size());
+    Append(data.data(), data.size());
+}
+
+void MessageBuffer::Push(RawBuffer &&data) {
+    if (Size() == 0) {
+        m_buffer = std::move(data);
+        m_readPos = 0;
+    } else
+        Append(data.data(), data.size());
 }
 
 RawBuffer MessageBuffer::Pop() {
-    size_t size = m_buffer.Size();
-    RawBuffer buffer;
-    buffer.resize(size + sizeof(size_t));
-    memcpy(&buffer[0], &size, sizeof(size_t));
-    m_buffer.FlattenConsume(&buffer[sizeof(size_t)], size);
+    size_t size = Size();
+    if (m_readPos < sizeof(size_t)) {
+        m_buffer.insert(m_buffer.begin(), sizeof(size_t) - m_readPos, 0);
+        m_readPos = sizeof(size_t);
+    }
+
+    size_t header = m_readPos - sizeof(size_t);
+    memcpy(&m_buffer[header], &size, sizeof(size_t));
+    if (header > 0)
+        m_buffer.erase(m_buffer.begin(), m_buffer.begin() + header);
+
+    RawBuffer buffer(std::move(m_buffer));
+    m_buffer.clear();
+    m_readPos = 0;
+    m_bytesLeft = 0;
     return buffer;
 }
 
@@ -45,7 +72,7 @@ bool MessageBuffer::Ready() {
     CountBytesLeft();
     if (m_bytesLeft == 0)
         return false;
-    if (m_bytesLeft > m_buffer.Size())
+    if (m_bytesLeft > Size())
         return false;
     return true;
 }
@@ -53,17 +80,30 @@ bool MessageBuffer::Ready() {
 void MessageBuffer::Read(size_t num, void *bytes) {
     CountBytesLeft();
     if (num > m_bytesLeft) {
-        LogError("Protocol broken. OutOfData. Asked for: " << num << " Ready: " << m_bytesLeft << " Buffer.size(): " << m_buffer.Size());
+        LogError("Protocol broken. OutOfData. Asked for: " << num << " Ready: " << m_bytesLeft << " Buffer.size(): " << Size());
         Throw(Exception::OutOfData);
     }
 
-    m_buffer.FlattenConsume(bytes, num);
+    memcpy(bytes, m_buffer.data() + m_readPos, num);
+    m_readPos += num;
     m_bytesLeft -= num;
+
+    if (m_readPos == m_buffer.size()) {
+        // everything consumed, reuse the storage from the beginning
+        m_buffer.clear();
+        m_readPos = 0;
+    }
 }
 
 void MessageBuffer::Write(size_t num, const void *bytes) {
-    m_buffer.AppendCopy(bytes, num);
+    if (m_buffer.empty()) {
+        // leave room for the size, so that Pop() doesn't have to copy
+        m_buffer.reserve(INITIAL_CAPACITY);
+        m_buffer.resize(sizeof(size_t));
+        m_readPos = sizeof(size_t);
+    }
+    const unsigned char *data = static_cast<const unsigned char *>(bytes);
+    m_buffer.insert(m_buffer.end(), data, data + num);
 }
 
 } // namespace SecurityManager
-
@@ -294,6 +294,33 @@ void PrivilegeDb::GetUserApps(uid_t uid, std::vector<std::string> &apps)
     });
 }
 
+void PrivilegeDb::GetUserApps(uid_t uid, const std::string &after, unsigned int limit,
+    std::vector<std::string> &apps)
+{
+   try_catch<void>([&] {
+        auto command = getStatement(StmtType::EGetUserAppsAfter);
+        command->BindInteger(1, static_cast<unsigned int>(uid));
+        command->BindString(2, after);
+        command->BindInteger(3, limit);
+        apps.clear();
+        while (command->Step())
+            apps.push_back(command->GetColumnString(0));
+    });
+}
+
+void PrivilegeDb::GetApps(const std::string &after, unsigned int limit,
+    std::vector<std::string> &apps)
+{
+   try_catch<void>([&] {
+        auto command = getStatement(StmtType::EGetAppsAfter);
+        command->BindString(1, after);
+        command->BindInteger(2, limit);
+        apps.clear();
+        while (command->Step())
+            apps.push_back(command->GetColumnString(0));
+    });
+}
+
 void PrivilegeDb::GetAppIdsForPkgId(const std::string &pkgId,
         std::vector<std::string> &appIds)
 {
@@ -399,4 +426,46 @@ void PrivilegeDb::GetGroups(std::vector<std::string> &groups)
     });
 }
 
+void PrivilegeDb::GetAllAppPkgIds(std::vector<std::pair<std::string, std::string>> &appPkgIds)
+{
+    try_catch<void>([&] {
+        auto command = getStatement(StmtType::EGetAllAppPkgIds);
+
+        appPkgIds.clear();
+        while (command->Step())
+            appPkgIds.emplace_back(command->GetColumnString(0),
+                command->GetColumnString(1));
+        LogDebug("Got " << appPkgIds.size() << " applications");
+    });
+}
+
+void PrivilegeDb::GetAllPrivilegeGroups(
+        std::vector<std::pair<std::string, std::string>> &privilegeGroups)
+{
+    try_catch<void>([&] {
+        auto command = getStatement(StmtType::EGetAllPrivilegeGroups);
+
+        privilegeGroups.clear();
+        while (command->Step())
+            privilegeGroups.emplace_back(command->GetColumnString(0),
+                command->GetColumnString(1));
+        LogDebug("Got " << privilegeGroups.size() << " privilege groups");
+    });
+}
+
+void PrivilegeDb::GetAllAppPrivileges(
+        std::vector<std::tuple<std::string, uid_t, std::string>> &appPrivileges)
+{
+    try_catch<void>([&] {
+        auto command = getStatement(StmtType::EGetAllAppPrivileges);
+
+        appPrivileges.clear();
+        while (command->Step())
+            appPrivileges.emplace_back(command->GetColumnString(0),
+                static_cast<uid_t>(command->GetColumnInteger(1)),
+                command->GetColumnString(2));
+        LogDebug("Got " << appPrivileges.size() << " application privileges");
+    });
+}
+
 } //namespace SecurityManager
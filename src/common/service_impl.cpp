@@ -31,6 +31,9 @@
 
 #include <cstring>
 #include <algorithm>
+#include <memory>
+#include <set>
+#include <tuple>
 
 #include <dpl/log/log.h>
 #include <tzplatform_config.h>
@@ -43,6 +46,7 @@
 #include "smack-labels.h"
 #include "security-manager.h"
 #include "zone-utils.h"
+#include "app-snapshot.h"
 
 #include "service_impl.h"
 #include "master-req.h"
@@ -54,6 +58,39 @@ static const std::string SELF_PRIVILEGE = "http://tizen.org/privilege/systemsett
 
 namespace {
 
+/* Number of applications fetched from the database at once when listing policies in pages */
+const unsigned int POLICY_APPS_CHUNK = 64;
+
+static policy_entry makeConfiguredPolicyEntry(const CynaraAdminPolicy &policy, bool forAdmin)
+{
+    policy_entry pe;
+
+    pe.appId = strcmp(policy.client, CYNARA_ADMIN_WILDCARD) ? SmackLabels::generateAppNameFromLabel(policy.client) : SECURITY_MANAGER_ANY;
+    pe.user =  strcmp(policy.user, CYNARA_ADMIN_WILDCARD) ? policy.user : SECURITY_MANAGER_ANY;
+    pe.privilege = strcmp(policy.privilege, CYNARA_ADMIN_WILDCARD) ? policy.privilege : SECURITY_MANAGER_ANY;
+    pe.currentLevel = CynaraAdmin::getInstance().convertToPolicyDescription(policy.result);
+
+    if (!forAdmin) {
+        // All policy entries in PRIVACY_MANAGER should be fully-qualified
+        pe.maxLevel = CynaraAdmin::getInstance().convertToPolicyDescription(
+            CynaraAdmin::getInstance().GetPrivilegeManagerMaxLevel(
+                policy.client, policy.user, policy.privilege));
+    } else {
+        // Cannot reliably calculate maxLavel for policies from ADMIN bucket
+        pe.maxLevel = CynaraAdmin::getInstance().convertToPolicyDescription(CYNARA_ADMIN_ALLOW);
+    }
+
+    LogDebug(
+        "[policy_entry] app: " << pe.appId
+        << " user: " << pe.user
+        << " privilege: " << pe.privilege
+        << " current: " << pe.currentLevel
+        << " max: " << pe.maxLevel
+        );
+
+    return pe;
+}
+
 static inline int validatePolicy(policy_entry &policyEntry, std::string uidStr, bool &forAdmin, CynaraAdminPolicy &cyap)
 {
     LogDebug("Authenticating and validating policy update request for user with id: " << uidStr);
@@ -121,7 +158,7 @@ static inline int validatePolicy(policy_entry &policyEntry, std::string uidStr,
 
     cyap = std::move(CynaraAdminPolicy(
         policyEntry.appId.compare(SECURITY_MANAGER_ANY) ?
-            SmackLabels::generateAppLabel(policyEntry.appId) : CYNARA_ADMIN_WILDCARD,
+            *SmackLabelCache::getInstance().get(SmackLabelCache::Kind::APP, policyEntry.appId) : CYNARA_ADMIN_WILDCARD,
         policyEntry.user,
         policyEntry.privilege,
         level,
@@ -240,6 +277,81 @@ bool ServiceImpl::installRequestAuthCheck(const app_inst_req &req, uid_t uid, st
     return true;
 }
 
+void ServiceImpl::publishAppSnapshot(void)
+{
+    try {
+        AppSnapshotWriter::publish();
+    } catch (const AppSnapshotException::Base &e) {
+        LogError("Cannot publish application snapshot: " << e.DumpToString());
+        AppSnapshotWriter::invalidate();
+    } catch (const PrivilegeDb::Exception::Base &e) {
+        LogError("Cannot read database for application snapshot: " << e.DumpToString());
+        AppSnapshotWriter::invalidate();
+    } catch (const std::bad_alloc &e) {
+        LogError("Memory allocation failed while building application snapshot: " << e.what());
+        AppSnapshotWriter::invalidate();
+    }
+}
+
+void ServiceImpl::restoreAppPolicies(void)
+{
+    try {
+        std::vector<std::tuple<std::string, uid_t, std::string>> appPrivileges;
+        PrivilegeDb::getInstance().GetAllAppPrivileges(appPrivileges);
+
+        std::set<std::tuple<std::string, std::string, std::string>> expected;
+        for (const auto &appPrivilege : appPrivileges) {
+            uid_t uid = std::get<1>(appPrivilege);
+            std::string uidStr;
+            checkGlobalUser(uid, uidStr);
+            expected.emplace(*SmackLabelCache::getInstance().get(SmackLabelCache::Kind::APP, std::get<0>(appPrivilege)),
+                uidStr, std::get<2>(appPrivilege));
+        }
+
+        std::vector<CynaraAdminPolicy> policies;
+        CynaraAdmin::getInstance().ListPolicies(CynaraAdmin::Buckets.at(Bucket::MANIFESTS),
+            CYNARA_ADMIN_ANY, CYNARA_ADMIN_ANY, CYNARA_ADMIN_ANY, policies);
+
+        CynaraAdminPolicyBatch updates;
+        const std::string &bucket = CynaraAdmin::Buckets.at(Bucket::MANIFESTS);
+        for (const auto &policy : policies) {
+            if (policy.result != CYNARA_ADMIN_ALLOW)
+                continue;
+
+            // Only host applications are managed here, skip other clients
+            try {
+                SmackLabels::generateAppNameFromLabel(policy.client);
+            } catch (const SmackException::InvalidLabel &) {
+                continue;
+            }
+
+            auto it = expected.find(std::make_tuple(std::string(policy.client),
+                std::string(policy.user), std::string(policy.privilege)));
+            if (it != expected.end())
+                expected.erase(it);
+            else
+                updates.add(policy.client, policy.user, policy.privilege,
+                    static_cast<int>(CynaraAdminPolicy::Operation::Delete), bucket);
+        }
+
+        for (const auto &policy : expected)
+            updates.add(std::get<0>(policy), std::get<1>(policy), std::get<2>(policy),
+                static_cast<int>(CynaraAdminPolicy::Operation::Allow), bucket);
+
+        LogInfo("Restoring " << updates.size() << " application policies in Cynara");
+        CynaraAdmin::getInstance().SetPolicies(updates);
+        CynaraAdmin::ClearLostPolicies();
+    } catch (const PrivilegeDb::Exception::Base &e) {
+        LogError("Cannot read database to restore application policies: " << e.DumpToString());
+    } catch (const CynaraException::Base &e) {
+        LogError("Cannot restore application policies in Cynara: " << e.DumpToString());
+    } catch (const SmackException::InvalidLabel &e) {
+        LogError("Error while generating Smack labels: " << e.DumpToString());
+    } catch (const std::bad_alloc &e) {
+        LogError("Memory allocation failed while restoring application policies: " << e.what());
+    }
+}
+
 bool ServiceImpl::getZoneId(std::string &zoneId)
 {
     if (!getZoneIdFromPid(getpid(), zoneId)) {
@@ -263,8 +375,8 @@ int ServiceImpl::appInstall(const app_inst_req &req, uid_t uid, bool isSlave)
     std::vector<std::string> pkgContents;
     std::string uidstr;
     std::string appPath;
-    std::string appLabel;
-    std::string pkgLabel;
+    SmackLabelCache::Label appLabel;
+    SmackLabelCache::Label pkgLabel;
 
     std::string zoneId;
     if (isSlave) {
@@ -294,12 +406,12 @@ int ServiceImpl::appInstall(const app_inst_req &req, uid_t uid, bool isSlave)
     try {
         std::vector<std::string> oldAppPrivileges;
 
-        appLabel = zoneSmackLabelGenerate(SmackLabels::generateAppLabel(req.appId), zoneId);
+        appLabel = SmackLabelCache::getInstance().get(SmackLabelCache::Kind::APP, req.appId, zoneId);
         /* NOTE: we don't use pkgLabel here, but generate it for pkgId validation */
-        pkgLabel = zoneSmackLabelGenerate(SmackLabels::generatePkgLabel(req.pkgId), zoneId);
+        pkgLabel = SmackLabelCache::getInstance().get(SmackLabelCache::Kind::PKG, req.pkgId, zoneId);
         LogDebug("Install parameters: appId: " << req.appId << ", pkgId: " << req.pkgId
                  << ", uidstr " << uidstr
-                 << ", app label: " << appLabel << ", pkg label: " << pkgLabel);
+                 << ", app label: " << *appLabel << ", pkg label: " << *pkgLabel);
 
         PrivilegeDb::getInstance().BeginTransaction();
         std::string pkg;
@@ -315,6 +427,7 @@ int ServiceImpl::appInstall(const app_inst_req &req, uid_t uid, bool isSlave)
         /* Get all application ids in the package to generate rules withing the package */
         PrivilegeDb::getInstance().GetAppIdsForPkgId(req.pkgId, pkgContents);
 
+        bool queuePolicy = false;
         if (isSlave) {
             int ret = MasterReq::CynaraPolicyUpdate(req.appId, uidstr, oldAppPrivileges,
                                                     req.privileges);
@@ -323,13 +436,30 @@ int ServiceImpl::appInstall(const app_inst_req &req, uid_t uid, bool isSlave)
                 LogError("Error while processing request on master: " << ret);
                 return ret;
             }
+        } else if (CynaraAdmin::getInstance().IsCoalescingUpdates() &&
+                   CynaraAdmin::getInstance().MarkPendingPolicies()) {
+            // Marker is durable before the commit, so a crash can't lose the update
+            queuePolicy = true;
         } else {
-            CynaraAdmin::getInstance().UpdateAppPolicy(appLabel, uidstr, oldAppPrivileges,
+            CynaraAdmin::getInstance().UpdateAppPolicy(*appLabel, uidstr, oldAppPrivileges,
                                                        req.privileges);
         }
 
-        PrivilegeDb::getInstance().CommitTransaction();
+        try {
+            PrivilegeDb::getInstance().CommitTransaction();
+        } catch (...) {
+            // Update won't be queued, don't keep the marker for it
+            if (queuePolicy)
+                CynaraAdmin::getInstance().ReleasePendingMark();
+            throw;
+        }
         LogDebug("Application installation commited to database");
+
+        // Coalesced Cynara updates are queued only once the change is durable in database
+        if (queuePolicy)
+            CynaraAdmin::getInstance().QueueAppPolicy(*appLabel, uidstr, oldAppPrivileges,
+                                                      req.privileges);
+        AppSnapshotWriter::markChanged();
     } catch (const PrivilegeDb::Exception::IOError &e) {
         LogError("Cannot access application database: " << e.DumpToString());
         return SECURITY_MANAGER_API_ERROR_SERVER_ERROR;
@@ -356,11 +486,19 @@ int ServiceImpl::appInstall(const app_inst_req &req, uid_t uid, bool isSlave)
             SmackLabels::setupAppBasePath(req.pkgId, appPath);
 
         // register paths
+        SmackLabeler::Stats labelStats = {0, 0, 0, 0, 0};
         for (const auto &appPath : req.appPaths) {
             const std::string &path = appPath.first;
             app_install_path_type pathType = static_cast<app_install_path_type>(appPath.second);
-            SmackLabels::setupPath(req.pkgId, path, pathType, zoneId);
+            SmackLabeler::Stats stats = SmackLabels::setupPath(req.pkgId, path, pathType, zoneId);
+            labelStats.visited += stats.visited;
+            labelStats.written += stats.written;
+            labelStats.skipped += stats.skipped;
         }
+        if (!req.appPaths.empty())
+            LogDebug("Labeled paths of appId " << req.appId << ", files visited: " <<
+                labelStats.visited << ", written: " << labelStats.written <<
+                ", skipped: " << labelStats.skipped);
 
         if (isSlave) {
             LogDebug("Requesting master to add rules for new appId: " << req.appId << " with pkgId: "
@@ -373,7 +511,12 @@ int ServiceImpl::appInstall(const app_inst_req &req, uid_t uid, bool isSlave)
         } else {
             LogDebug("Adding Smack rules for new appId: " << req.appId << " with pkgId: "
                     << req.pkgId << ". Applications in package: " << pkgContents.size());
-            SmackRules::installApplicationRules(req.appId, req.pkgId, pkgContents);
+            // Application and package rules are synced to disk together
+            SmackRulesStore::Batch rulesBatch;
+            SmackRules::Stats ruleStats =
+                SmackRules::installApplicationRules(req.appId, req.pkgId, pkgContents);
+            LogDebug("Kernel rules of appId " << req.appId << " applied: " << ruleStats.applied <<
+                    ", cleared: " << ruleStats.cleared << ", unchanged: " << ruleStats.unchanged);
         }
     } catch (const SmackException::Base &e) {
         LogError("Error while applying Smack policy for application: " << e.DumpToString());
@@ -392,7 +535,7 @@ int ServiceImpl::appInstall(const app_inst_req &req, uid_t uid, bool isSlave)
 int ServiceImpl::appUninstall(const std::string &appId, uid_t uid, bool isSlave)
 {
     std::string pkgId;
-    std::string smackLabel;
+    SmackLabelCache::Label smackLabel;
     std::vector<std::string> pkgContents;
     bool appExists = true;
     bool removePkg = false;
@@ -417,18 +560,19 @@ int ServiceImpl::appUninstall(const std::string &appId, uid_t uid, bool isSlave)
             PrivilegeDb::getInstance().RollbackTransaction();
             appExists = false;
         } else {
-            smackLabel = zoneSmackLabelGenerate(SmackLabels::generateAppLabel(appId), zoneId);
+            smackLabel = SmackLabelCache::getInstance().get(SmackLabelCache::Kind::APP, appId, zoneId);
             LogDebug("Uninstall parameters: appId: " << appId << ", pkgId: " << pkgId
-                     << ", uidstr " << uidstr << ", generated smack label: " << smackLabel);
+                     << ", uidstr " << uidstr << ", generated smack label: " << *smackLabel);
 
-            /* Before we remove the app from the database, let's fetch all apps in the package
-                that this app belongs to, this will allow us to remove all rules withing the
-                package that the app appears in */
-            PrivilegeDb::getInstance().GetAppIdsForPkgId(pkgId, pkgContents);
             PrivilegeDb::getInstance().GetAppPrivileges(appId, uid, oldAppPrivileges);
             PrivilegeDb::getInstance().UpdateAppPrivileges(appId, uid, std::vector<std::string>());
             PrivilegeDb::getInstance().RemoveApplication(appId, uid, removePkg);
+            /* After the app is removed from the database, fetch all apps remaining
+                in the package. Rules within the package are removed for the app only
+                if it is no longer installed for any user */
+            PrivilegeDb::getInstance().GetAppIdsForPkgId(pkgId, pkgContents);
 
+            bool queuePolicy = false;
             if (isSlave) {
                 int ret = MasterReq::CynaraPolicyUpdate(appId, uidstr, oldAppPrivileges,
                                                         std::vector<std::string>());
@@ -437,13 +581,27 @@ int ServiceImpl::appUninstall(const std::string &appId, uid_t uid, bool isSlave)
                     LogError("Error while processing request on master: " << ret);
                     return ret;
                 }
+            } else if (CynaraAdmin::getInstance().IsCoalescingUpdates() &&
+                       CynaraAdmin::getInstance().MarkPendingPolicies()) {
+                queuePolicy = true;
             } else {
-                CynaraAdmin::getInstance().UpdateAppPolicy(smackLabel, uidstr, oldAppPrivileges,
+                CynaraAdmin::getInstance().UpdateAppPolicy(*smackLabel, uidstr, oldAppPrivileges,
                                                            std::vector<std::string>());
             }
 
-            PrivilegeDb::getInstance().CommitTransaction();
+            try {
+                PrivilegeDb::getInstance().CommitTransaction();
+            } catch (...) {
+                if (queuePolicy)
+                    CynaraAdmin::getInstance().ReleasePendingMark();
+                throw;
+            }
             LogDebug("Application uninstallation commited to database");
+
+            if (queuePolicy)
+                CynaraAdmin::getInstance().QueueAppPolicy(*smackLabel, uidstr, oldAppPrivileges,
+                                                          std::vector<std::string>());
+            AppSnapshotWriter::markChanged();
         }
     } catch (const PrivilegeDb::Exception::IOError &e) {
         LogError("Cannot access application database: " << e.DumpToString());
@@ -468,6 +626,9 @@ int ServiceImpl::appUninstall(const std::string &appId, uid_t uid, bool isSlave)
 
     if (appExists) {
         try {
+            if (removePkg)
+                SmackLabels::removeManifests(pkgId);
+
             if (isSlave) {
                 LogDebug("Delegating Smack rules removal for deleted pkgId " << pkgId <<
                          " to master");
@@ -477,13 +638,17 @@ int ServiceImpl::appUninstall(const std::string &appId, uid_t uid, bool isSlave)
                     return ret;
                 }
             } else {
+                SmackRulesStore::Batch rulesBatch;
+                SmackRules::Stats ruleStats = {0, 0, 0};
                 if (removePkg) {
                     LogDebug("Removing Smack rules for deleted pkgId " << pkgId);
-                    SmackRules::uninstallPackageRules(pkgId);
+                    ruleStats += SmackRules::uninstallPackageRules(pkgId);
                 }
 
                 LogDebug ("Removing smack rules for deleted appId " << appId);
-                SmackRules::uninstallApplicationRules(appId, pkgId, pkgContents, zoneId);
+                ruleStats += SmackRules::uninstallApplicationRules(appId, pkgId, pkgContents, zoneId);
+                LogDebug("Kernel rules of appId " << appId << " cleared: " << ruleStats.cleared <<
+                        ", applied: " << ruleStats.applied);
             }
         } catch (const SmackException::Base &e) {
             LogError("Error while removing Smack rules for application: " << e.DumpToString());
@@ -521,6 +686,16 @@ int ServiceImpl::getPkgId(const std::string &appId, std::string &pkgId)
 
 int ServiceImpl::getAppGroups(const std::string &appId, uid_t uid, pid_t pid, bool isSlave,
         std::unordered_set<gid_t> &gids)
+{
+    std::string pkgId;
+    SmackLabelCache::Label smackLabel;
+
+    return getAppLaunchBundle(appId, uid, pid, isSlave, pkgId, smackLabel, gids);
+}
+
+int ServiceImpl::getAppLaunchBundle(const std::string &appId, uid_t uid, pid_t pid,
+        bool isSlave, std::string &pkgId, SmackLabelCache::Label &smackLabel,
+        std::unordered_set<gid_t> &gids)
 {
     // FIXME Temporary solution, see below
     std::string zoneId;
@@ -532,8 +707,6 @@ int ServiceImpl::getAppGroups(const std::string &appId, uid_t uid, pid_t pid, bo
     }
 
     try {
-        std::string pkgId;
-        std::string smackLabel;
         std::string uidStr = std::to_string(uid);
         std::string pidStr = std::to_string(pid);
 
@@ -547,8 +720,8 @@ int ServiceImpl::getAppGroups(const std::string &appId, uid_t uid, pid_t pid, bo
 
         // FIXME getAppGroups should work without generating zone-specific labels when
         //       Smack Namespaces will work
-        smackLabel = zoneSmackLabelGenerate(SmackLabels::generateAppLabel(appId), zoneId);
-        LogDebug("smack label: " << smackLabel);
+        smackLabel = SmackLabelCache::getInstance().get(SmackLabelCache::Kind::APP, appId, zoneId);
+        LogDebug("smack label: " << *smackLabel);
 
         std::vector<std::string> privileges;
         PrivilegeDb::getInstance().GetPkgPrivileges(pkgId, uid, privileges);
@@ -559,6 +732,10 @@ int ServiceImpl::getAppGroups(const std::string &appId, uid_t uid, pid_t pid, bo
         std::inplace_merge(privileges.begin(), privileges.begin() + tmp, privileges.end());
         privileges.erase(unique(privileges.begin(), privileges.end()), privileges.end());
 
+        // Application may be launched right after installation, its policy must be in Cynara
+        if (!isSlave)
+            CynaraAdmin::getInstance().FlushPendingPolicies();
+
         for (const auto &privilege : privileges) {
             std::vector<std::string> gidsTmp;
             PrivilegeDb::getInstance().GetPrivilegeGroups(privilege, gidsTmp);
@@ -566,7 +743,7 @@ int ServiceImpl::getAppGroups(const std::string &appId, uid_t uid, pid_t pid, bo
                 LogDebug("Considering privilege " << privilege << " with " <<
                     gidsTmp.size() << " groups assigned");
                 // TODO: create method in Cynara class for fetching all privileges of an application
-                if (Cynara::getInstance().check(smackLabel, privilege, uidStr, pidStr)) {
+                if (Cynara::getInstance().check(*smackLabel, privilege, uidStr, pidStr)) {
                     for_each(gidsTmp.begin(), gidsTmp.end(), [&] (std::string group) {
                         struct group *grp = getgrnam(group.c_str());
                         if (grp == NULL) {
@@ -617,6 +794,9 @@ int ServiceImpl::userAdd(uid_t uidAdded, int userType, uid_t uid, bool isSlave)
         }
     }
 
+    // Bump snapshot generation, policies of the new user are in place
+    AppSnapshotWriter::markChanged();
+
     return SECURITY_MANAGER_API_SUCCESS;
 }
 
@@ -705,6 +885,9 @@ int ServiceImpl::policyUpdate(const std::vector<policy_entry> &policyEntries, ui
             // Apply updates
         CynaraAdmin::getInstance().SetPolicies(validatedPolicies);
 
+        // Bump snapshot generation, clients may keep data derived from policies
+        AppSnapshotWriter::markChanged();
+
     } catch (const CynaraException::Base &e) {
         LogError("Error while updating Cynara rules: " << e.DumpToString());
         return SECURITY_MANAGER_API_ERROR_SERVER_ERROR;
@@ -738,7 +921,7 @@ int ServiceImpl::getConfiguredPolicy(bool forAdmin, const policy_entry &filter,
         std::vector<CynaraAdminPolicy> listOfPolicies;
 
         //convert appId to smack label
-        std::string appLabel = filter.appId.compare(SECURITY_MANAGER_ANY) ? SmackLabels::generateAppLabel(filter.appId) : CYNARA_ADMIN_ANY;
+        std::string appLabel = filter.appId.compare(SECURITY_MANAGER_ANY) ? *SmackLabelCache::getInstance().get(SmackLabelCache::Kind::APP, filter.appId) : CYNARA_ADMIN_ANY;
         std::string user = filter.user.compare(SECURITY_MANAGER_ANY) ? filter.user : CYNARA_ADMIN_ANY;
         std::string privilege = filter.privilege.compare(SECURITY_MANAGER_ANY) ? filter.privilege : CYNARA_ADMIN_ANY;
 
@@ -782,38 +965,113 @@ int ServiceImpl::getConfiguredPolicy(bool forAdmin, const policy_entry &filter,
             if (policy.result ==  CYNARA_ADMIN_BUCKET)
                 continue;
 
-            policy_entry pe;
+            policyEntries.push_back(makeConfiguredPolicyEntry(policy, forAdmin));
+        };
 
-            pe.appId = strcmp(policy.client, CYNARA_ADMIN_WILDCARD) ? SmackLabels::generateAppNameFromLabel(policy.client) : SECURITY_MANAGER_ANY;
-            pe.user =  strcmp(policy.user, CYNARA_ADMIN_WILDCARD) ? policy.user : SECURITY_MANAGER_ANY;
-            pe.privilege = strcmp(policy.privilege, CYNARA_ADMIN_WILDCARD) ? policy.privilege : pe.privilege = SECURITY_MANAGER_ANY;
-            pe.currentLevel = CynaraAdmin::getInstance().convertToPolicyDescription(policy.result);
+    } catch (const CynaraException::Base &e) {
+        LogError("Error while listing Cynara rules: " << e.DumpToString());
+        return SECURITY_MANAGER_API_ERROR_SERVER_ERROR;
+    } catch (const SmackException::InvalidLabel &e) {
+        LogError("Error while generating Smack labels: " << e.DumpToString());
+        return SECURITY_MANAGER_API_ERROR_SERVER_ERROR;
+    } catch (const std::bad_alloc &e) {
+        LogError("Memory allocation error while listing Cynara rules: " << e.what());
+        return SECURITY_MANAGER_API_ERROR_SERVER_ERROR;
+    }
 
-            if (!forAdmin) {
-                // All policy entries in PRIVACY_MANAGER should be fully-qualified
-                pe.maxLevel = CynaraAdmin::getInstance().convertToPolicyDescription(
-                    CynaraAdmin::getInstance().GetPrivilegeManagerMaxLevel(
-                        policy.client, policy.user, policy.privilege));
-            } else {
-                // Cannot reliably calculate maxLavel for policies from ADMIN bucket
-                pe.maxLevel = CynaraAdmin::getInstance().convertToPolicyDescription(CYNARA_ADMIN_ALLOW);
-            }
 
+    return SECURITY_MANAGER_API_SUCCESS;
+}
+
+int ServiceImpl::getConfiguredPolicyPage(const policy_entry &filter, uid_t uid, pid_t pid,
+    const std::string &smackLabel, std::vector<policy_entry> &policyEntries,
+    const policy_entry *after, size_t limit)
+{
+    try {
+        std::string uidStr = std::to_string(uid);
+        std::string pidStr = std::to_string(pid);
+
+        if (!Cynara::getInstance().check(smackLabel, SELF_PRIVILEGE, uidStr, pidStr) ||
+            !Cynara::getInstance().check(smackLabel, ADMIN_PRIVILEGE, uidStr, pidStr)) {
+            LogError("Not enough privilege to access admin enforced policies: " << __FUNCTION__);
+            return SECURITY_MANAGER_API_ERROR_ACCESS_DENIED;
+        };
 
-            LogDebug(
-                "[policy_entry] app: " << pe.appId
-                << " user: " << pe.user
-                << " privilege: " << pe.privilege
-                << " current: " << pe.currentLevel
-                << " max: " << pe.maxLevel
+        std::string user = filter.user.compare(SECURITY_MANAGER_ANY) ? filter.user : CYNARA_ADMIN_ANY;
+        std::string privilege = filter.privilege.compare(SECURITY_MANAGER_ANY) ? filter.privilege : CYNARA_ADMIN_ANY;
+
+        /*
+         * Cynara can't list a bucket in parts, so the ADMIN bucket is listed
+         * client by client and a page is resumed within the client of the
+         * last entry, ordered by user and privilege.
+         */
+        auto listClient = [&](const std::string &clientLabel, bool resume) {
+            if (policyEntries.size() >= limit)
+                return;
+
+            std::vector<CynaraAdminPolicy> listOfPolicies;
+            CynaraAdmin::getInstance().ListPolicies(
+                CynaraAdmin::Buckets.at(Bucket::ADMIN),
+                clientLabel,
+                user,
+                privilege,
+                listOfPolicies
                 );
 
-            policyEntries.push_back(pe);
+            std::vector<policy_entry> clientEntries;
+            for (const auto &policy : listOfPolicies) {
+                //ignore "jump to bucket" entries
+                if (policy.result == CYNARA_ADMIN_BUCKET)
+                    continue;
+                clientEntries.push_back(makeConfiguredPolicyEntry(policy, true));
+            }
+
+            std::sort(clientEntries.begin(), clientEntries.end(),
+                [](const policy_entry &a, const policy_entry &b) {
+                    return std::tie(a.user, a.privilege) < std::tie(b.user, b.privilege);
+                });
+
+            for (auto &pe : clientEntries) {
+                if (resume && std::tie(pe.user, pe.privilege) <= std::tie(after->user, after->privilege))
+                    continue;
+                if (policyEntries.size() >= limit)
+                    break;
+                policyEntries.push_back(std::move(pe));
+            }
         };
 
+        if (filter.appId.compare(SECURITY_MANAGER_ANY)) {
+            listClient(*SmackLabelCache::getInstance().get(SmackLabelCache::Kind::APP, filter.appId),
+                after && after->appId == filter.appId);
+            return SECURITY_MANAGER_API_SUCCESS;
+        }
+
+        // Wildcard client comes first, then applications in order of their identifiers
+        std::string lastAppId;
+        if (!after || !after->appId.compare(SECURITY_MANAGER_ANY)) {
+            listClient(CYNARA_ADMIN_WILDCARD, after != nullptr);
+        } else {
+            listClient(*SmackLabelCache::getInstance().get(SmackLabelCache::Kind::APP, after->appId), true);
+            lastAppId = after->appId;
+        }
+
+        std::vector<std::string> listOfApps;
+        while (policyEntries.size() < limit) {
+            PrivilegeDb::getInstance().GetApps(lastAppId, POLICY_APPS_CHUNK, listOfApps);
+            for (const std::string &appId : listOfApps)
+                listClient(*SmackLabelCache::getInstance().get(SmackLabelCache::Kind::APP, appId), false);
+
+            if (listOfApps.size() < POLICY_APPS_CHUNK)
+                break;
+            lastAppId = listOfApps.back();
+        }
+
     } catch (const CynaraException::Base &e) {
         LogError("Error while listing Cynara rules: " << e.DumpToString());
         return SECURITY_MANAGER_API_ERROR_SERVER_ERROR;
+    } catch (const PrivilegeDb::Exception::Base &e) {
+        LogError("Error while listing applications: " << e.DumpToString());
+        return SECURITY_MANAGER_API_ERROR_SERVER_ERROR;
     } catch (const SmackException::InvalidLabel &e) {
         LogError("Error while generating Smack labels: " << e.DumpToString());
         return SECURITY_MANAGER_API_ERROR_SERVER_ERROR;
@@ -822,11 +1080,11 @@ int ServiceImpl::getConfiguredPolicy(bool forAdmin, const policy_entry &filter,
         return SECURITY_MANAGER_API_ERROR_SERVER_ERROR;
     }
 
-
     return SECURITY_MANAGER_API_SUCCESS;
 }
 
-int ServiceImpl::getPolicy(const policy_entry &filter, uid_t uid, pid_t pid, const std::string &smackLabel, std::vector<policy_entry> &policyEntries)
+int ServiceImpl::getPolicy(const policy_entry &filter, uid_t uid, pid_t pid, const std::string &smackLabel,
+    std::vector<policy_entry> &policyEntries, const policy_entry *after, size_t limit)
 {
     try {
         std::string uidStr = std::to_string(uid);
@@ -844,6 +1102,16 @@ int ServiceImpl::getPolicy(const policy_entry &filter, uid_t uid, pid_t pid, con
                     << ", max: " << filter.maxLevel
                     );
 
+        uid_t afterUid = 0;
+        if (after) {
+            try {
+                afterUid = static_cast<uid_t>(std::stoul(after->user));
+            } catch (const std::logic_error &e) {
+                LogError("Invalid UID in the last entry of previous page: " << after->user);
+                return SECURITY_MANAGER_API_ERROR_BAD_REQUEST;
+            }
+        }
+
         std::vector<uid_t> listOfUsers;
 
         if (Cynara::getInstance().check(smackLabel, ADMIN_PRIVILEGE, uidStr, pidStr)) {
@@ -862,71 +1130,131 @@ int ServiceImpl::getPolicy(const policy_entry &filter, uid_t uid, pid_t pid, con
             LogDebug("Fetching personal policy for user: " << uid);
             listOfUsers.push_back(uid);
         };
+        std::sort(listOfUsers.begin(), listOfUsers.end());
         LogDebug("Fetching policy for " << listOfUsers.size() << " users");
 
-        for (const uid_t &uid : listOfUsers) {
-            LogDebug("User: " << uid);
+        /*
+         * Unless the query is narrowed down to a single entry, resolve the
+         * levels in memory instead of asking Cynara twice for every
+         * (user, app, privilege). A bounded page lists only policies of the
+         * clients and users it visits, whole buckets are listed otherwise.
+         */
+        std::unique_ptr<CynaraAdminPolicyEvaluator> evaluator;
+        if (listOfUsers.size() > 1 || !filter.appId.compare(SECURITY_MANAGER_ANY) ||
+            !filter.privilege.compare(SECURITY_MANAGER_ANY))
+            evaluator.reset(new CynaraAdminPolicyEvaluator(
+                limit == std::numeric_limits<size_t>::max() ?
+                    CynaraAdminPolicyEvaluator::Scope::WholeBuckets :
+                    CynaraAdminPolicyEvaluator::Scope::ClientAndUser));
+
+        // Privileges of the app are listed in order, the page resumes after afterPrivilege
+        auto listApp = [&](uid_t uid, const std::string &appId, const std::string *afterPrivilege) {
+            if (policyEntries.size() >= limit)
+                return;
+
+            LogDebug("App: " << appId);
             std::string userStr = std::to_string(uid);
-            std::vector<std::string> listOfApps;
+            SmackLabelCache::Label smackLabelForApp =
+                SmackLabelCache::getInstance().get(SmackLabelCache::Kind::APP, appId);
+            std::vector<std::string> listOfPrivileges;
+
+            // FIXME: also fetch privileges of global applications
+            PrivilegeDb::getInstance().GetAppPrivileges(appId, uid, listOfPrivileges);
+
+            if (filter.privilege.compare(SECURITY_MANAGER_ANY)) {
+                LogDebug("Limitting Cynara query to privilege: " << filter.privilege);
+                // FIXME: this filtering should be already performed by method fetching the privileges
+                if (std::find(listOfPrivileges.begin(), listOfPrivileges.end(),
+                    filter.privilege) == listOfPrivileges.end()) {
+                    LogDebug("Application " << appId <<
+                        " doesn't have the filteres privilege " << filter.privilege);
+                    return;
+                }
+                listOfPrivileges.clear();
+                listOfPrivileges.push_back(filter.privilege);
+            }
 
-            if (filter.appId.compare(SECURITY_MANAGER_ANY)) {
-                LogDebug("Limitting Cynara query to app: " << filter.appId);
-                listOfApps.push_back(filter.appId);
-            } else {
-                PrivilegeDb::getInstance().GetUserApps(uid, listOfApps);
-                LogDebug("Found apps: " << listOfApps.size());
-            };
+            LogDebug("Privileges matching filter - " << filter.privilege << ": " << listOfPrivileges.size());
+
+            for (const std::string &privilege : listOfPrivileges) {
+                if (afterPrivilege && privilege <= *afterPrivilege)
+                    continue;
+                if (policyEntries.size() >= limit)
+                    break;
 
-            for (const std::string &appId : listOfApps) {
-                LogDebug("App: " << appId);
-                std::string smackLabelForApp = SmackLabels::generateAppLabel(appId);
-                std::vector<std::string> listOfPrivileges;
-
-                // FIXME: also fetch privileges of global applications
-                PrivilegeDb::getInstance().GetAppPrivileges(appId, uid, listOfPrivileges);
-
-                if (filter.privilege.compare(SECURITY_MANAGER_ANY)) {
-                    LogDebug("Limitting Cynara query to privilege: " << filter.privilege);
-                    // FIXME: this filtering should be already performed by method fetching the privileges
-                    if (std::find(listOfPrivileges.begin(), listOfPrivileges.end(),
-                        filter.privilege) == listOfPrivileges.end()) {
-                        LogDebug("Application " << appId <<
-                            " doesn't have the filteres privilege " << filter.privilege);
-                        continue;
-                    }
-                    listOfPrivileges.clear();
-                    listOfPrivileges.push_back(filter.privilege);
+                LogDebug("Privilege: " << privilege);
+                policy_entry pe;
+
+                pe.appId = appId;
+                pe.user = userStr;
+                pe.privilege = privilege;
+
+                int currentLevel, maxLevel;
+                if (evaluator) {
+                    currentLevel = evaluator->GetPrivilegeManagerCurrLevel(
+                        *smackLabelForApp, userStr, privilege);
+                    maxLevel = evaluator->GetPrivilegeManagerMaxLevel(
+                        *smackLabelForApp, userStr, privilege);
+                } else {
+                    currentLevel = CynaraAdmin::getInstance().GetPrivilegeManagerCurrLevel(
+                        *smackLabelForApp, userStr, privilege);
+                    maxLevel = CynaraAdmin::getInstance().GetPrivilegeManagerMaxLevel(
+                        *smackLabelForApp, userStr, privilege);
                 }
 
-                LogDebug("Privileges matching filter - " << filter.privilege << ": " << listOfPrivileges.size());
+                pe.currentLevel = CynaraAdmin::getInstance().convertToPolicyDescription(
+                    currentLevel);
+                pe.maxLevel = CynaraAdmin::getInstance().convertToPolicyDescription(
+                    maxLevel);
+
+                LogDebug(
+                    "[policy_entry] app: " << pe.appId
+                    << " user: " << pe.user
+                    << " privilege: " << pe.privilege
+                    << " current: " << pe.currentLevel
+                    << " max: " << pe.maxLevel
+                    );
 
-                for (const std::string &privilege : listOfPrivileges) {
-                    LogDebug("Privilege: " << privilege);
-                    policy_entry pe;
+                policyEntries.push_back(pe);
+            };
+        };
 
-                    pe.appId = appId;
-                    pe.user = userStr;
-                    pe.privilege = privilege;
+        for (const uid_t &uid : listOfUsers) {
+            if (policyEntries.size() >= limit)
+                break;
+            if (after && uid < afterUid)
+                continue;
 
-                    pe.currentLevel = CynaraAdmin::getInstance().convertToPolicyDescription(
-                        CynaraAdmin::getInstance().GetPrivilegeManagerCurrLevel(
-                            smackLabelForApp, userStr, privilege));
+            LogDebug("User: " << uid);
+            bool resume = after && uid == afterUid;
 
-                    pe.maxLevel = CynaraAdmin::getInstance().convertToPolicyDescription(
-                        CynaraAdmin::getInstance().GetPrivilegeManagerMaxLevel(
-                            smackLabelForApp, userStr, privilege));
+            if (filter.appId.compare(SECURITY_MANAGER_ANY)) {
+                LogDebug("Limitting Cynara query to app: " << filter.appId);
+                if (!resume || filter.appId > after->appId)
+                    listApp(uid, filter.appId, nullptr);
+                else if (filter.appId == after->appId)
+                    listApp(uid, filter.appId, &after->privilege);
+                continue;
+            }
 
-                    LogDebug(
-                        "[policy_entry] app: " << pe.appId
-                        << " user: " << pe.user
-                        << " privilege: " << pe.privilege
-                        << " current: " << pe.currentLevel
-                        << " max: " << pe.maxLevel
-                        );
+            // Apps are fetched in chunks, so that a page doesn't list all of them
+            std::string lastAppId;
+            if (resume) {
+                listApp(uid, after->appId, &after->privilege);
+                lastAppId = after->appId;
+            }
 
-                    policyEntries.push_back(pe);
-                };
-            };
+            std::vector<std::string> listOfApps;
+            while (policyEntries.size() < limit) {
+                PrivilegeDb::getInstance().GetUserApps(uid, lastAppId, POLICY_APPS_CHUNK, listOfApps);
+                LogDebug("Found apps: " << listOfApps.size());
+                for (const std::string &appId : listOfApps)
+                    listApp(uid, appId, nullptr);
+
+                if (listOfApps.size() < POLICY_APPS_CHUNK)
+                    break;
+                lastAppId = listOfApps.back();
+            }
         };
 
     } catch (const CynaraException::Base &e) {
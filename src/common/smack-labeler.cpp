@@ -0,0 +1,845 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/**
+ * @file        smack-labeler.cpp
+ * @author      Rafal Krypa <r.krypa@samsung.com>
+ * @version     1.0
+ * @brief       Recursive Smack labeling of directory trees
+ *
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/xattr.h>
+#include <linux/xattr.h>
+#ifdef IO_URING_ENABLED
+#include <linux/io_uring.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <system_error>
+
+#include <dpl/errno_string.h>
+#include <dpl/log/log.h>
+
+#include "smack-labeler.h"
+
+namespace SecurityManager {
+
+namespace {
+
+const std::string TRANSMUTE_VALUE("TRUE");
+
+const char *const MANIFEST_MAGIC = "security-manager-labels 1";
+
+/* Smack labels are at most 255 bytes long */
+const size_t XATTR_VALUE_MAX = 256;
+
+#ifdef IO_URING_ENABLED
+/* Set after io_uring turned out to be unusable, to not try it again */
+std::atomic<bool> ioUringUnsupported(false);
+#endif
+
+} // namespace anonymous
+
+/* Writes attributes of entries for a single worker */
+class SmackLabeler::XattrWriter
+{
+public:
+    XattrWriter(SmackLabeler &labeler, unsigned self)
+        : m_labeler(labeler)
+        , m_self(self)
+    {}
+
+    virtual ~XattrWriter() {}
+
+    /**
+     * Write attributes of an entry, completion may be delayed until flush().
+     *
+     * @param[in] dirFd - directory containing the entry, or AT_FDCWD
+     * @param[in] name - name of the entry relative to dirFd
+     * @param[in] path - path of the entry
+     * @param[in] ops - attributes to write
+     * @param[in] count - number of attributes
+     * @param[in] mode - type and mode of the entry
+     */
+    virtual void write(int dirFd, const char *name, const std::string &path,
+        const XattrOp *ops, size_t count, mode_t mode) = 0;
+
+    /**
+     * Wait for all writes to complete.
+     */
+    virtual void flush() {}
+
+protected:
+    void writeSync(const std::string &path, const XattrOp *ops, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i) {
+            if (lsetxattr(path.c_str(), ops[i].name, ops[i].value->c_str(),
+                    ops[i].value->length(), 0)) {
+                m_labeler.reportError(path, std::string("lsetxattr failed on ") + path +
+                    ": " + GetErrnoString(errno));
+                return;
+            }
+        }
+
+        m_labeler.entryWritten(m_self, path);
+    }
+
+    SmackLabeler &m_labeler;
+    const unsigned m_self;
+};
+
+class SmackLabeler::SyscallXattrWriter : public SmackLabeler::XattrWriter
+{
+public:
+    SyscallXattrWriter(SmackLabeler &labeler, unsigned self)
+        : XattrWriter(labeler, self)
+    {}
+
+    virtual void write(int dirFd, const char *name, const std::string &path,
+        const XattrOp *ops, size_t count, mode_t mode)
+    {
+        (void) dirFd;
+        (void) name;
+        (void) mode;
+        writeSync(path, ops, count);
+    }
+};
+
+#ifdef IO_URING_ENABLED
+/*
+ * Attributes of an entry are submitted as a chain of linked
+ * IORING_OP_FSETXATTR requests, so that completion of the chain means that
+ * the entry is labeled. Requests are submitted in batches, one
+ * io_uring_enter() call for many entries.
+ *
+ * IORING_OP_SETXATTR resolves the path following symbolic links, so an
+ * entry swapped for a link after it was checked would be labeled through
+ * it. Entries are opened with O_NOFOLLOW relative to their directory
+ * instead and the attributes are set on the descriptor. Only regular files
+ * and directories are opened, other entries are labeled synchronously.
+ */
+class SmackLabeler::IoUringXattrWriter : public SmackLabeler::XattrWriter
+{
+public:
+    static const unsigned RING_ENTRIES = 64;
+    static const unsigned SUBMIT_BATCH = 32;
+
+    IoUringXattrWriter(SmackLabeler &labeler, unsigned self);
+    virtual ~IoUringXattrWriter();
+
+    bool isReady() const { return m_fd != -1; }
+
+    virtual void write(int dirFd, const char *name, const std::string &path,
+        const XattrOp *ops, size_t count, mode_t mode);
+    virtual void flush();
+
+private:
+    struct Slot {
+        std::string path;
+        int fd;
+        unsigned remaining;
+        bool failed;
+    };
+
+    bool setup();
+    bool probe();
+    void submit(unsigned waitNr);
+    void reap();
+    void fail(const std::string &message);
+
+    int m_fd;
+    void *m_sqRing;
+    size_t m_sqRingSize;
+    void *m_cqRing;
+    size_t m_cqRingSize;
+    struct io_uring_sqe *m_sqes;
+    size_t m_sqesSize;
+
+    unsigned *m_sqTail;
+    unsigned m_sqMask;
+    unsigned *m_sqArray;
+    unsigned *m_cqHead;
+    unsigned *m_cqTail;
+    unsigned m_cqMask;
+    struct io_uring_cqe *m_cqes;
+    unsigned m_sqEntries;
+
+    /* Queued in the ring, not passed to the kernel yet */
+    unsigned m_toSubmit;
+    /* Queued or submitted, not completed yet */
+    unsigned m_inFlight;
+    bool m_broken;
+
+    std::vector<Slot> m_slots;
+    std::vector<unsigned> m_freeSlots;
+};
+
+SmackLabeler::IoUringXattrWriter::IoUringXattrWriter(SmackLabeler &labeler, unsigned self)
+    : XattrWriter(labeler, self)
+    , m_fd(-1)
+    , m_sqRing(MAP_FAILED)
+    , m_sqRingSize(0)
+    , m_cqRing(MAP_FAILED)
+    , m_cqRingSize(0)
+    , m_sqes(static_cast<struct io_uring_sqe *>(MAP_FAILED))
+    , m_sqesSize(0)
+    , m_toSubmit(0)
+    , m_inFlight(0)
+    , m_broken(false)
+{
+    if (!setup()) {
+        if (m_fd != -1)
+            close(m_fd);
+        m_fd = -1;
+        return;
+    }
+
+    m_slots.resize(m_sqEntries);
+    for (unsigned i = m_sqEntries; i > 0; --i)
+        m_freeSlots.push_back(i - 1);
+}
+
+SmackLabeler::IoUringXattrWriter::~IoUringXattrWriter()
+{
+    if (m_sqes != MAP_FAILED)
+        munmap(m_sqes, m_sqesSize);
+    if (m_cqRing != MAP_FAILED)
+        munmap(m_cqRing, m_cqRingSize);
+    if (m_sqRing != MAP_FAILED)
+        munmap(m_sqRing, m_sqRingSize);
+    if (m_fd != -1)
+        close(m_fd);
+}
+
+bool SmackLabeler::IoUringXattrWriter::setup()
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    m_fd = syscall(__NR_io_uring_setup, RING_ENTRIES, &params);
+    if (m_fd == -1) {
+        LogDebug("io_uring_setup failed: " << GetErrnoString(errno));
+        return false;
+    }
+
+    if (!probe())
+        return false;
+
+    m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    m_sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    m_sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+    m_cqRing = mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+    m_sqes = static_cast<struct io_uring_sqe *>(mmap(nullptr, m_sqesSize,
+        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES));
+
+    if (m_sqRing == MAP_FAILED || m_cqRing == MAP_FAILED || m_sqes == MAP_FAILED) {
+        LogError("Cannot map io_uring: " << GetErrnoString(errno));
+        return false;
+    }
+
+    char *sq = static_cast<char *>(m_sqRing);
+    char *cq = static_cast<char *>(m_cqRing);
+    m_sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    m_sqMask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    m_sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    m_cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    m_cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    m_cqMask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    m_cqes = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+    m_sqEntries = params.sq_entries;
+
+    return true;
+}
+
+bool SmackLabeler::IoUringXattrWriter::probe()
+{
+    const unsigned opsCount = IORING_OP_FSETXATTR + 1;
+    std::vector<char> buffer(sizeof(struct io_uring_probe) +
+        opsCount * sizeof(struct io_uring_probe_op));
+    auto probe = reinterpret_cast<struct io_uring_probe *>(buffer.data());
+
+    if (syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_PROBE, probe, opsCount) == -1) {
+        LogDebug("io_uring probe failed: " << GetErrnoString(errno));
+        return false;
+    }
+
+    if (probe->ops_len <= IORING_OP_FSETXATTR ||
+            !(probe->ops[IORING_OP_FSETXATTR].flags & IO_URING_OP_SUPPORTED)) {
+        LogDebug("IORING_OP_FSETXATTR not supported by the kernel");
+        return false;
+    }
+
+    return true;
+}
+
+void SmackLabeler::IoUringXattrWriter::write(int dirFd, const char *name,
+    const std::string &path, const XattrOp *ops, size_t count, mode_t mode)
+{
+    // Opening devices or FIFOs may have side effects, lsetxattr() doesn't open
+    if (m_broken || !(S_ISREG(mode) || S_ISDIR(mode))) {
+        writeSync(path, ops, count);
+        return;
+    }
+
+    while (m_inFlight + count > m_sqEntries || m_freeSlots.empty()) {
+        submit(1);
+        reap();
+        if (m_broken) {
+            writeSync(path, ops, count);
+            return;
+        }
+    }
+
+    // Entry replaced by a link since it was found fails here with ELOOP
+    int fd = TEMP_FAILURE_RETRY(openat(dirFd, name,
+        O_RDONLY | O_NOFOLLOW | O_NONBLOCK | O_NOCTTY | O_CLOEXEC));
+    if (fd == -1) {
+        m_labeler.reportError(path, std::string("open failed on ") + path + ": " +
+            GetErrnoString(errno));
+        return;
+    }
+
+    unsigned slotIdx = m_freeSlots.back();
+    m_freeSlots.pop_back();
+    Slot &slot = m_slots[slotIdx];
+    slot.path = path;
+    slot.fd = fd;
+    slot.remaining = count;
+    slot.failed = false;
+
+    unsigned tail = *m_sqTail;
+    for (size_t i = 0; i < count; ++i, ++tail) {
+        unsigned idx = tail & m_sqMask;
+        struct io_uring_sqe *sqe = &m_sqes[idx];
+
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_FSETXATTR;
+        sqe->flags = (i + 1 < count) ? IOSQE_IO_LINK : 0;
+        sqe->fd = slot.fd;
+        sqe->addr = reinterpret_cast<uintptr_t>(ops[i].name);
+        sqe->addr2 = reinterpret_cast<uintptr_t>(ops[i].value->c_str());
+        sqe->len = ops[i].value->length();
+        sqe->user_data = slotIdx;
+        m_sqArray[idx] = idx;
+    }
+    __atomic_store_n(m_sqTail, tail, __ATOMIC_RELEASE);
+
+    m_toSubmit += count;
+    m_inFlight += count;
+
+    if (m_toSubmit >= SUBMIT_BATCH) {
+        submit(0);
+        reap();
+    }
+}
+
+void SmackLabeler::IoUringXattrWriter::flush()
+{
+    while (m_inFlight > 0 && !m_broken) {
+        submit(1);
+        reap();
+    }
+}
+
+void SmackLabeler::IoUringXattrWriter::submit(unsigned waitNr)
+{
+    while (true) {
+        unsigned flags = waitNr ? IORING_ENTER_GETEVENTS : 0;
+        long ret = syscall(__NR_io_uring_enter, m_fd, m_toSubmit, waitNr, flags, nullptr, 0);
+        if (ret >= 0) {
+            m_toSubmit -= ret;
+            return;
+        }
+
+        if (errno == EINTR)
+            continue;
+
+        // Out of resources, completions have to be reaped first
+        if ((errno == EAGAIN || errno == EBUSY) && m_inFlight > m_toSubmit) {
+            if (!waitNr)
+                return;
+            ret = syscall(__NR_io_uring_enter, m_fd, 0, waitNr, IORING_ENTER_GETEVENTS,
+                nullptr, 0);
+            if (ret >= 0 || errno == EINTR)
+                return;
+        }
+
+        fail("io_uring_enter failed: " + GetErrnoString(errno));
+        return;
+    }
+}
+
+void SmackLabeler::IoUringXattrWriter::reap()
+{
+    unsigned head = *m_cqHead;
+    unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+
+    for (; head != tail; ++head) {
+        const struct io_uring_cqe *cqe = &m_cqes[head & m_cqMask];
+        unsigned slotIdx = cqe->user_data;
+        Slot &slot = m_slots[slotIdx];
+
+        --m_inFlight;
+        if (cqe->res < 0) {
+            // Requests linked after the failed one are cancelled
+            if (!slot.failed && cqe->res != -ECANCELED)
+                m_labeler.reportError(slot.path, std::string("setxattr failed on ") +
+                    slot.path + ": " + GetErrnoString(-cqe->res));
+            slot.failed = true;
+        }
+
+        if (--slot.remaining == 0) {
+            close(slot.fd);
+            if (!slot.failed)
+                m_labeler.entryWritten(m_self, slot.path);
+            m_freeSlots.push_back(slotIdx);
+        }
+    }
+
+    __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+}
+
+void SmackLabeler::IoUringXattrWriter::fail(const std::string &message)
+{
+    LogError(message << ", labeling remaining files synchronously");
+    m_broken = true;
+
+    // Requests still in the ring won't be processed
+    for (unsigned i = 0; i < m_slots.size(); ++i) {
+        if (std::find(m_freeSlots.begin(), m_freeSlots.end(), i) != m_freeSlots.end())
+            continue;
+        m_labeler.reportError(m_slots[i].path, message);
+        close(m_slots[i].fd);
+    }
+}
+#endif
+
+SmackLabeler::Backend SmackLabeler::s_backend = SmackLabeler::Backend::SYSCALL;
+
+void SmackLabeler::setBackend(Backend backend)
+{
+    s_backend = backend;
+}
+
+SmackLabeler::SmackLabeler(const Attributes &attributes, unsigned maxThreads,
+        size_t parallelThreshold)
+    : m_attributes(attributes)
+    , m_maxThreads(maxThreads ? maxThreads : 1)
+    , m_parallelThreshold(parallelThreshold)
+    , m_pending(0)
+    , m_visited(0)
+    , m_written(0)
+    , m_skipped(0)
+    , m_attrReads(0)
+    , m_attrWrites(0)
+    , m_parallel(false)
+    , m_compare(true)
+    , m_errorCount(0)
+{
+    for (unsigned i = 0; i < m_maxThreads; ++i)
+        m_workers.emplace_back(new Worker);
+}
+
+SmackLabeler::~SmackLabeler()
+{
+}
+
+SmackLabeler::XattrWriter &SmackLabeler::getWriter(unsigned self)
+{
+    Worker &worker = *m_workers[self];
+    if (worker.writer)
+        return *worker.writer;
+
+#ifdef IO_URING_ENABLED
+    if (s_backend == Backend::IO_URING && !ioUringUnsupported.load()) {
+        std::unique_ptr<IoUringXattrWriter> writer(new IoUringXattrWriter(*this, self));
+        if (writer->isReady()) {
+            worker.writer = std::move(writer);
+            return *worker.writer;
+        }
+
+        LogWarning("io_uring can't be used for labeling, falling back to lsetxattr");
+        ioUringUnsupported = true;
+    }
+#endif
+
+    worker.writer.reset(new SyscallXattrWriter(*this, self));
+    return *worker.writer;
+}
+
+void SmackLabeler::flushWriter(unsigned self)
+{
+    Worker &worker = *m_workers[self];
+    if (worker.writer)
+        worker.writer->flush();
+}
+
+void SmackLabeler::label(const std::string &path)
+{
+    struct stat st;
+
+    if (lstat(path.c_str(), &st) == -1) {
+        LogError("lstat failed on " << path << ": " << GetErrnoString(errno));
+        ThrowMsg(SmackException::FileError, "lstat failed on " << path);
+    }
+
+    m_root = path;
+
+    // Reads can't save any write in a tree that wasn't labeled before
+    m_compare = !m_manifest.empty() || xattrMatches(path, XATTR_NAME_SMACK, m_attributes.label);
+
+    if (S_ISDIR(st.st_mode)) {
+        pushUnit(0, std::string(path), st);
+        run(0);
+    } else {
+        labelEntry(0, AT_FDCWD, path.c_str(), path, st);
+        flushWriter(0);
+    }
+
+    for (auto &helper : m_helpers)
+        helper.join();
+    m_helpers.clear();
+
+    LogDebug("Labeled " << path << (m_parallel.load() ? " in parallel" : "") <<
+        ", entries visited: " << m_visited.load() << ", written: " << m_written.load() <<
+        ", skipped: " << m_skipped.load() << ", attributes read: " << m_attrReads.load() <<
+        ", written: " << m_attrWrites.load());
+
+    if (!m_manifestPath.empty() && !m_errorCount)
+        saveManifest();
+
+    if (m_errorCount) {
+        LogError("Labeling " << path << " failed on " << m_errorCount << " entries, first: " <<
+            m_errorPath << ": " << m_errorMessage);
+        ThrowMsg(SmackException::FileError, m_errorMessage);
+    }
+}
+
+SmackLabeler::Stats SmackLabeler::getStats() const
+{
+    return {m_visited.load(), m_written.load(), m_skipped.load(), m_attrReads.load(),
+        m_attrWrites.load()};
+}
+
+std::string SmackLabeler::manifestHeader() const
+{
+    return std::string(MANIFEST_MAGIC) + " " + (m_attributes.transmute ? "1" : "0") + " " +
+        (m_attributes.executables ? "1" : "0") + " " + m_attributes.label;
+}
+
+void SmackLabeler::setManifest(const std::string &manifestPath)
+{
+    m_manifestPath = manifestPath;
+    m_manifest.clear();
+
+    std::ifstream file(manifestPath);
+    std::string line;
+    if (!file.is_open() || !std::getline(file, line))
+        return;
+
+    if (line != manifestHeader()) {
+        LogDebug("Labeling manifest " << manifestPath << " is outdated, ignoring it");
+        return;
+    }
+
+    while (std::getline(file, line)) {
+        const char *ptr = line.c_str();
+        char *end;
+        std::pair<ino_t, struct timespec> entry;
+
+        entry.first = strtoull(ptr, &end, 10);
+        if (*end != ' ')
+            break;
+        entry.second.tv_sec = strtoll(end + 1, &end, 10);
+        if (*end != ' ')
+            break;
+        entry.second.tv_nsec = strtol(end + 1, &end, 10);
+        if (*end != ' ')
+            break;
+
+        m_manifest[end + 1] = entry;
+    }
+
+    if (!file.eof()) {
+        LogWarning("Labeling manifest " << manifestPath << " is damaged, ignoring it");
+        m_manifest.clear();
+    }
+}
+
+void SmackLabeler::saveManifest()
+{
+    std::string tmpPath = m_manifestPath + ".tmp";
+    std::ofstream file(tmpPath, std::ofstream::trunc);
+
+    file << manifestHeader() << '\n';
+    for (const auto &worker : m_workers)
+        for (const auto &entry : worker->manifest)
+            file << entry.ino << ' ' << entry.ctime.tv_sec << ' ' << entry.ctime.tv_nsec <<
+                ' ' << entry.path << '\n';
+    file.close();
+
+    if (file.fail() || rename(tmpPath.c_str(), m_manifestPath.c_str()) == -1) {
+        LogWarning("Cannot save labeling manifest " << m_manifestPath);
+        unlink(tmpPath.c_str());
+    }
+}
+
+bool SmackLabeler::inManifest(const std::string &path, const struct stat &st) const
+{
+    if (m_manifest.empty())
+        return false;
+
+    auto it = m_manifest.find(path.substr(m_root.size()));
+    return it != m_manifest.end() && it->second.first == st.st_ino &&
+        it->second.second.tv_sec == st.st_ctim.tv_sec &&
+        it->second.second.tv_nsec == st.st_ctim.tv_nsec;
+}
+
+void SmackLabeler::run(unsigned self)
+{
+    Unit unit;
+
+    while (true) {
+        if (takeUnit(self, unit)) {
+            try {
+                processDirectory(self, unit);
+            } catch (const std::exception &e) {
+                reportError(unit.path, std::string("Unexpected error: ") + e.what());
+            } catch (const SmackException::Base &e) {
+                reportError(unit.path, e.DumpToString());
+            }
+
+            if (--m_pending == 0) {
+                std::lock_guard<std::mutex> guard(m_idleMutex);
+                m_idleCond.notify_all();
+            }
+
+            // Only the calling thread decides about going parallel
+            if (self == 0 && !m_parallel.load() && m_maxThreads > 1 &&
+                    m_visited.load() >= m_parallelThreshold && m_pending.load() > 0)
+                startHelpers();
+            continue;
+        }
+
+        if (m_pending.load() == 0) {
+            flushWriter(self);
+            return;
+        }
+
+        // Units are being processed by other workers, they may queue more
+        std::unique_lock<std::mutex> lock(m_idleMutex);
+        m_idleCond.wait_for(lock, std::chrono::milliseconds(1),
+            [this]() { return m_pending.load() == 0; });
+    }
+}
+
+void SmackLabeler::startHelpers()
+{
+    LogDebug("Starting " << m_maxThreads - 1 << " helper threads for labeling");
+    m_parallel = true;
+
+    for (unsigned i = 1; i < m_maxThreads; ++i) {
+        try {
+            m_helpers.emplace_back(&SmackLabeler::run, this, i);
+        } catch (const std::system_error &e) {
+            // Continue with threads started so far
+            LogWarning("Cannot start labeling thread: " << e.what());
+            break;
+        }
+    }
+}
+
+bool SmackLabeler::takeUnit(unsigned self, Unit &unit)
+{
+    {
+        Worker &worker = *m_workers[self];
+        std::lock_guard<std::mutex> guard(worker.mutex);
+        if (!worker.units.empty()) {
+            unit = std::move(worker.units.back());
+            worker.units.pop_back();
+            return true;
+        }
+    }
+
+    // Steal the oldest unit, likely the root of the largest remaining subtree
+    for (unsigned i = 1; i < m_maxThreads; ++i) {
+        Worker &victim = *m_workers[(self + i) % m_maxThreads];
+        std::lock_guard<std::mutex> guard(victim.mutex);
+        if (!victim.units.empty()) {
+            unit = std::move(victim.units.front());
+            victim.units.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void SmackLabeler::pushUnit(unsigned self, std::string &&path, const struct stat &st)
+{
+    ++m_pending;
+
+    Worker &worker = *m_workers[self];
+    std::lock_guard<std::mutex> guard(worker.mutex);
+    worker.units.push_back({std::move(path), st.st_dev, st.st_ino});
+}
+
+void SmackLabeler::processDirectory(unsigned self, const Unit &unit)
+{
+    const std::string &path = unit.path;
+    struct stat st;
+
+    int dirFd = TEMP_FAILURE_RETRY(open(path.c_str(),
+        O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC));
+    if (dirFd == -1) {
+        reportError(path, "open failed on " + path + ": " + GetErrnoString(errno));
+        return;
+    }
+
+    std::unique_ptr<DIR, int(*)(DIR*)> dir(fdopendir(dirFd), closedir);
+    if (!dir) {
+        reportError(path, "fdopendir failed on " + path + ": " + GetErrnoString(errno));
+        close(dirFd);
+        return;
+    }
+
+    if (fstat(dirFd, &st) == -1) {
+        reportError(path, "fstat failed on " + path + ": " + GetErrnoString(errno));
+        return;
+    }
+
+    // Any component of the path may have been replaced since it was queued
+    if (st.st_dev != unit.dev || st.st_ino != unit.ino) {
+        reportError(path, path + " was replaced during labeling");
+        return;
+    }
+    labelEntry(self, dirFd, ".", path, st);
+
+    std::string entryPath;
+    struct dirent *entry;
+    errno = 0;
+    while ((entry = readdir(dir.get())) != nullptr) {
+        if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+            continue;
+
+        entryPath.reserve(path.size() + 1 + strlen(entry->d_name));
+        entryPath.assign(path);
+        if (entryPath.empty() || entryPath.back() != '/')
+            entryPath.push_back('/');
+        entryPath.append(entry->d_name);
+
+        if (fstatat(dirFd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == -1)
+            reportError(entryPath, "fstatat failed on " + entryPath + ": " +
+                GetErrnoString(errno));
+        else if (S_ISDIR(st.st_mode))
+            pushUnit(self, std::move(entryPath), st);
+        else
+            labelEntry(self, dirFd, entry->d_name, entryPath, st);
+
+        entryPath.clear();
+        errno = 0;
+    }
+
+    if (errno != 0)
+        reportError(path, "readdir failed on " + path + ": " + GetErrnoString(errno));
+}
+
+void SmackLabeler::labelEntry(unsigned self, int dirFd, const char *name,
+    const std::string &path, const struct stat &st)
+{
+    ++m_visited;
+
+    XattrOp ops[3];
+    size_t count = 0;
+    if (!inManifest(path, st)) {
+        if (!m_compare || !xattrMatches(path, XATTR_NAME_SMACK, m_attributes.label))
+            ops[count++] = {XATTR_NAME_SMACK, &m_attributes.label};
+
+        if (m_attributes.transmute && S_ISDIR(st.st_mode) && (!m_compare ||
+                !xattrMatches(path, XATTR_NAME_SMACKTRANSMUTE, TRANSMUTE_VALUE)))
+            ops[count++] = {XATTR_NAME_SMACKTRANSMUTE, &TRANSMUTE_VALUE};
+
+        if (m_attributes.executables && S_ISREG(st.st_mode) && (st.st_mode & S_IXUSR) &&
+                (!m_compare || !xattrMatches(path, XATTR_NAME_SMACKEXEC, m_attributes.label)))
+            ops[count++] = {XATTR_NAME_SMACKEXEC, &m_attributes.label};
+    }
+
+    if (!count) {
+        ++m_skipped;
+        recordManifest(self, path, st);
+        return;
+    }
+
+    ++m_written;
+    m_attrWrites += count;
+    getWriter(self).write(dirFd, name, path, ops, count, st.st_mode);
+}
+
+void SmackLabeler::entryWritten(unsigned self, const std::string &path)
+{
+    // Writing attributes changes ctime
+    struct stat st;
+    if (!m_manifestPath.empty() && lstat(path.c_str(), &st) == 0)
+        recordManifest(self, path, st);
+}
+
+void SmackLabeler::recordManifest(unsigned self, const std::string &path,
+        const struct stat &st)
+{
+    if (m_manifestPath.empty() || path.find('\n') != std::string::npos)
+        return;
+
+    m_workers[self]->manifest.push_back({path.substr(m_root.size()), st.st_ino, st.st_ctim});
+}
+
+bool SmackLabeler::xattrMatches(const std::string &path, const char *name,
+        const std::string &value)
+{
+    char buf[XATTR_VALUE_MAX];
+
+    ++m_attrReads;
+    ssize_t len = lgetxattr(path.c_str(), name, buf, sizeof(buf));
+    return len == static_cast<ssize_t>(value.length()) &&
+        !memcmp(buf, value.c_str(), value.length());
+}
+
+void SmackLabeler::reportError(const std::string &path, const std::string &message)
+{
+    std::lock_guard<std::mutex> guard(m_errorMutex);
+
+    if (m_errorCount++ == 0 || path < m_errorPath) {
+        m_errorPath = path;
+        m_errorMessage = message;
+    }
+}
+
+} // namespace SecurityManager
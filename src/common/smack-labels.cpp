@@ -24,18 +24,24 @@
  *
  */
 
+#include <dirent.h>
+#include <unistd.h>
 #include <sys/stat.h>
 #include <sys/smack.h>
 #include <sys/xattr.h>
 #include <linux/xattr.h>
-#include <memory>
-#include <fts.h>
+#include <cstdint>
+#include <cstdio>
 #include <cstring>
+#include <memory>
 #include <string>
 
+#include <dpl/errno_string.h>
 #include <dpl/log/log.h>
+#include <tzplatform_config.h>
 
 #include "security-manager.h"
+#include "smack-labeler.h"
 #include "smack-labels.h"
 #include "zone-utils.h"
 
@@ -45,106 +51,116 @@ namespace SmackLabels {
 //! Smack label used for SECURITY_MANAGER_PATH_PUBLIC_RO paths (RO for all apps)
 const char *const LABEL_FOR_APP_PUBLIC_RO_PATH = "User::Home";
 
-typedef std::function<bool(const FTSENT*)> LabelDecisionFn;
-
-static bool labelAll(const FTSENT *ftsent __attribute__((unused)))
+static inline void pathSetSmack(const char *path, const std::string &label,
+        const char *xattr_name)
 {
-    return true;
+    if (lsetxattr(path, xattr_name, label.c_str(), label.length(), 0)) {
+        LogError("lsetxattr failed.");
+        ThrowMsg(SmackException::FileError, "lsetxattr failed.");
+    }
 }
 
-static bool labelDirs(const FTSENT *ftsent)
+static std::string manifestDir;
+
+/* FNV-1a hash, used for names of manifests so that no input ends up in a path */
+static std::string hashName(const std::string &input)
 {
-    // label only directories
-    return (S_ISDIR(ftsent->fts_statp->st_mode));
+    uint64_t hash = 14695981039346656037ULL;
+    for (char c : input) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ULL;
+    }
+
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash));
+    return name;
 }
 
-static bool labelExecs(const FTSENT *ftsent)
+/* Package identifiers like ".." are valid, so they are hashed as well */
+static std::string getManifestPkgDir(const std::string &pkgId)
 {
-    // LogDebug("Mode = " << ftsent->fts_statp->st_mode); // this could be helpfull in debugging
-    // label only regular executable files
-    return (S_ISREG(ftsent->fts_statp->st_mode) && (ftsent->fts_statp->st_mode & S_IXUSR));
+    return manifestDir + "/" + hashName(pkgId);
 }
 
-static inline void pathSetSmack(const char *path, const std::string &label,
-        const char *xattr_name)
+static std::string getManifestPath(const std::string &pkgId, const std::string &path)
 {
-    if (lsetxattr(path, xattr_name, label.c_str(), label.length(), 0)) {
-        LogError("lsetxattr failed.");
-        ThrowMsg(SmackException::FileError, "lsetxattr failed.");
+    std::string pkgDir = getManifestPkgDir(pkgId);
+    if (mkdir(pkgDir.c_str(), 0700) == -1 && errno != EEXIST) {
+        LogWarning("Cannot create " << pkgDir << ": " << GetErrnoString(errno));
+        return std::string();
     }
+
+    return pkgDir + "/" + hashName(path);
 }
 
-static void dirSetSmack(const std::string &path, const std::string &label,
-        const char *xattr_name, LabelDecisionFn fn)
+static SmackLabeler::Stats labelDir(const std::string &pkgId, const std::string &path,
+        const std::string &label, bool set_transmutable, bool set_executables)
 {
-    char *const path_argv[] = {const_cast<char *>(path.c_str()), NULL};
-    FTSENT *ftsent;
+    // Large trees are labeled by multiple threads
+    SmackLabeler labeler({label, set_transmutable, set_executables});
 
-    std::unique_ptr<FTS, std::function<void(FTS*)> > fts(
-            fts_open(path_argv, FTS_PHYSICAL | FTS_NOCHDIR, NULL),
-            fts_close);
-
-    if (!fts) {
-        LogError("fts_open failed.");
-        ThrowMsg(SmackException::FileError, "fts_open failed.");
+    if (!manifestDir.empty()) {
+        std::string manifestPath = getManifestPath(pkgId, path);
+        if (!manifestPath.empty())
+            labeler.setManifest(manifestPath);
     }
 
-    while ((ftsent = fts_read(fts.get())) != NULL) {
-        /* Check for error (FTS_ERR) or failed stat(2) (FTS_NS) */
-        if (ftsent->fts_info == FTS_ERR || ftsent->fts_info == FTS_NS) {
-            LogError("FTS_ERR error or failed stat(2) (FTS_NS)");
-            ThrowMsg(SmackException::FileError, "FTS_ERR error or failed stat(2) (FTS_NS)");
-        }
-
-        /* avoid to tag directories two times */
-        if (ftsent->fts_info == FTS_D)
-            continue;
+    labeler.label(path);
+    return labeler.getStats();
+}
 
-        if (fn(ftsent))
-            pathSetSmack(ftsent->fts_path, label, xattr_name);
+bool enableManifests()
+{
+    std::string dir = tzplatform_mkpath(TZ_SYS_DB, ".security-manager-labels");
+    if (mkdir(dir.c_str(), 0700) == -1 && errno != EEXIST) {
+        LogError("Cannot create " << dir << ": " << GetErrnoString(errno));
+        return false;
     }
 
-    /* If last call to fts_read() set errno, we need to return error. */
-    if ((errno != 0) && (ftsent == NULL)) {
-        LogError("Last errno from fts_read: " << strerror(errno));
-        ThrowMsg(SmackException::FileError, "Last errno from fts_read: " << strerror(errno));
-    }
+    manifestDir = dir;
+    return true;
 }
 
-static void labelDir(const std::string &path, const std::string &label,
-        bool set_transmutable, bool set_executables)
+void removeManifests(const std::string &pkgId)
 {
-    // setting access label on everything in given directory and below
-    dirSetSmack(path, label, XATTR_NAME_SMACK, labelAll);
+    if (manifestDir.empty())
+        return;
+
+    std::string pkgDir = getManifestPkgDir(pkgId);
+    std::unique_ptr<DIR, int(*)(DIR*)> dir(opendir(pkgDir.c_str()), closedir);
+    if (!dir)
+        return;
 
-    // setting transmute on dirs
-    if (set_transmutable)
-        dirSetSmack(path, "TRUE", XATTR_NAME_SMACKTRANSMUTE, labelDirs);
+    struct dirent *entry;
+    while ((entry = readdir(dir.get())) != nullptr)
+        if (entry->d_name[0] != '.')
+            unlinkat(dirfd(dir.get()), entry->d_name, 0);
 
-    // setting SMACK64EXEC labels
-    if (set_executables)
-        dirSetSmack(path, label, XATTR_NAME_SMACKEXEC, &labelExecs);
+    if (rmdir(pkgDir.c_str()) == -1)
+        LogWarning("Cannot remove " << pkgDir << ": " << GetErrnoString(errno));
 }
 
-void setupPath(const std::string &pkgId, const std::string &path, app_install_path_type pathType,
+SmackLabeler::Stats setupPath(const std::string &pkgId, const std::string &path, app_install_path_type pathType,
         const std::string &zoneId)
 {
-    std::string label;
+    static const SmackLabelCache::Label publicROLabel =
+        std::make_shared<const std::string>(LABEL_FOR_APP_PUBLIC_RO_PATH);
+    SmackLabelCache::Label label;
     bool label_executables, label_transmute;
 
     switch (pathType) {
     case SECURITY_MANAGER_PATH_RW:
-        label = zoneSmackLabelGenerate(generatePkgLabel(pkgId), zoneId);
+        label = SmackLabelCache::getInstance().get(SmackLabelCache::Kind::PKG, pkgId, zoneId);
         label_executables = false;
         label_transmute = true;
         break;
     case SECURITY_MANAGER_PATH_RO:
-        label = zoneSmackLabelGenerate(generatePkgROLabel(pkgId), zoneId);
+        label = SmackLabelCache::getInstance().get(SmackLabelCache::Kind::PKG_RO, pkgId, zoneId);
         label_executables = false;
         label_transmute = false;
         break;
     case SECURITY_MANAGER_PATH_PUBLIC_RO:
-        label.assign(LABEL_FOR_APP_PUBLIC_RO_PATH);
+        label = publicROLabel;
         label_executables = false;
         label_transmute = true;
         break;
@@ -152,7 +168,7 @@ void setupPath(const std::string &pkgId, const std::string &path, app_install_pa
         LogError("Path type not known.");
         Throw(SmackException::InvalidPathType);
     }
-    return labelDir(path, label, label_transmute, label_executables);
+    return labelDir(pkgId, path, *label, label_transmute, label_executables);
 }
 
 void setupAppBasePath(const std::string &pkgId, const std::string &basePath)
@@ -201,6 +217,90 @@ std::string generatePkgROLabel(const std::string &pkgId)
     return label;
 }
 
-
 } // namespace SmackLabels
+
+SmackLabelCache::SmackLabelCache(size_t capacity)
+    : m_capacity(capacity)
+    , m_stats({0, 0, 0, 0, 0})
+{
+}
+
+SmackLabelCache &SmackLabelCache::getInstance()
+{
+    static SmackLabelCache instance;
+    return instance;
+}
+
+std::string SmackLabelCache::generate(Kind kind, const std::string &id)
+{
+    switch (kind) {
+    case Kind::APP:
+        return SmackLabels::generateAppLabel(id);
+    case Kind::PKG:
+        return SmackLabels::generatePkgLabel(id);
+    case Kind::PKG_RO:
+    default:
+        return SmackLabels::generatePkgROLabel(id);
+    }
+}
+
+SmackLabelCache::Label SmackLabelCache::get(Kind kind, const std::string &id,
+    const std::string &zoneId)
+{
+    // Zone IDs and identifiers can't contain NUL
+    std::string key;
+    key.reserve(zoneId.size() + id.size() + 2);
+    key += static_cast<char>('0' + static_cast<int>(kind));
+    key += zoneId;
+    key += '\0';
+    key += id;
+
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    auto it = m_labels.find(key);
+    if (it != m_labels.end()) {
+        ++m_stats.hits;
+        return it->second;
+    }
+
+    ++m_stats.misses;
+    Label label = std::make_shared<const std::string>(
+        zoneSmackLabelGenerate(generate(kind, id), zoneId));
+
+    if (m_labels.size() >= m_capacity) {
+        m_labels.clear();
+        m_stats.bytes = 0;
+        ++m_stats.flushes;
+    }
+
+    m_stats.bytes += key.capacity() + label->capacity() +
+        sizeof(std::pair<const std::string, Label>) + sizeof(std::string) + 4 * sizeof(void *);
+    m_labels.emplace(std::move(key), label);
+    return label;
+}
+
+void SmackLabelCache::flush()
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    m_labels.clear();
+    m_stats.bytes = 0;
+    ++m_stats.flushes;
+}
+
+SmackLabelCacheStats SmackLabelCache::getStats()
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    SmackLabelCacheStats stats = m_stats;
+    stats.entries = m_labels.size();
+    return stats;
+}
+
+void SmackLabelCache::logStats()
+{
+    SmackLabelCacheStats stats = getStats();
+    LogInfo("Smack label cache: entries: " << stats.entries <<
+        ", bytes: " << stats.bytes << ", hits: " << stats.hits <<
+        ", misses: " << stats.misses << ", flushes: " << stats.flushes);
+}
+
 } // namespace SecurityManager
@@ -0,0 +1,676 @@
+/*
+ *  Copyright (c) 2015 Samsung Electronics Co., Ltd All Rights Reserved
+ *
+ *  Contact: Rafal Krypa <r.krypa@samsung.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License
+ */
+/**
+ * @file        smack-rules-store.cpp
+ * @author      Rafal Krypa <r.krypa@samsung.com>
+ * @version     1.0
+ * @brief       Persistent storage of Smack rules of applications and packages
+ *
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/smack.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include <dpl/errno_string.h>
+#include <dpl/log/log.h>
+#include <tzplatform_config.h>
+
+#include "smack-rules-store.h"
+
+namespace SecurityManager {
+
+namespace {
+
+const char *const STORE_HEADER = "security-manager-rules 1";
+
+/* "+ owner subject object permissions" - rule of the owner */
+const char RECORD_RULE = '+';
+/* "- owner" - all rules of the owner are removed */
+const char RECORD_REMOVE = '-';
+/* "." - end of transaction */
+const char RECORD_COMMIT = '.';
+
+const char *const APP_OWNER_PREFIX = "app:";
+const char *const PKG_OWNER_PREFIX = "pkg:";
+const char *const LEGACY_APP_PREFIX = "app_";
+const char *const LEGACY_PKG_PREFIX = "pkg_";
+
+/* Size of writes to smackfs, kernel consumes it page by page */
+const size_t BULK_WRITE_SIZE = 64 * 1024;
+
+/*
+ * Split line into whitespace separated fields. Returns number of fields
+ * found, or count + 1 if there are more than count.
+ */
+size_t splitFields(const std::string &line, std::string *fields, size_t count)
+{
+    static const char *const whitespace = " \t\r";
+    size_t found = 0;
+    size_t pos = line.find_first_not_of(whitespace);
+
+    while (pos != std::string::npos) {
+        if (found == count)
+            return count + 1;
+
+        size_t end = line.find_first_of(whitespace, pos);
+        fields[found++] = line.substr(pos,
+            end == std::string::npos ? std::string::npos : end - pos);
+        pos = line.find_first_not_of(whitespace, end);
+    }
+
+    return found;
+}
+
+void appendRuleRecord(std::string &out, const std::string &owner,
+    const SmackRulesStore::Rule &rule)
+{
+    out += RECORD_RULE;
+    out += ' ';
+    out += owner;
+    out += ' ';
+    out += rule.subject;
+    out += ' ';
+    out += rule.object;
+    out += ' ';
+    out += rule.permissions;
+    out += '\n';
+}
+
+void writeAll(int fd, const std::string &data, const std::string &path)
+{
+    size_t done = 0;
+
+    while (done < data.size()) {
+        ssize_t ret = TEMP_FAILURE_RETRY(write(fd, data.data() + done, data.size() - done));
+        if (ret <= 0) {
+            LogError("Failed to write " << path << ": " << GetErrnoString(errno));
+            ThrowMsg(SmackException::FileError, "Failed to write " << path);
+        }
+        done += ret;
+    }
+}
+
+/*
+ * Write newline terminated rules to smackfs load2 interface. Once a write
+ * fails, rules are written one by one to find and skip the invalid ones.
+ * Returns number of rejected rules.
+ */
+size_t writeKernelRules(int fd, const std::string &rules)
+{
+    size_t done = 0;
+    size_t rejected = 0;
+    bool single = false;
+
+    while (done < rules.size()) {
+        if (!single) {
+            ssize_t ret = TEMP_FAILURE_RETRY(write(fd, rules.data() + done, rules.size() - done));
+            if (ret > 0) {
+                done += ret;
+                continue;
+            }
+            single = true;
+        }
+
+        size_t end = rules.find('\n', done) + 1;
+        ssize_t ret = TEMP_FAILURE_RETRY(write(fd, rules.data() + done, end - done));
+        if (ret != static_cast<ssize_t>(end - done)) {
+            LogError("Cannot load Smack rule \"" << rules.substr(done, end - done - 1) <<
+                "\": " << GetErrnoString(errno));
+            ++rejected;
+        }
+        done = end;
+    }
+
+    return rejected;
+}
+
+bool sameRules(const SmackRulesStore::Rules &a, const SmackRulesStore::Rules &b)
+{
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(),
+        [](const SmackRulesStore::Rule &x, const SmackRulesStore::Rule &y) {
+            return x.subject == y.subject && x.object == y.object &&
+                x.permissions == y.permissions;
+        });
+}
+
+/* Make rename of a file in the directory durable */
+void syncDirectory(const std::string &path)
+{
+    std::string dirPath = path.substr(0, path.rfind('/'));
+    int fd = TEMP_FAILURE_RETRY(open(dirPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (fd == -1) {
+        LogWarning("Cannot open directory " << dirPath << ": " << GetErrnoString(errno));
+        return;
+    }
+
+    if (fsync(fd) == -1)
+        LogWarning("Cannot sync directory " << dirPath << ": " << GetErrnoString(errno));
+    close(fd);
+}
+
+} // namespace anonymous
+
+SmackRulesStore::Batch::Batch()
+{
+    SmackRulesStore &store = SmackRulesStore::getInstance();
+    std::lock_guard<std::mutex> guard(store.m_mutex);
+    ++store.m_batchDepth;
+}
+
+SmackRulesStore::Batch::~Batch()
+{
+    SmackRulesStore &store = SmackRulesStore::getInstance();
+    std::lock_guard<std::mutex> guard(store.m_mutex);
+    if (--store.m_batchDepth > 0)
+        return;
+
+    try {
+        store.syncFile();
+    } catch (const SmackException::Base &e) {
+        LogError("Failed to sync rules store at the end of batch");
+    }
+}
+
+SmackRulesStore::SmackRulesStore()
+    : m_loaded(false)
+    , m_fd(-1)
+    , m_records(0)
+    , m_rules(0)
+    , m_batchDepth(0)
+    , m_dirty(false)
+{
+}
+
+SmackRulesStore::~SmackRulesStore()
+{
+    if (m_fd != -1)
+        close(m_fd);
+}
+
+SmackRulesStore &SmackRulesStore::getInstance()
+{
+    static SmackRulesStore instance;
+    return instance;
+}
+
+std::string SmackRulesStore::appOwner(const std::string &appId)
+{
+    return APP_OWNER_PREFIX + appId;
+}
+
+std::string SmackRulesStore::pkgOwner(const std::string &pkgId)
+{
+    return PKG_OWNER_PREFIX + pkgId;
+}
+
+std::string SmackRulesStore::s_path;
+
+void SmackRulesStore::setPath(const std::string &path)
+{
+    s_path = path;
+}
+
+std::string SmackRulesStore::storePath()
+{
+    if (!s_path.empty())
+        return s_path;
+    return tzplatform_mkpath(TZ_SYS_SMACK, "security-manager.rules");
+}
+
+std::string SmackRulesStore::legacyPath()
+{
+    if (!s_path.empty())
+        return s_path.substr(0, s_path.rfind('/') + 1) + "accesses.d";
+    return tzplatform_mkpath(TZ_SYS_SMACK, "accesses.d");
+}
+
+size_t SmackRulesStore::countRules(const Index &index)
+{
+    size_t count = 0;
+    for (const auto &owner : index)
+        count += owner.second.size();
+    return count;
+}
+
+bool SmackRulesStore::parse(const std::string &path, Index &index, size_t &records,
+    off_t &committed)
+{
+    struct Record {
+        std::string owner;
+        bool remove;
+        Rule rule;
+    };
+
+    struct stat st;
+    if (stat(path.c_str(), &st) == -1) {
+        if (errno == ENOENT)
+            return false;
+        LogError("Cannot access rules store " << path << ": " << GetErrnoString(errno));
+        ThrowMsg(SmackException::FileError, "Cannot access rules store " << path);
+    }
+
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        LogError("Cannot open rules store: " << path);
+        ThrowMsg(SmackException::FileError, "Cannot open rules store: " << path);
+    }
+
+    std::string line;
+    if (!std::getline(file, line) || line != STORE_HEADER) {
+        LogError("Invalid header of rules store: " << path);
+        ThrowMsg(SmackException::FileError, "Invalid header of rules store: " << path);
+    }
+
+    std::vector<Record> transaction;
+    std::string fields[5];
+    off_t offset = line.size() + 1;
+    size_t pending = 0;
+
+    index.clear();
+    records = 0;
+    committed = offset;
+
+    // Line without newline at the end of file is an interrupted append
+    while (std::getline(file, line) && !file.eof()) {
+        offset += line.size() + 1;
+        ++pending;
+
+        size_t count = splitFields(line, fields, 5);
+        if (count == 1 && fields[0].size() == 1 && fields[0][0] == RECORD_COMMIT) {
+            for (auto &record : transaction) {
+                if (record.remove)
+                    index.erase(record.owner);
+                else
+                    index[record.owner].push_back(std::move(record.rule));
+            }
+            transaction.clear();
+            records += pending;
+            pending = 0;
+            committed = offset;
+        } else if (count == 2 && fields[0].size() == 1 && fields[0][0] == RECORD_REMOVE) {
+            transaction.push_back({std::move(fields[1]), true, Rule()});
+        } else if (count == 5 && fields[0].size() == 1 && fields[0][0] == RECORD_RULE) {
+            transaction.push_back({std::move(fields[1]), false,
+                {std::move(fields[2]), std::move(fields[3]), std::move(fields[4])}});
+        } else {
+            LogWarning("Skipping invalid record in " << path << ": " << line);
+        }
+    }
+
+    if (file.bad()) {
+        LogError("Error reading rules store: " << path);
+        ThrowMsg(SmackException::FileError, "Error reading rules store: " << path);
+    }
+
+    return true;
+}
+
+void SmackRulesStore::ensureLoaded()
+{
+    if (m_loaded)
+        return;
+
+    std::string path = storePath();
+    Index index;
+    size_t records;
+    off_t committed;
+
+    if (parse(path, index, records, committed)) {
+        struct stat st;
+        if (stat(path.c_str(), &st) == 0 && st.st_size > committed) {
+            LogWarning("Discarding incomplete transaction at the end of " << path);
+            if (truncate(path.c_str(), committed) == -1) {
+                LogError("Cannot truncate " << path << ": " << GetErrnoString(errno));
+                ThrowMsg(SmackException::FileError, "Cannot truncate " << path);
+            }
+        }
+
+        m_fd = TEMP_FAILURE_RETRY(open(path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC));
+        if (m_fd == -1) {
+            LogError("Cannot open rules store " << path << ": " << GetErrnoString(errno));
+            ThrowMsg(SmackException::FileError, "Cannot open rules store " << path);
+        }
+
+        m_index.swap(index);
+        m_records = records;
+        m_rules = countRules(m_index);
+        m_loaded = true;
+        LogDebug("Loaded " << m_rules << " rules of " << m_index.size() <<
+            " owners from " << path);
+        return;
+    }
+
+    std::vector<std::string> legacyFiles;
+    importLegacy(legacyFiles);
+    m_rules = countRules(m_index);
+    rewrite();
+    m_loaded = true;
+
+    for (const auto &file : legacyFiles)
+        if (unlink(file.c_str()) == -1)
+            LogWarning("Cannot remove imported rules file " << file << ": " <<
+                GetErrnoString(errno));
+
+    LogInfo("Created rules store " << path << " with " << m_rules << " rules imported from " <<
+        legacyFiles.size() << " files");
+}
+
+void SmackRulesStore::importLegacy(std::vector<std::string> &files)
+{
+    std::string dirPath = legacyPath();
+    size_t prefixLength = strlen(LEGACY_APP_PREFIX);
+
+    DIR *dir = opendir(dirPath.c_str());
+    if (dir == NULL) {
+        if (errno != ENOENT)
+            LogWarning("Cannot open " << dirPath << ": " << GetErrnoString(errno));
+        return;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        std::string name(entry->d_name);
+        std::string owner;
+
+        if (name.compare(0, prefixLength, LEGACY_APP_PREFIX) == 0)
+            owner = appOwner(name.substr(prefixLength));
+        else if (name.compare(0, prefixLength, LEGACY_PKG_PREFIX) == 0)
+            owner = pkgOwner(name.substr(prefixLength));
+        else
+            continue;
+
+        std::string path = dirPath + "/" + name;
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            LogWarning("Cannot import rules from " << path);
+            continue;
+        }
+
+        Rules rules;
+        std::string line;
+        std::string fields[3];
+        while (std::getline(file, line)) {
+            size_t count = splitFields(line, fields, 3);
+            if (count == 3)
+                rules.push_back({fields[0], fields[1], fields[2]});
+            else if (count != 0)
+                LogWarning("Skipping invalid rule in " << path << ": " << line);
+        }
+
+        if (file.bad()) {
+            LogWarning("Cannot import rules from " << path);
+            continue;
+        }
+
+        if (!rules.empty())
+            m_index[owner] = std::move(rules);
+        files.push_back(path);
+    }
+
+    closedir(dir);
+}
+
+void SmackRulesStore::rewrite()
+{
+    std::string path = storePath();
+    std::string tmpPath = path + ".tmp";
+    std::string data(STORE_HEADER);
+    data += '\n';
+
+    for (const auto &owner : m_index)
+        for (const auto &rule : owner.second)
+            appendRuleRecord(data, owner.first, rule);
+    data += RECORD_COMMIT;
+    data += '\n';
+
+    int fd = TEMP_FAILURE_RETRY(open(tmpPath.c_str(), O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0644));
+    if (fd == -1) {
+        LogError("Failed to create file " << tmpPath << ": " << GetErrnoString(errno));
+        ThrowMsg(SmackException::FileError, "Failed to create file " << tmpPath);
+    }
+
+    try {
+        writeAll(fd, data, tmpPath);
+    } catch (...) {
+        close(fd);
+        unlink(tmpPath.c_str());
+        throw;
+    }
+
+    int ret = fsync(fd);
+    if (close(fd) == -1)
+        ret = -1;
+    if (ret == -1) {
+        LogError("Failed to save " << tmpPath << ": " << GetErrnoString(errno));
+        unlink(tmpPath.c_str());
+        ThrowMsg(SmackException::FileError, "Failed to save " << tmpPath);
+    }
+
+    if (rename(tmpPath.c_str(), path.c_str()) == -1) {
+        LogError("Failed to replace " << path << ": " << GetErrnoString(errno));
+        unlink(tmpPath.c_str());
+        ThrowMsg(SmackException::FileError, "Failed to replace " << path);
+    }
+    syncDirectory(path);
+
+    if (m_fd != -1)
+        close(m_fd);
+    m_fd = TEMP_FAILURE_RETRY(open(path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC));
+    if (m_fd == -1) {
+        LogError("Cannot open rules store " << path << ": " << GetErrnoString(errno));
+        ThrowMsg(SmackException::FileError, "Cannot open rules store " << path);
+    }
+
+    m_records = m_rules + 1;
+    m_dirty = false;
+    LogDebug("Rules store " << path << " written with " << m_rules << " rules");
+}
+
+void SmackRulesStore::syncFile()
+{
+    if (!m_dirty)
+        return;
+
+    if (fdatasync(m_fd) == -1) {
+        LogError("Failed to sync rules store: " << GetErrnoString(errno));
+        ThrowMsg(SmackException::FileError, "Failed to sync rules store");
+    }
+    m_dirty = false;
+}
+
+void SmackRulesStore::commit(const std::string &owner, const Rules &rules)
+{
+    std::string path = storePath();
+    std::string data;
+
+    data += RECORD_REMOVE;
+    data += ' ';
+    data += owner;
+    data += '\n';
+    for (const auto &rule : rules)
+        appendRuleRecord(data, owner, rule);
+    data += RECORD_COMMIT;
+    data += '\n';
+
+    // Failed append must not leave partial transaction to be committed by the next one
+    off_t size = lseek(m_fd, 0, SEEK_END);
+    try {
+        writeAll(m_fd, data, path);
+    } catch (...) {
+        if (size != -1 && ftruncate(m_fd, size) == -1)
+            LogError("Cannot truncate " << path << ": " << GetErrnoString(errno));
+        throw;
+    }
+
+    auto it = m_index.find(owner);
+    if (it != m_index.end()) {
+        m_rules -= it->second.size();
+        if (rules.empty())
+            m_index.erase(it);
+        else
+            it->second = rules;
+    } else if (!rules.empty()) {
+        m_index[owner] = rules;
+    }
+    m_rules += rules.size();
+    m_records += rules.size() + 2;
+    m_dirty = true;
+
+    if (m_records > 2 * m_rules + COMPACT_THRESHOLD) {
+        LogDebug("Compacting rules store, " << m_records << " records for " << m_rules << " rules");
+        try {
+            rewrite();
+        } catch (const SmackException::Base &e) {
+            // Changes are already saved, compaction will be retried
+            LogError("Failed to compact rules store");
+        }
+    }
+
+    if (m_batchDepth == 0)
+        syncFile();
+}
+
+bool SmackRulesStore::get(const std::string &owner, Rules &rules)
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    ensureLoaded();
+
+    auto it = m_index.find(owner);
+    if (it == m_index.end()) {
+        rules.clear();
+        return false;
+    }
+
+    rules = it->second;
+    return true;
+}
+
+void SmackRulesStore::set(const std::string &owner, const Rules &rules)
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    ensureLoaded();
+
+    auto it = m_index.find(owner);
+    if (it == m_index.end() ? rules.empty() : sameRules(it->second, rules)) {
+        LogDebug("Rules of " << owner << " not changed");
+        return;
+    }
+
+    commit(owner, rules);
+}
+
+bool SmackRulesStore::remove(const std::string &owner, Rules &rules)
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    ensureLoaded();
+
+    auto it = m_index.find(owner);
+    if (it == m_index.end()) {
+        rules.clear();
+        return false;
+    }
+
+    rules = it->second;
+    commit(owner, Rules());
+    return true;
+}
+
+void SmackRulesStore::compact()
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    ensureLoaded();
+    rewrite();
+}
+
+void SmackRulesStore::sync()
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    syncFile();
+}
+
+size_t SmackRulesStore::loadToKernel()
+{
+    const char *smackfs = smack_smackfs_path();
+    if (smackfs == NULL) {
+        LogWarning("Smack filesystem is not mounted, rules not loaded");
+        return 0;
+    }
+
+    return load(std::string(smackfs) + "/load2");
+}
+
+size_t SmackRulesStore::load(const std::string &loadPath)
+{
+    std::string path = storePath();
+    Index index;
+    size_t records;
+    off_t committed;
+
+    if (!parse(path, index, records, committed)) {
+        LogInfo("No rules store " << path << ", nothing to load");
+        return 0;
+    }
+
+    int fd = TEMP_FAILURE_RETRY(open(loadPath.c_str(), O_WRONLY | O_CLOEXEC));
+    if (fd == -1) {
+        LogError("Cannot open " << loadPath << ": " << GetErrnoString(errno));
+        ThrowMsg(SmackException::FileError, "Cannot open " << loadPath);
+    }
+
+    std::string buffer;
+    buffer.reserve(BULK_WRITE_SIZE);
+    size_t loaded = 0;
+    size_t rejected = 0;
+
+    for (const auto &owner : index) {
+        for (const auto &rule : owner.second) {
+            size_t length = rule.subject.size() + rule.object.size() +
+                rule.permissions.size() + 3;
+            if (!buffer.empty() && buffer.size() + length > BULK_WRITE_SIZE) {
+                rejected += writeKernelRules(fd, buffer);
+                buffer.clear();
+            }
+
+            buffer += rule.subject;
+            buffer += ' ';
+            buffer += rule.object;
+            buffer += ' ';
+            buffer += rule.permissions;
+            buffer += '\n';
+            ++loaded;
+        }
+    }
+
+    if (!buffer.empty())
+        rejected += writeKernelRules(fd, buffer);
+
+    close(fd);
+
+    LogInfo("Loaded " << loaded - rejected << " Smack rules of " << index.size() <<
+        " owners from " << path << ", " << rejected << " rejected");
+    return loaded - rejected;
+}
+
+} // namespace SecurityManager
@@ -27,17 +27,22 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/smack.h>
+#include <sys/inotify.h>
 #include <fcntl.h>
+#include <algorithm>
 #include <fstream>
 #include <cstring>
-#include <sstream>
+#include <map>
 #include <memory>
+#include <utility>
 
+#include <dpl/errno_string.h>
 #include <dpl/log/log.h>
 #include <tzplatform_config.h>
 
 #include "smack-labels.h"
 #include "smack-rules.h"
+#include "smack-rules-store.h"
 #include "zone-utils.h"
 
 namespace SecurityManager {
@@ -47,6 +52,205 @@ const char *const SMACK_PKG_LABEL_TEMPLATE     = "~PKG~";
 const char *const APP_RULES_TEMPLATE_FILE_PATH = tzplatform_mkpath4(TZ_SYS_SHARE, "security-manager", "policy", "app-rules-template.smack");
 const char *const SMACK_APP_IN_PACKAGE_PERMS   = "rwxat";
 
+namespace {
+
+SmackRulesTemplate::Label compileLabel(const std::string &label)
+{
+    static const struct {
+        const char *text;
+        size_t length;
+        SmackRulesTemplate::Piece::Slot slot;
+    } placeholders[] = {
+        {SMACK_APP_LABEL_TEMPLATE, strlen(SMACK_APP_LABEL_TEMPLATE),
+            SmackRulesTemplate::Piece::Slot::APP_LABEL},
+        {SMACK_PKG_LABEL_TEMPLATE, strlen(SMACK_PKG_LABEL_TEMPLATE),
+            SmackRulesTemplate::Piece::Slot::PKG_LABEL},
+    };
+
+    SmackRulesTemplate::Label compiled;
+    size_t begin = 0;
+
+    for (size_t pos = 0; pos < label.size(); ++pos) {
+        for (const auto &placeholder : placeholders) {
+            if (label.compare(pos, placeholder.length, placeholder.text) != 0)
+                continue;
+
+            compiled.push_back({label.substr(begin, pos - begin), placeholder.slot});
+            pos += placeholder.length - 1;
+            begin = pos + 1;
+            break;
+        }
+    }
+
+    if (begin < label.size() || compiled.empty())
+        compiled.push_back({label.substr(begin),
+            SmackRulesTemplate::Piece::Slot::NONE});
+
+    return compiled;
+}
+
+void expandLabel(const SmackRulesTemplate::Label &label, const std::string &zonePrefix,
+    const std::string &appLabel, const std::string &pkgLabel, std::string &out)
+{
+    // Buffer is reused between rules, its capacity is retained
+    out.assign(zonePrefix);
+    for (const auto &piece : label) {
+        out.append(piece.literal);
+        switch (piece.slot) {
+        case SmackRulesTemplate::Piece::Slot::APP_LABEL:
+            out.append(appLabel);
+            break;
+        case SmackRulesTemplate::Piece::Slot::PKG_LABEL:
+            out.append(pkgLabel);
+            break;
+        case SmackRulesTemplate::Piece::Slot::NONE:
+            break;
+        }
+    }
+}
+
+} // namespace anonymous
+
+SmackRulesTemplate::SmackRulesTemplate()
+    : m_watchFd(-1)
+{
+}
+
+SmackRulesTemplate &SmackRulesTemplate::getInstance()
+{
+    static SmackRulesTemplate instance;
+    return instance;
+}
+
+std::shared_ptr<const SmackRulesTemplate::Rules> SmackRulesTemplate::compile(
+    const std::vector<std::string> &templateRules)
+{
+    static const char *const whitespace = " \t\r";
+    auto rules = std::make_shared<Rules>();
+    rules->reserve(templateRules.size());
+
+    for (const auto &line : templateRules) {
+        std::string fields[3];
+        size_t count = 0;
+        size_t pos = line.find_first_not_of(whitespace);
+
+        while (pos != std::string::npos) {
+            size_t end = line.find_first_of(whitespace, pos);
+            if (count == 3) {
+                count = 4;
+                break;
+            }
+            fields[count++] = line.substr(pos,
+                end == std::string::npos ? std::string::npos : end - pos);
+            pos = line.find_first_not_of(whitespace, end);
+        }
+
+        if (count == 0)
+            continue;
+
+        if (count != 3) {
+            LogError("Invalid rule template: " << line);
+            ThrowMsg(SmackException::FileError, "Invalid rule template: " << line);
+        }
+
+        rules->push_back({compileLabel(fields[0]), compileLabel(fields[1]),
+            std::move(fields[2])});
+    }
+
+    return rules;
+}
+
+std::shared_ptr<const SmackRulesTemplate::Rules> SmackRulesTemplate::load()
+{
+    std::vector<std::string> templateRules;
+    std::string line;
+    std::ifstream templateRulesFile(APP_RULES_TEMPLATE_FILE_PATH);
+
+    if (!templateRulesFile.is_open()) {
+        LogError("Cannot open rules template file: " << APP_RULES_TEMPLATE_FILE_PATH);
+        ThrowMsg(SmackException::FileError, "Cannot open rules template file: " << APP_RULES_TEMPLATE_FILE_PATH);
+    }
+
+    while (std::getline(templateRulesFile, line)) {
+        templateRules.push_back(line);
+    }
+
+    if (templateRulesFile.bad()) {
+        LogError("Error reading template file: " << APP_RULES_TEMPLATE_FILE_PATH);
+        ThrowMsg(SmackException::FileError, "Error reading template file: " << APP_RULES_TEMPLATE_FILE_PATH);
+    }
+
+    LogDebug("Compiled rules template: " << APP_RULES_TEMPLATE_FILE_PATH);
+    return compile(templateRules);
+}
+
+std::shared_ptr<const SmackRulesTemplate::Rules> SmackRulesTemplate::get()
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    if (m_rules)
+        return m_rules;
+
+    auto rules = load();
+    if (m_watchFd != -1)
+        m_rules = rules;
+
+    return rules;
+}
+
+int SmackRulesTemplate::StartWatching()
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    if (m_watchFd != -1)
+        return m_watchFd;
+
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd == -1) {
+        LogError("Cannot initialize inotify: " << GetErrnoString(errno));
+        return -1;
+    }
+
+    // Watch the directory, template may be replaced by rename
+    std::string path(APP_RULES_TEMPLATE_FILE_PATH);
+    std::string dir = path.substr(0, path.rfind('/'));
+    if (inotify_add_watch(fd, dir.c_str(),
+            IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE) == -1) {
+        LogError("Cannot watch " << dir << ": " << GetErrnoString(errno));
+        close(fd);
+        return -1;
+    }
+
+    m_watchFd = fd;
+    m_rules.reset();
+    return m_watchFd;
+}
+
+void SmackRulesTemplate::ProcessWatchEvents(const std::vector<unsigned char> &events)
+{
+    std::string path(APP_RULES_TEMPLATE_FILE_PATH);
+    std::string name = path.substr(path.rfind('/') + 1);
+    bool changed = false;
+
+    // Read from inotify descriptor returns whole events only
+    for (size_t pos = 0; pos + sizeof(struct inotify_event) <= events.size(); ) {
+        struct inotify_event event;
+        memcpy(&event, &events[pos], sizeof(event));
+        const char *eventName = reinterpret_cast<const char *>(&events[pos + sizeof(event)]);
+        if ((event.mask & IN_Q_OVERFLOW) ||
+                (event.len && pos + sizeof(event) + event.len <= events.size() &&
+                 name == std::string(eventName, strnlen(eventName, event.len))))
+            changed = true;
+        pos += sizeof(event) + event.len;
+    }
+
+    if (changed) {
+        LogInfo("Rules template changed: " << path);
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_rules.reset();
+    }
+}
+
 SmackRules::SmackRules()
 {
     if (smack_accesses_new(&m_handle) < 0) {
@@ -64,6 +268,18 @@ void SmackRules::add(const std::string &subject, const std::string &object,
 {
     if (smack_accesses_add(m_handle, subject.c_str(), object.c_str(), permissions.c_str()))
         ThrowMsg(SmackException::LibsmackError, "smack_accesses_add");
+    m_rules.push_back({subject, object, permissions});
+}
+
+void SmackRules::add(const SmackRulesStore::Rules &rules)
+{
+    for (const auto &rule : rules)
+        add(rule.subject, rule.object, rule.permissions);
+}
+
+const SmackRulesStore::Rules &SmackRules::getRules() const
+{
+    return m_rules;
 }
 
 void SmackRules::addModify(const std::string &subject, const std::string &object,
@@ -109,30 +325,36 @@ void SmackRules::loadFromFile(const std::string &path)
 
 void SmackRules::saveToFile(const std::string &path) const
 {
+    // Written aside and renamed, so that the file is never seen half written
+    std::string tmpPath = path + ".tmp";
     int fd;
 
-    fd = TEMP_FAILURE_RETRY(open(path.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644));
+    fd = TEMP_FAILURE_RETRY(open(tmpPath.c_str(), O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0644));
     if (fd == -1) {
-        LogError("Failed to create file: " << path);
-        ThrowMsg(SmackException::FileError, "Failed to create file: " << path);
+        LogError("Failed to create file: " << tmpPath);
+        ThrowMsg(SmackException::FileError, "Failed to create file: " << tmpPath);
     }
 
     if (smack_accesses_save(m_handle, fd)) {
-        LogError("Failed to save rules to file: " << path);
-        unlink(path.c_str());
-        ThrowMsg(SmackException::LibsmackError, "Failed to save rules to file: " << path);
+        LogError("Failed to save rules to file: " << tmpPath);
+        close(fd);
+        unlink(tmpPath.c_str());
+        ThrowMsg(SmackException::LibsmackError, "Failed to save rules to file: " << tmpPath);
     }
 
-    if (close(fd) == -1) {
-        if (errno == EIO) {
-            LogError("I/O Error occured while closing the file: " << path << ", error: " << strerror(errno));
-            unlink(path.c_str());
-            ThrowMsg(SmackException::FileError, "I/O Error occured while closing the file: " << path << ", error: " << strerror(errno));
-        } else {
-            // non critical error
-            // don't change the return code, the descriptor should be closed despite the error.
-            LogWarning("Error while closing the file: " << path << ", error: " << strerror(errno));
-        }
+    int ret = fsync(fd);
+    if (close(fd) == -1)
+        ret = -1;
+    if (ret == -1) {
+        LogError("I/O Error occured while saving the file: " << tmpPath << ", error: " << strerror(errno));
+        unlink(tmpPath.c_str());
+        ThrowMsg(SmackException::FileError, "I/O Error occured while saving the file: " << tmpPath << ", error: " << strerror(errno));
+    }
+
+    if (rename(tmpPath.c_str(), path.c_str()) == -1) {
+        LogError("Failed to rename " << tmpPath << " to " << path << ", error: " << strerror(errno));
+        unlink(tmpPath.c_str());
+        ThrowMsg(SmackException::FileError, "Failed to rename " << tmpPath << " to " << path);
     }
 }
 
@@ -140,55 +362,32 @@ void SmackRules::saveToFile(const std::string &path) const
 void SmackRules::addFromTemplateFile(const std::string &appId, const std::string &pkgId,
         const std::string &zoneId)
 {
-    std::vector<std::string> templateRules;
-    std::string line;
-    std::ifstream templateRulesFile(APP_RULES_TEMPLATE_FILE_PATH);
-
-    if (!templateRulesFile.is_open()) {
-        LogError("Cannot open rules template file: " << APP_RULES_TEMPLATE_FILE_PATH);
-        ThrowMsg(SmackException::FileError, "Cannot open rules template file: " << APP_RULES_TEMPLATE_FILE_PATH);
-    }
-
-    while (std::getline(templateRulesFile, line)) {
-        templateRules.push_back(line);
-    }
-
-    if (templateRulesFile.bad()) {
-        LogError("Error reading template file: " << APP_RULES_TEMPLATE_FILE_PATH);
-        ThrowMsg(SmackException::FileError, "Error reading template file: " << APP_RULES_TEMPLATE_FILE_PATH);
-    }
-
-    addFromTemplate(templateRules, appId, pkgId, zoneId);
+    addFromTemplate(*SmackRulesTemplate::getInstance().get(), appId, pkgId, zoneId);
 }
 
 void SmackRules::addFromTemplate(const std::vector<std::string> &templateRules,
         const std::string &appId, const std::string &pkgId, const std::string &zoneId)
 {
-    for (auto rule : templateRules) {
-        if (rule.empty())
-            continue;
-
-        std::stringstream stream(rule);
-        std::string subject, object, permissions;
-        stream >> subject >> object >> permissions;
-
-        if (stream.fail() || !stream.eof()) {
-            LogError("Invalid rule template: " << rule);
-            ThrowMsg(SmackException::FileError, "Invalid rule template: " << rule);
-        }
-
-        strReplace(subject, SMACK_APP_LABEL_TEMPLATE, SmackLabels::generateAppLabel(appId));
-        strReplace(subject, SMACK_PKG_LABEL_TEMPLATE, SmackLabels::generatePkgLabel(pkgId));
-        strReplace(object,  SMACK_APP_LABEL_TEMPLATE, SmackLabels::generateAppLabel(appId));
-        strReplace(object,  SMACK_PKG_LABEL_TEMPLATE, SmackLabels::generatePkgLabel(pkgId));
-
-        if (!zoneId.empty()) {
-            // FIXME replace with vasum calls. See zone-utils.h
-            subject = zoneSmackLabelGenerate(subject, zoneId);
-            object = zoneSmackLabelGenerate(object, zoneId);
-        }
+    addFromTemplate(*SmackRulesTemplate::compile(templateRules), appId, pkgId, zoneId);
+}
 
-        add(subject, object, permissions);
+void SmackRules::addFromTemplate(const SmackRulesTemplate::Rules &templateRules,
+        const std::string &appId, const std::string &pkgId, const std::string &zoneId)
+{
+    SmackLabelCache &labels = SmackLabelCache::getInstance();
+    const SmackLabelCache::Label appLabel = labels.get(SmackLabelCache::Kind::APP, appId);
+    const SmackLabelCache::Label pkgLabel = labels.get(SmackLabelCache::Kind::PKG, pkgId);
+    // FIXME replace with vasum calls. See zone-utils.h
+    const std::string zonePrefix = zoneSmackLabelGenerate(std::string(), zoneId);
+
+    std::string subject, object;
+    subject.reserve(zonePrefix.size() + SMACK_LABEL_LEN);
+    object.reserve(zonePrefix.size() + SMACK_LABEL_LEN);
+
+    for (const auto &rule : templateRules) {
+        expandLabel(rule.subject, zonePrefix, *appLabel, *pkgLabel, subject);
+        expandLabel(rule.object, zonePrefix, *appLabel, *pkgLabel, object);
+        add(subject, object, rule.permissions);
     }
 }
 
@@ -197,115 +396,200 @@ void SmackRules::generatePackageCrossDeps(const std::vector<std::string> &pkgCon
 {
     LogDebug ("Generating cross-package rules");
 
-    std::string subjectLabel, objectLabel;
     std::string appsInPackagePerms = SMACK_APP_IN_PACKAGE_PERMS;
+    std::vector<SmackLabelCache::Label> labels;
+
+    labels.reserve(pkgContents.size());
+    for (const auto &appId : pkgContents)
+        labels.push_back(SmackLabelCache::getInstance().get(SmackLabelCache::Kind::APP, appId, zoneId));
 
-    for (const auto &subject : pkgContents) {
-        for (const auto &object : pkgContents) {
+    for (size_t subject = 0; subject < labels.size(); ++subject) {
+        for (size_t object = 0; object < labels.size(); ++object) {
             if (object == subject)
                 continue;
 
-            subjectLabel = zoneSmackLabelGenerate(SmackLabels::generateAppLabel(subject), zoneId);
-            objectLabel = zoneSmackLabelGenerate(SmackLabels::generateAppLabel(object), zoneId);
-            LogDebug ("Trying to add rule subject: " << subjectLabel << " object: " << objectLabel << " perms: " << appsInPackagePerms);
-            add(subjectLabel, objectLabel, appsInPackagePerms);
+            LogDebug ("Trying to add rule subject: " << *labels[subject] << " object: " << *labels[object] << " perms: " << appsInPackagePerms);
+            add(*labels[subject], *labels[object], appsInPackagePerms);
         }
     }
 }
 
-std::string SmackRules::getPackageRulesFilePath(const std::string &pkgId)
+void SmackRules::generateAppCrossDeps(const std::string &appId,
+        const std::vector<std::string> &pkgContents, const std::string &zoneId)
 {
-    std::string path(tzplatform_mkpath3(TZ_SYS_SMACK, "accesses.d", ("pkg_" + pkgId).c_str()));
-    return path;
+    LogDebug ("Generating cross-package rules for appId " << appId);
+
+    std::string appsInPackagePerms = SMACK_APP_IN_PACKAGE_PERMS;
+    SmackLabelCache &labels = SmackLabelCache::getInstance();
+    SmackLabelCache::Label appLabel = labels.get(SmackLabelCache::Kind::APP, appId, zoneId);
+
+    for (const auto &other : pkgContents) {
+        if (other == appId)
+            continue;
+
+        SmackLabelCache::Label otherLabel = labels.get(SmackLabelCache::Kind::APP, other, zoneId);
+        add(*appLabel, *otherLabel, appsInPackagePerms);
+        add(*otherLabel, *appLabel, appsInPackagePerms);
+    }
 }
 
-std::string SmackRules::getApplicationRulesFilePath(const std::string &appId)
+SmackRules::Stats &SmackRules::Stats::operator+=(const Stats &other)
 {
-    std::string path(tzplatform_mkpath3(TZ_SYS_SMACK, "accesses.d", ("app_" +  appId).c_str()));
-    return path;
+    applied += other.applied;
+    cleared += other.cleared;
+    unchanged += other.unchanged;
+    return *this;
 }
 
-void SmackRules::installApplicationRules(const std::string &appId, const std::string &pkgId,
-        const std::vector<std::string> &pkgContents)
+SmackRules::Stats SmackRules::applyDiff(const SmackRulesStore::Rules &oldRules,
+        const SmackRulesStore::Rules &newRules)
 {
-    installApplicationRules(appId, pkgId, pkgContents, std::string());
+    typedef std::pair<std::string, std::string> RuleKey;
+    std::map<RuleKey, const std::string *> previous;
+    SmackRules toApply, toClear;
+    Stats stats = {0, 0, 0};
+
+    for (const auto &rule : oldRules)
+        previous[RuleKey(rule.subject, rule.object)] = &rule.permissions;
+
+    for (const auto &rule : newRules) {
+        auto it = previous.find(RuleKey(rule.subject, rule.object));
+        if (it != previous.end()) {
+            bool same = *it->second == rule.permissions;
+            previous.erase(it);
+            if (same) {
+                ++stats.unchanged;
+                continue;
+            }
+        }
+        // Kernel replaces permissions of existing rule
+        toApply.add(rule.subject, rule.object, rule.permissions);
+    }
+
+    for (const auto &rule : previous)
+        toClear.add(rule.first.first, rule.first.second, *rule.second);
+
+
+    if (smack_smackfs_path() == NULL)
+        return stats;
+
+    if (!toClear.getRules().empty()) {
+        toClear.clear();
+        stats.cleared = toClear.getRules().size();
+    }
+
+    if (!toApply.getRules().empty()) {
+        toApply.apply();
+        stats.applied = toApply.getRules().size();
+    }
+
+    return stats;
 }
 
-void SmackRules::installApplicationRules(const std::string &appId, const std::string &pkgId,
-        const std::vector<std::string> &pkgContents, const std::string &zoneId)
+SmackRules::Stats SmackRules::installApplicationRules(const std::string &appId,
+        const std::string &pkgId, const std::vector<std::string> &pkgContents)
+{
+    return installApplicationRules(appId, pkgId, pkgContents, std::string());
+}
+
+SmackRules::Stats SmackRules::installApplicationRules(const std::string &appId,
+        const std::string &pkgId, const std::vector<std::string> &pkgContents,
+        const std::string &zoneId)
 {
     SmackRules smackRules;
-    std::string appPath = getApplicationRulesFilePath(appId);
+    SmackRulesStore::Rules oldRules;
+    std::string owner = SmackRulesStore::appOwner(appId);
 
     smackRules.addFromTemplateFile(appId, pkgId, zoneId);
+    SmackRulesStore::getInstance().get(owner, oldRules);
+
+    Stats stats = applyDiff(oldRules, smackRules.getRules());
+    SmackRulesStore::getInstance().set(owner, smackRules.getRules());
+    stats += updatePackageRulesForApp(appId, pkgId, pkgContents, zoneId);
+    return stats;
+}
 
-    if (smack_smackfs_path() != NULL)
-        smackRules.apply();
+SmackRules::Stats SmackRules::updatePackageRulesForApp(const std::string &appId,
+        const std::string &pkgId, const std::vector<std::string> &pkgContents,
+        const std::string &zoneId)
+{
+    SmackRules pkgRules, appRules;
+    SmackRulesStore::Rules oldRules, oldAppRules;
+    std::string owner = SmackRulesStore::pkgOwner(pkgId);
+    SmackLabelCache::Label appLabel =
+        SmackLabelCache::getInstance().get(SmackLabelCache::Kind::APP, appId, zoneId);
+    bool installed = std::find(pkgContents.begin(), pkgContents.end(), appId) != pkgContents.end();
+
+    // Keep rules of other applications, collect old rules of this one
+    SmackRulesStore::getInstance().get(owner, oldRules);
+    for (const auto &rule : oldRules) {
+        if (rule.subject == *appLabel || rule.object == *appLabel)
+            oldAppRules.push_back(rule);
+        else
+            pkgRules.add(rule.subject, rule.object, rule.permissions);
+    }
 
-    smackRules.saveToFile(appPath);
-    updatePackageRules(pkgId, pkgContents, zoneId);
+    if (!installed && oldAppRules.empty()) {
+        LogDebug("Package rules of pkgId " << pkgId << " don't refer to appId " << appId);
+        return Stats{0, 0, 0};
+    }
+
+    if (installed) {
+        appRules.generateAppCrossDeps(appId, pkgContents, zoneId);
+        pkgRules.generateAppCrossDeps(appId, pkgContents, zoneId);
+    }
+
+    Stats stats = applyDiff(oldAppRules, appRules.getRules());
+    SmackRulesStore::getInstance().set(owner, pkgRules.getRules());
+    return stats;
 }
 
-void SmackRules::updatePackageRules(const std::string &pkgId,
+SmackRules::Stats SmackRules::updatePackageRules(const std::string &pkgId,
         const std::vector<std::string> &pkgContents, const std::string &zoneId)
 {
     SmackRules smackRules;
-    std::string pkgPath = getPackageRulesFilePath(pkgId);
+    SmackRulesStore::Rules oldRules;
+    std::string owner = SmackRulesStore::pkgOwner(pkgId);
 
     smackRules.generatePackageCrossDeps(pkgContents, zoneId);
+    SmackRulesStore::getInstance().get(owner, oldRules);
 
-    if (smack_smackfs_path() != NULL)
-        smackRules.apply();
-
-    smackRules.saveToFile(pkgPath);
+    Stats stats = applyDiff(oldRules, smackRules.getRules());
+    SmackRulesStore::getInstance().set(owner, smackRules.getRules());
+    return stats;
 }
 
-void SmackRules::uninstallPackageRules(const std::string &pkgId)
+SmackRules::Stats SmackRules::uninstallPackageRules(const std::string &pkgId)
 {
-    uninstallRules(getPackageRulesFilePath(pkgId));
+    return uninstallRules(SmackRulesStore::pkgOwner(pkgId));
 }
 
-void SmackRules::uninstallApplicationRules(const std::string &appId,
+SmackRules::Stats SmackRules::uninstallApplicationRules(const std::string &appId,
         const std::string &pkgId, std::vector<std::string> pkgContents, const std::string &zoneId)
 {
-    uninstallRules(getApplicationRulesFilePath(appId));
-    updatePackageRules(pkgId, pkgContents, zoneId);
+    Stats stats = uninstallRules(SmackRulesStore::appOwner(appId));
+    stats += updatePackageRulesForApp(appId, pkgId, pkgContents, zoneId);
+    return stats;
 }
 
-void SmackRules::uninstallRules(const std::string &path)
+SmackRules::Stats SmackRules::uninstallRules(const std::string &owner)
 {
-    if (access(path.c_str(), F_OK) == -1) {
-        if (errno == ENOENT) {
-            LogWarning("Smack rules not found in file: " << path);
-            return;
-        }
+    SmackRulesStore::Rules rules;
+    Stats stats = {0, 0, 0};
 
-        LogWarning("Cannot access smack rules path: " << path);
-        ThrowMsg(SmackException::FileError, "Cannot access smack rules path: " << path);
+    if (!SmackRulesStore::getInstance().remove(owner, rules)) {
+        LogWarning("Smack rules not found for: " << owner);
+        return stats;
     }
 
     try {
-        SmackRules rules;
-        rules.loadFromFile(path);
-        if (smack_smackfs_path())
-            rules.clear();
+        stats = applyDiff(rules, SmackRulesStore::Rules());
     } catch (const SmackException::Base &e) {
-        LogWarning("Failed to clear smack kernel rules from file: " << path);
+        LogWarning("Failed to clear smack kernel rules of: " << owner);
         // don't stop uninstallation
     }
 
-    if (unlink(path.c_str()) == -1) {
-        LogWarning("Failed to remove smack rules file: " << path);
-        ThrowMsg(SmackException::FileError, "Failed to remove smack rules file: " << path);
-    }
-}
-
-void SmackRules::strReplace(std::string &haystack, const std::string &needle,
-            const std::string &replace)
-{
-    size_t pos;
-    while ((pos = haystack.find(needle)) != std::string::npos)
-        haystack.replace(pos, needle.size(), replace);
+    return stats;
 }
 
 } // namespace SecurityManager
@@ -309,21 +309,17 @@ struct Deserialization {
     {
         int length;
         stream.Read(sizeof(length), &length);
-        char * buf = new char[length + 1];
-        stream.Read(length, buf);
-        buf[length] = 0;
-        str = std::string(buf);
-        delete[] buf;
+        str.resize(length);
+        if (length > 0)
+            stream.Read(length, &str[0]);
     }
     static void Deserialize(IStream& stream, std::string*& str)
     {
         int length;
         stream.Read(sizeof(length), &length);
-        char * buf = new char[length + 1];
-        stream.Read(length, buf);
-        buf[length] = 0;
-        str = new std::string(buf);
-        delete[] buf;
+        str = new std::string(length, '\0');
+        if (length > 0)
+            stream.Read(length, &(*str)[0]);
     }
 
     // STL templates
@@ -42,6 +42,7 @@ enum lib_retcode {
     SECURITY_MANAGER_ERROR_REQ_NOT_COMPLETE,
     SECURITY_MANAGER_ERROR_AUTHENTICATION_FAILED,
     SECURITY_MANAGER_ERROR_ACCESS_DENIED,
+    SECURITY_MANAGER_ERROR_TIMEOUT,
 };
 
 /*! \brief accesses types for application installation paths*/
@@ -91,6 +92,37 @@ typedef struct policy_update_req policy_update_req;
 struct policy_entry;
 typedef struct policy_entry policy_entry;
 
+/*! \brief iterator over policy entries fetched from the server page by page */
+struct policy_iterator;
+typedef struct policy_iterator policy_iterator;
+
+/*! \brief everything a launcher needs to prepare an application process */
+struct app_launch_bundle;
+typedef struct app_launch_bundle app_launch_bundle;
+
+/*! \brief connection to the server for requests completed asynchronously */
+struct security_manager_async;
+typedef struct security_manager_async security_manager_async;
+
+/*! \brief completion callback of asynchronous requests returning only a result
+ *
+ *  \param[in] request_id  Identifier of the completed request
+ *  \param[in] result      API return code or error code of the request
+ *  \param[in] user_data   Pointer passed with the request
+ */
+typedef void (*security_manager_async_cb)(unsigned int request_id, int result,
+        void *user_data);
+
+/*! \brief completion callback of security_manager_async_get_app_pkgid()
+ *
+ *  \param[in] request_id  Identifier of the completed request
+ *  \param[in] result      API return code or error code of the request
+ *  \param[in] pkg_id      Package id, valid only during the callback, NULL on error
+ *  \param[in] user_data   Pointer passed with the request
+ */
+typedef void (*security_manager_async_pkgid_cb)(unsigned int request_id, int result,
+        const char *pkg_id, void *user_data);
+
 /*! \brief wildcard to be used in requests to match all possible values of given field.
  *         Use it, for example when it is desired to list or apply policy change for all
  *         users or all apps for selected user.
@@ -111,6 +143,17 @@ typedef struct policy_entry policy_entry;
  */
 const char *security_manager_strerror(enum lib_retcode rc);
 
+/**
+ * Enable or disable caching of results of security_manager_get_app_pkgid(),
+ * security_manager_groups_get() and security_manager_policy_levels_get() in
+ * the calling process. Cached results are dropped whenever applications or
+ * policies change, which security-manager publishes in shared memory, so
+ * a repeated lookup costs no request. Disabled by default.
+ *
+ * \param[in] enable  Non-zero to enable the cache, zero to disable and clear it
+ */
+void security_manager_result_cache_enable(int enable);
+
 /*
  * This function is responsible for initialize app_inst_req data structure
  * It uses dynamic allocation inside and user responsibility is to call
@@ -219,6 +262,20 @@ int security_manager_get_app_pkgid(char **pkg_id, const char *app_id);
  */
 int security_manager_set_process_label_from_appid(const char *app_id);
 
+/**
+ * Variant of security_manager_set_process_label_from_appid() for callers that
+ * know which sockets must be relabeled. Only the given sockets get the label,
+ * instead of all open sockets found by scanning /proc/self/fd.
+ *
+ * \param[in] app_id            Application identifier
+ * \param[in] socket_fds        Socket descriptors to relabel
+ * \param[in] socket_fds_count  Number of socket descriptors, may be 0
+ * \return API return code or error code, SECURITY_MANAGER_ERROR_INPUT_PARAM
+ *         if any of the descriptors is not a socket
+ */
+int security_manager_set_process_label_from_appid_with_fds(const char *app_id,
+        const int *socket_fds, size_t socket_fds_count);
+
 /**
  * For given app_id and current user, calculate allowed privileges that give
  * direct access to file system resources. Then add current process to
@@ -262,6 +319,68 @@ int security_manager_drop_process_privileges(void);
  */
 int security_manager_prepare_app(const char *app_id);
 
+/**
+ * Variant of security_manager_prepare_app() relabeling only the given sockets,
+ * see security_manager_set_process_label_from_appid_with_fds().
+ *
+ * \param[in] app_id            Application identifier
+ * \param[in] socket_fds        Socket descriptors to relabel
+ * \param[in] socket_fds_count  Number of socket descriptors, may be 0
+ * \return API return code or error code
+ */
+int security_manager_prepare_app_with_fds(const char *app_id,
+        const int *socket_fds, size_t socket_fds_count);
+
+/**
+ * Get launch bundle of an application: its package id, Smack label and
+ * supplementary groups, fetched from security-manager in a single request.
+ * Groups are checked against policy of the calling user and process.
+ *
+ * \attention Developer is responsible for calling security_manager_app_launch_bundle_free()
+ *
+ * \param[in]  app_id     Application identifier
+ * \param[out] pp_bundle  Pointer to the new bundle
+ * \return API return code or error code
+ */
+int security_manager_app_launch_bundle_get(const char *app_id, app_launch_bundle **pp_bundle);
+
+/**
+ * Get package id from a launch bundle. String is owned by the bundle.
+ *
+ * \param[in]  p_bundle  Launch bundle
+ * \param[out] pkg_id    Package identifier
+ * \return API return code or error code
+ */
+int security_manager_app_launch_bundle_get_pkg_id(const app_launch_bundle *p_bundle,
+        const char **pkg_id);
+
+/**
+ * Get Smack label from a launch bundle. String is owned by the bundle.
+ *
+ * \param[in]  p_bundle  Launch bundle
+ * \param[out] label     Smack label of the application
+ * \return API return code or error code
+ */
+int security_manager_app_launch_bundle_get_label(const app_launch_bundle *p_bundle,
+        const char **label);
+
+/**
+ * Prepare security context of the current process from a launch bundle,
+ * like security_manager_prepare_app() does, but without any request to
+ * security-manager. It should be called after fork in the new process.
+ *
+ * \param[in] p_bundle  Launch bundle
+ * \return API return code or error code
+ */
+int security_manager_app_launch_bundle_apply(const app_launch_bundle *p_bundle);
+
+/**
+ * This function is used to free resources allocated for launch bundle.
+ *
+ * \param[in] p_bundle  Launch bundle
+ */
+void security_manager_app_launch_bundle_free(app_launch_bundle *p_bundle);
+
 /*
  * This function is responsible for initialization of user_req data structure.
  * It uses dynamic allocation inside and user responsibility is to call
@@ -703,6 +822,62 @@ int security_manager_get_policy(
  */
 void security_manager_policy_entries_free(policy_entry *p_entries, const size_t size);
 
+/**
+ * \brief Function starts iteration over the whole policy, with the same scope
+ *        and filtering as security_manager_get_policy(). Entries are fetched
+ *        from the server in pages of limited size, so memory usage doesn't
+ *        depend on the size of the policy.
+ *
+ * \attention Developer is responsible for calling security_manager_policy_iterator_free()
+ *            for freeing allocated resources.
+ *
+ * \param[in]  p_filter        Pointer to filter struct
+ * \param[out] pp_iter         Pointer handling allocated iterator
+ * \return API return code or error code
+ */
+int security_manager_get_policy_iterator(
+        policy_entry *p_filter,
+        policy_iterator **pp_iter);
+
+/**
+ * \brief Function starts iteration over privileges enforced by admin user,
+ *        with the same filtering as
+ *        security_manager_get_configured_policy_for_admin(). Entries are
+ *        fetched from the server in pages of limited size, listed for the
+ *        wildcard application first and then for installed applications.
+ *        Policies of applications that are not installed are not listed.
+ *
+ * \attention Developer is responsible for calling security_manager_policy_iterator_free()
+ *            for freeing allocated resources.
+ *
+ * \param[in]  p_filter        Pointer to filter struct
+ * \param[out] pp_iter         Pointer handling allocated iterator
+ * \return API return code or error code
+ */
+int security_manager_get_configured_policy_for_admin_iterator(
+        policy_entry *p_filter,
+        policy_iterator **pp_iter);
+
+/**
+ * \brief Function returns next policy entry from the iterator, fetching next
+ *        page from the server when needed.
+ *        Returned entry is owned by the iterator and stays valid until next
+ *        call of this function or until the iterator is freed.
+ *
+ * \param[in]  p_iter          Pointer to iterator
+ * \param[out] pp_entry        Pointer to next entry, set to NULL after the last one
+ * \return API return code or error code
+ */
+int security_manager_policy_iterator_next(
+        policy_iterator *p_iter,
+        policy_entry **pp_entry);
+
+/**
+ *  \brief This function is used to free resources allocated for policy iterator.
+ *  \param[in] p_iter Pointer handling allocated iterator
+ */
+void security_manager_policy_iterator_free(policy_iterator *p_iter);
+
 /**
  * This function returns array of available policy levels in form of simple
  * text descriptions. List is sorted using internal policy level value,
@@ -778,6 +953,130 @@ int security_manager_groups_get(char ***groups, size_t *groups_count);
  */
 void security_manager_groups_free(char **groups, size_t groups_count);
 
+/**
+ * \brief Create a handle for asynchronous requests to security-manager.
+ *
+ * Requests sent with the handle don't block the caller. They are written to
+ * a single connection kept open by the library, in order, and completion
+ * callbacks are called from security_manager_async_process(). The connection
+ * is opened with the first request and reopened when the server closes it.
+ * Requests which were pending when the connection broke fail with
+ * SECURITY_MANAGER_ERROR_UNKNOWN, they may or may not have been carried out.
+ *
+ * Handle is not thread safe and must not be used after fork() in the child.
+ * Asynchronous requests are not supported when the service is not running.
+ *
+ * \attention Developer is responsible for calling security_manager_async_free()
+ *
+ * \param[out] pp_async  Pointer to the new handle
+ * \return API return code or error code
+ */
+int security_manager_async_new(security_manager_async **pp_async);
+
+/**
+ * \brief Free the handle and close its connection. Callbacks of pending
+ *        requests are not called. Must not be called from a callback.
+ *
+ * \param[in] p_async  Handle to free
+ */
+void security_manager_async_free(security_manager_async *p_async);
+
+/**
+ * \brief Get descriptor to be watched for input in caller's event loop
+ *        (poll, epoll, etc.). It stays the same for the lifetime of the handle,
+ *        also when the connection is reopened. Whenever it becomes readable,
+ *        security_manager_async_process() must be called.
+ *
+ * \param[in]  p_async  Handle
+ * \param[out] fd       Descriptor to watch
+ * \return API return code or error code
+ */
+int security_manager_async_get_fd(security_manager_async *p_async, int *fd);
+
+/**
+ * \brief Send queued data, receive responses and call completion callbacks
+ *        of finished and timed out requests. Doesn't block.
+ *
+ * \param[in] p_async  Handle
+ * \return API return code or error code
+ */
+int security_manager_async_process(security_manager_async *p_async);
+
+/**
+ * \brief Cancel a pending request: its callback won't be called. The request
+ *        is already sent and may still be carried out by the server.
+ *
+ * \param[in] p_async     Handle
+ * \param[in] request_id  Identifier of the request
+ * \return API return code or error code, SECURITY_MANAGER_ERROR_INPUT_PARAM
+ *         if the request is not pending
+ */
+int security_manager_async_cancel(security_manager_async *p_async,
+        unsigned int request_id);
+
+/**
+ * \brief Asynchronous variant of security_manager_app_install().
+ *
+ * All asynchronous requests take the following common parameters:
+ * \param[in]  p_async       Handle
+ * \param[in]  timeout_ms    Time after which the callback is called with
+ *                           SECURITY_MANAGER_ERROR_TIMEOUT, negative for none
+ * \param[in]  callback      Completion callback
+ * \param[in]  user_data     Pointer passed to the callback
+ * \param[out] p_request_id  Identifier of the request, may be NULL
+ * \return API return code or error code. Callback is called only if the
+ *         request was queued successfully.
+ */
+int security_manager_async_app_install(security_manager_async *p_async,
+        const app_inst_req *p_req, int timeout_ms,
+        security_manager_async_cb callback, void *user_data,
+        unsigned int *p_request_id);
+
+/**
+ * \brief Asynchronous variant of security_manager_app_uninstall().
+ *        See security_manager_async_app_install() for common parameters.
+ */
+int security_manager_async_app_uninstall(security_manager_async *p_async,
+        const app_inst_req *p_req, int timeout_ms,
+        security_manager_async_cb callback, void *user_data,
+        unsigned int *p_request_id);
+
+/**
+ * \brief Asynchronous variant of security_manager_get_app_pkgid().
+ *        See security_manager_async_app_install() for common parameters.
+ */
+int security_manager_async_get_app_pkgid(security_manager_async *p_async,
+        const char *app_id, int timeout_ms,
+        security_manager_async_pkgid_cb callback, void *user_data,
+        unsigned int *p_request_id);
+
+/**
+ * \brief Asynchronous variant of security_manager_user_add().
+ *        See security_manager_async_app_install() for common parameters.
+ */
+int security_manager_async_user_add(security_manager_async *p_async,
+        const user_req *p_req, int timeout_ms,
+        security_manager_async_cb callback, void *user_data,
+        unsigned int *p_request_id);
+
+/**
+ * \brief Asynchronous variant of security_manager_user_delete().
+ *        See security_manager_async_app_install() for common parameters.
+ */
+int security_manager_async_user_delete(security_manager_async *p_async,
+        const user_req *p_req, int timeout_ms,
+        security_manager_async_cb callback, void *user_data,
+        unsigned int *p_request_id);
+
+/**
+ * \brief Asynchronous variant of security_manager_policy_update_send().
+ *        See security_manager_async_app_install() for common parameters.
+ */
+int security_manager_async_policy_update_send(security_manager_async *p_async,
+        policy_update_req *p_req, int timeout_ms,
+        security_manager_async_cb callback, void *user_data,
+        unsigned int *p_request_id);
+
 #ifdef __cplusplus
 }
 #endif
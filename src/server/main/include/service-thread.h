@@ -26,6 +26,8 @@
 #define _SECURITY_MANAGER_SERVICE_THREAD_
 
 #include <cassert>
+#include <chrono>
+#include <functional>
 #include <queue>
 #include <mutex>
 #include <thread>
@@ -117,6 +119,21 @@ public:
         m_waitCondition.notify_one();
     }
 
+    /*
+     * Run task in the service thread once delay passes. Only one task can
+     * wait at a time and it is not replaced by later calls, so work requested
+     * by a burst of events is done once, at most delay after the first one.
+     */
+    void Defer(const std::function<void()> &task, std::chrono::milliseconds delay)
+    {
+        std::lock_guard<std::mutex> lock(m_eventQueueMutex);
+        if (m_deferredTask)
+            return;
+        m_deferredTask = task;
+        m_deferredTime = std::chrono::steady_clock::now() + delay;
+        m_waitCondition.notify_one();
+    }
+
 protected:
 
     struct EventDescription {
@@ -140,18 +157,31 @@ protected:
     void ThreadLoop(){
         for (;;) {
             EventDescription description = {NULL, NULL, NULL, NULL};
+            std::function<void()> deferredTask;
             {
                 std::unique_lock<std::mutex> ulock(m_eventQueueMutex);
                 if (m_quit)
                     return;
-                if (!m_eventQueue.empty()) {
+                if (m_deferredTask && std::chrono::steady_clock::now() >= m_deferredTime) {
+                    deferredTask.swap(m_deferredTask);
+                } else if (!m_eventQueue.empty()) {
                     description = m_eventQueue.front();
                     m_eventQueue.pop();
+                } else if (m_deferredTask) {
+                    m_waitCondition.wait_until(ulock, m_deferredTime);
                 } else {
                     m_waitCondition.wait(ulock);
                 }
             }
 
+            if (deferredTask) {
+                UNHANDLED_EXCEPTION_HANDLER_BEGIN
+                {
+                    deferredTask();
+                }
+                UNHANDLED_EXCEPTION_HANDLER_END
+            }
+
             if (description.eventPtr != NULL) {
                 UNHANDLED_EXCEPTION_HANDLER_BEGIN
                 {
@@ -167,6 +197,8 @@ protected:
     std::mutex m_eventQueueMutex;
     std::queue<EventDescription> m_eventQueue;
     std::condition_variable m_waitCondition;
+    std::function<void()> m_deferredTask;
+    std::chrono::steady_clock::time_point m_deferredTime;
 
     State m_state;
     bool m_quit;
@@ -25,6 +25,7 @@
 #ifndef _SECURITY_MANAGER_SOCKET_MANAGER_
 #define _SECURITY_MANAGER_SOCKET_MANAGER_
 
+#include <functional>
 #include <vector>
 #include <queue>
 #include <string>
@@ -50,6 +51,13 @@ public:
     virtual void MainLoopStop();
 
     virtual void RegisterSocketService(GenericSocketService *service);
+
+    /**
+     * Watch a descriptor that isn't a socket (e.g. timerfd or inotify) and
+     * call handler with data read from it whenever it becomes readable.
+     * SocketManager takes ownership of the descriptor.
+     */
+    void RegisterDescriptor(int fd, const std::function<void(const RawBuffer &)> &handler);
     virtual void Close(ConnectionID connectionID);
     virtual void Write(ConnectionID connectionID, const RawBuffer &rawBuffer);
     virtual void Write(ConnectionID connectionID, const SendMsgData &sendMsgData);
@@ -34,6 +34,12 @@
 #include <socket-manager.h>
 #include <file-lock.h>
 
+#include <cynara.h>
+#ifdef BUILD_TYPE_DEBUG
+#include <cynara-local-backend.h>
+#endif
+#include <smack-labels.h>
+#include <smack-rules.h>
 #include <service.h>
 #include <master-service.h>
 
@@ -79,13 +85,35 @@ int main(int argc, char* argv[])
 
         // parse arguments
         bool masterMode = false, slaveMode = false;
+        unsigned int cynaraUpdateWindow = 0;
+#ifdef BUILD_TYPE_DEBUG
+        unsigned int localCynaraLatency = 0, localCynaraJitter = 0;
+#endif
+        std::string labelBackend;
         po::options_description optDesc("Allowed options");
 
         optDesc.add_options()
         ("help,h", "Print this help message")
         ("master,m", "Enable master mode")
         ("slave,s", "Enable slave mode")
+        ("cynara-update-window", po::value<unsigned int>(&cynaraUpdateWindow),
+            "Coalesce Cynara policy updates of application installations "
+            "within given number of milliseconds (0 disables)")
+        ("label-backend", po::value<std::string>(&labelBackend),
+            "Write Smack labels of application files with \"syscall\" (default) or "
+            "\"io_uring\" (if supported)")
+        ("label-manifests", "Remember labeled application files to skip them on reinstallation")
         ;
+#ifdef BUILD_TYPE_DEBUG
+        optDesc.add_options()
+        ("local-cynara", "Keep policies in memory instead of using Cynara service")
+        ("local-cynara-latency", po::value<unsigned int>(&localCynaraLatency),
+            "Delay each call to in-memory policies by given number of microseconds")
+        ("local-cynara-jitter", po::value<unsigned int>(&localCynaraJitter),
+            "Add random delay of up to given number of microseconds to each call "
+            "to in-memory policies")
+        ;
+#endif
 
         po::variables_map vm;
         po::basic_parsed_options<char> parsed =
@@ -123,6 +151,38 @@ int main(int argc, char* argv[])
             return EXIT_FAILURE;
         }
 
+        if (cynaraUpdateWindow && (masterMode || slaveMode)) {
+            LogWarning("Coalescing of Cynara updates is supported only in standalone mode");
+            cynaraUpdateWindow = 0;
+        }
+        SecurityManager::CynaraAdmin::setUpdateWindow(cynaraUpdateWindow);
+
+        if (labelBackend == "syscall") {
+            SecurityManager::SmackLabeler::setBackend(
+                SecurityManager::SmackLabeler::Backend::SYSCALL);
+        } else if (labelBackend == "io_uring") {
+            SecurityManager::SmackLabeler::setBackend(
+                SecurityManager::SmackLabeler::Backend::IO_URING);
+        } else if (!labelBackend.empty()) {
+            std::cerr << "Unknown labeling backend: " << labelBackend << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        if (vm.count("label-manifests") && !SecurityManager::SmackLabels::enableManifests())
+            LogError("Labeling manifests disabled");
+
+#ifdef BUILD_TYPE_DEBUG
+        if (vm.count("local-cynara")) {
+            LogWarning("Using in-memory policies instead of Cynara service");
+            auto backend = std::make_shared<SecurityManager::CynaraLocalBackend>();
+            backend->setupDefaultBuckets();
+            backend->setLatency(std::chrono::microseconds(localCynaraLatency),
+                std::chrono::microseconds(localCynaraJitter));
+            SecurityManager::CynaraAdmin::setBackend(backend);
+            SecurityManager::Cynara::setBackend(backend);
+        }
+#endif
+
         SecurityManager::FileLocker serviceLock(SecurityManager::SERVICE_LOCK_FILE,
                                                 true);
 
@@ -150,9 +210,45 @@ int main(int argc, char* argv[])
                 LogError("Unable to create socket service. Exiting.");
                 return EXIT_FAILURE;
             }
+
+            if (cynaraUpdateWindow) {
+                int timerFd = SecurityManager::CynaraAdmin::getInstance().GetUpdateTimerDescriptor();
+                if (timerFd != -1)
+                    manager.RegisterDescriptor(timerFd, [](const SecurityManager::RawBuffer &) {
+                        SecurityManager::CynaraAdmin::getInstance().FlushPendingPolicies();
+                    });
+            }
+        }
+
+        auto &decisionCache = SecurityManager::CynaraDecisionCache::getInstance();
+        int cynaraWatchFd = decisionCache.StartWatching();
+        if (cynaraWatchFd != -1)
+            manager.RegisterDescriptor(cynaraWatchFd,
+                [&decisionCache](const SecurityManager::RawBuffer &events) {
+                    decisionCache.ProcessWatchEvents(events);
+                });
+
+        if (!slaveMode) {
+            auto &rulesTemplate = SecurityManager::SmackRulesTemplate::getInstance();
+            int watchFd = rulesTemplate.StartWatching();
+            if (watchFd != -1)
+                manager.RegisterDescriptor(watchFd,
+                    [&rulesTemplate](const SecurityManager::RawBuffer &events) {
+                        rulesTemplate.ProcessWatchEvents(events);
+                    });
+
+            try {
+                rulesTemplate.get();
+            } catch (const SecurityManager::SmackException::Base &e) {
+                LogError("Cannot compile Smack rules template, will retry on install");
+            }
         }
 
         manager.MainLoop();
+
+        // Send queued updates while the timer descriptor is still open
+        if (cynaraUpdateWindow)
+            SecurityManager::CynaraAdmin::getInstance().FlushPendingPolicies();
     } catch (const SecurityManager::FileLocker::Exception::Base &e) {
         LogError("Unable to get a file lock. Exiting.");
         return EXIT_FAILURE;
@@ -22,6 +22,7 @@
  * @brief       Implementation of SocketManager.
  */
 
+#include <functional>
 #include <set>
 
 #include <signal.h>
@@ -43,7 +44,9 @@
 #include <dpl/log/log.h>
 #include <dpl/assert.h>
 
+#include <cynara.h>
 #include <smack-check.h>
+#include <smack-labels.h>
 #include <socket-manager.h>
 
 namespace {
@@ -70,6 +73,8 @@ struct SignalService : public GenericSocketService {
         sigset_t mask;
         sigemptyset(&mask);
         sigaddset(&mask, SIGTERM);
+        sigaddset(&mask, SIGHUP);
+        sigaddset(&mask, SIGUSR1);
         if (-1 == pthread_sigmask(SIG_BLOCK, &mask, NULL))
             return -1;
         return signalfd(-1, &mask, 0);
@@ -101,10 +106,44 @@ struct SignalService : public GenericSocketService {
             return;
         }
 
+        if (siginfo->ssi_signo == SIGHUP) {
+            LogInfo("Got signal: SIGHUP, reloading policy");
+            CynaraDecisionCache::getInstance().flush();
+            return;
+        }
+
+        if (siginfo->ssi_signo == SIGUSR1) {
+            LogInfo("Got signal: SIGUSR1, dumping cache statistics");
+            CynaraDecisionCache::getInstance().logStats();
+            SmackLabelCache::getInstance().logStats();
+            return;
+        }
+
         LogInfo("This should not happend. Got signal: " << siginfo->ssi_signo);
     }
 };
 
+struct DescriptorService : public GenericSocketService {
+    explicit DescriptorService(const std::function<void(const RawBuffer &)> &handler)
+      : m_handler(handler)
+    {}
+
+    ServiceDescriptionVector GetServiceDescription() {
+        return ServiceDescriptionVector();
+    }
+
+    void Event(const AcceptEvent &event) { (void)event; } // not supported
+    void Event(const WriteEvent &event) { (void)event; }  // not supported
+    void Event(const CloseEvent &event) { (void)event; }  // not supported
+
+    void Event(const ReadEvent &event) {
+        m_handler(event.rawBuffer);
+    }
+
+private:
+    std::function<void(const RawBuffer &)> m_handler;
+};
+
 SocketManager::SocketDescription&
 SocketManager::CreateDefaultReadSocketDescription(int sock, bool timeout)
 {
@@ -591,6 +630,12 @@ void SocketManager::RegisterSocketService(GenericSocketService *service) {
     }
 }
 
+void SocketManager::RegisterDescriptor(int fd, const std::function<void(const RawBuffer &)> &handler) {
+    auto &desc = CreateDefaultReadSocketDescription(fd, false);
+    desc.service = new DescriptorService(handler);
+    LogInfo("DescriptorService mounted on " << fd << " descriptor");
+}
+
 void SocketManager::Close(ConnectionID connectionID) {
     {
         std::lock_guard<std::mutex> ulock(m_eventQueueMutex);
@@ -75,7 +75,11 @@ void BaseService::write(const WriteEvent &event)
              " Size: " << event.size <<
              " Left: " << event.left);
 
-    if (event.left == 0)
+    if (event.left != 0)
+        return;
+
+    auto it = m_connectionInfoMap.find(event.connectionID.counter);
+    if (it == m_connectionInfoMap.end() || !it->second.keepOpen)
         m_serviceManager->Close(event.connectionID);
 }
 
@@ -94,6 +94,17 @@ private:
      */
     void processGetAppGroups(MessageBuffer &buffer, MessageBuffer &send, uid_t uid, pid_t pid);
 
+    /**
+     * Process getting launch bundles (package, Smack label and permitted
+     * group ids) of a list of app ids
+     *
+     * @param  buffer Raw received data buffer
+     * @param  send   Raw data buffer to be sent
+     * @param  uid    User's identifier for whom applications will be launched
+     * @param  pid    Process id of the launcher
+     */
+    void processGetLaunchBundles(MessageBuffer &buffer, MessageBuffer &send, uid_t uid, pid_t pid);
+
     void processUserAdd(MessageBuffer &buffer, MessageBuffer &send, uid_t uid);
 
     void processUserDelete(MessageBuffer &buffer, MessageBuffer &send, uid_t uid);
@@ -136,6 +147,22 @@ private:
      */
     void processGetPolicy(MessageBuffer &buffer, MessageBuffer &send, uid_t uid, pid_t pid, const std::string &smackLabel);
 
+    /**
+     * Get one page of policy listing, either the whole policy (as in
+     * processGetPolicy) or admin enforced policies (as in
+     * processGetConfiguredPolicy). Request carries filter, the last entry of
+     * the previous page (if any) and requested page size, response carries the
+     * entries and a flag telling whether more entries follow.
+     *
+     * @param  buffer Raw received data buffer
+     * @param  send     Raw data buffer to be sent
+     * @param  uid      Identifier of the user who sent the request
+     * @param  pid      PID of the process which sent the request
+     * @param  smackLabel smack label of requesting app
+     * @param  configuredForAdmin list ADMIN bucket policies instead of whole policy
+     */
+    void processGetPolicyPage(MessageBuffer &buffer, MessageBuffer &send, uid_t uid, pid_t pid, const std::string &smackLabel, bool configuredForAdmin);
+
     /**
      * Process getting policies descriptions as strings from Cynara
      *
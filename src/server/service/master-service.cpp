@@ -171,17 +171,17 @@ void MasterService::processCynaraUpdatePolicy(MessageBuffer &buffer, MessageBuff
     std::string appId;
     std::string uidstr;
     std::vector<std::string> oldAppPrivileges, newAppPrivileges;
-    std::string appLabel, newLabel;
+    SmackLabelCache::Label appLabel;
 
     Deserialization::Deserialize(buffer, appId);
     Deserialization::Deserialize(buffer, uidstr);
     Deserialization::Deserialize(buffer, oldAppPrivileges);
     Deserialization::Deserialize(buffer, newAppPrivileges);
 
-    appLabel = zoneSmackLabelGenerate(SmackLabels::generateAppLabel(appId), zoneId);
+    appLabel = SmackLabelCache::getInstance().get(SmackLabelCache::Kind::APP, appId, zoneId);
 
     try {
-        CynaraAdmin::getInstance().UpdateAppPolicy(appLabel, uidstr, oldAppPrivileges,
+        CynaraAdmin::getInstance().UpdateAppPolicy(*appLabel, uidstr, oldAppPrivileges,
                                                    newAppPrivileges);
     } catch (const CynaraException::Base &e) {
         LogError("Error while setting Cynara rules for application: " << e.DumpToString());
@@ -326,20 +326,26 @@ void MasterService::processSmackInstallRules(MessageBuffer &buffer, MessageBuffe
     try {
         LogDebug("Adding Smack rules for new appId: " << appId << " with pkgId: "
                 << pkgId << ". Applications in package: " << pkgContents.size());
-        SmackRules::installApplicationRules(appId, pkgId, pkgContents, zoneId);
+        SmackRulesStore::Batch rulesBatch;
+        SmackRules::Stats ruleStats =
+            SmackRules::installApplicationRules(appId, pkgId, pkgContents, zoneId);
+        LogDebug("Kernel rules of appId " << appId << " applied: " << ruleStats.applied <<
+                ", cleared: " << ruleStats.cleared << ", unchanged: " << ruleStats.unchanged);
 
         // FIXME implement zoneSmackLabelMap and check if works when Smack Namespaces are implemented
-        std::string zoneAppLabel = SmackLabels::generateAppLabel(appId);
-        std::string zonePkgLabel = SmackLabels::generatePkgLabel(pkgId);
-        std::string hostAppLabel = zoneSmackLabelGenerate(zoneAppLabel, zoneId);
-        std::string hostPkgLabel = zoneSmackLabelGenerate(zonePkgLabel, zoneId);
-
-        if (!zoneSmackLabelMap(hostAppLabel, zoneId, zoneAppLabel)) {
+        SmackLabelCache::Label zoneAppLabel =
+            SmackLabelCache::getInstance().get(SmackLabelCache::Kind::APP, appId);
+        SmackLabelCache::Label zonePkgLabel =
+            SmackLabelCache::getInstance().get(SmackLabelCache::Kind::PKG, pkgId);
+        std::string hostAppLabel = zoneSmackLabelGenerate(*zoneAppLabel, zoneId);
+        std::string hostPkgLabel = zoneSmackLabelGenerate(*zonePkgLabel, zoneId);
+
+        if (!zoneSmackLabelMap(hostAppLabel, zoneId, *zoneAppLabel)) {
             LogError("Failed to apply Smack label mapping for application " << appId);
             goto out;
         }
 
-        if (!zoneSmackLabelMap(hostPkgLabel, zoneId, zonePkgLabel)) {
+        if (!zoneSmackLabelMap(hostPkgLabel, zoneId, *zonePkgLabel)) {
             LogError("Failed to apply Smack label mapping for package " << pkgId);
             goto out;
         }
@@ -372,19 +378,25 @@ void MasterService::processSmackUninstallRules(MessageBuffer &buffer, MessageBuf
     Deserialization::Deserialize(buffer, removePkg);
 
     try {
+        SmackRulesStore::Batch rulesBatch;
+        SmackRules::Stats ruleStats = {0, 0, 0};
         if (removePkg) {
             LogDebug("Removing Smack rules for deleted pkgId " << pkgId);
-            SmackRules::uninstallPackageRules(pkgId);
+            ruleStats += SmackRules::uninstallPackageRules(pkgId);
         }
 
         LogDebug ("Removing smack rules for deleted appId " << appId);
-        SmackRules::uninstallApplicationRules(appId, pkgId, pkgContents, zoneId);
+        ruleStats += SmackRules::uninstallApplicationRules(appId, pkgId, pkgContents, zoneId);
+        LogDebug("Kernel rules of appId " << appId << " cleared: " << ruleStats.cleared <<
+                ", applied: " << ruleStats.applied);
 
         // FIXME implement zoneSmackLabelUnmap and check if works when Smack Namespaces are implemented
-        std::string zoneAppLabel = SmackLabels::generateAppLabel(appId);
-        std::string zonePkgLabel = SmackLabels::generatePkgLabel(pkgId);
-        std::string hostAppLabel = zoneSmackLabelGenerate(zoneAppLabel, zoneId);
-        std::string hostPkgLabel = zoneSmackLabelGenerate(zonePkgLabel, zoneId);
+        SmackLabelCache::Label zoneAppLabel =
+            SmackLabelCache::getInstance().get(SmackLabelCache::Kind::APP, appId);
+        SmackLabelCache::Label zonePkgLabel =
+            SmackLabelCache::getInstance().get(SmackLabelCache::Kind::PKG, pkgId);
+        std::string hostAppLabel = zoneSmackLabelGenerate(*zoneAppLabel, zoneId);
+        std::string hostPkgLabel = zoneSmackLabelGenerate(*zonePkgLabel, zoneId);
 
         if (!zoneSmackLabelUnmap(hostAppLabel, zoneId)) {
             LogError("Failed to unmap Smack labels for application " << appId);
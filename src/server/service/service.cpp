@@ -25,11 +25,16 @@
 
 #include <sys/socket.h>
 
+#include <algorithm>
+#include <chrono>
+
 #include <dpl/log/log.h>
 #include <dpl/serialization.h>
 #include <sys/smack.h>
 
+#include "app-snapshot.h"
 #include "connection.h"
+#include "cynara.h"
 #include "protocols.h"
 #include "service.h"
 #include "service_impl.h"
@@ -39,9 +44,16 @@ namespace SecurityManager {
 
 const InterfaceID IFACE = 1;
 
+/* Time to collect changes before publishing application snapshot */
+const std::chrono::milliseconds APP_SNAPSHOT_PUBLISH_DELAY(200);
+
 Service::Service(const bool isSlave):
         m_isSlave(isSlave)
 {
+    if (!m_isSlave && CynaraAdmin::HasLostPolicies())
+        ServiceImpl::restoreAppPolicies();
+
+    ServiceImpl::publishAppSnapshot();
 }
 
 GenericSocketService::ServiceDescriptionVector Service::GetServiceDescription()
@@ -99,6 +111,11 @@ bool Service::processOne(const ConnectionID &conn, MessageBuffer &buffer,
                     LogDebug("call_type: SecurityModuleCall::NOOP");
                     Serialization::Serialize(send, SECURITY_MANAGER_API_SUCCESS);
                     break;
+                case SecurityModuleCall::KEEP_CONNECTION:
+                    LogDebug("call_type: SecurityModuleCall::KEEP_CONNECTION");
+                    m_connectionInfoMap[conn.counter].keepOpen = true;
+                    Serialization::Serialize(send, SECURITY_MANAGER_API_SUCCESS);
+                    break;
                 case SecurityModuleCall::APP_INSTALL:
                     LogDebug("call_type: SecurityModuleCall::APP_INSTALL");
                     processAppInstall(buffer, send, uid);
@@ -113,6 +130,9 @@ bool Service::processOne(const ConnectionID &conn, MessageBuffer &buffer,
                 case SecurityModuleCall::APP_GET_GROUPS:
                     processGetAppGroups(buffer, send, uid, pid);
                     break;
+                case SecurityModuleCall::APP_GET_LAUNCH_BUNDLES:
+                    processGetLaunchBundles(buffer, send, uid, pid);
+                    break;
                 case SecurityModuleCall::USER_ADD:
                     processUserAdd(buffer, send, uid);
                     break;
@@ -131,6 +151,12 @@ bool Service::processOne(const ConnectionID &conn, MessageBuffer &buffer,
                 case SecurityModuleCall::GET_POLICY:
                     processGetPolicy(buffer, send, uid, pid, smackLabel);
                     break;
+                case SecurityModuleCall::GET_POLICY_PAGE:
+                    processGetPolicyPage(buffer, send, uid, pid, smackLabel, false);
+                    break;
+                case SecurityModuleCall::GET_CONF_POLICY_ADMIN_PAGE:
+                    processGetPolicyPage(buffer, send, uid, pid, smackLabel, true);
+                    break;
                 case SecurityModuleCall::POLICY_GET_DESCRIPTIONS:
                     processPolicyGetDesc(send);
                     break;
@@ -168,6 +194,9 @@ bool Service::processOne(const ConnectionID &conn, MessageBuffer &buffer,
         m_serviceManager->Close(conn);
     }
 
+    if (AppSnapshotWriter::isOutdated())
+        Defer(&ServiceImpl::publishAppSnapshot, APP_SNAPSHOT_PUBLISH_DELAY);
+
     return retval;
 }
 
@@ -221,6 +250,33 @@ void Service::processGetAppGroups(MessageBuffer &buffer, MessageBuffer &send, ui
     }
 }
 
+void Service::processGetLaunchBundles(MessageBuffer &buffer, MessageBuffer &send, uid_t uid,
+    pid_t pid)
+{
+    std::vector<std::string> appIds;
+
+    Deserialization::Deserialize(buffer, appIds);
+    if (appIds.empty() || appIds.size() > LAUNCH_BUNDLES_MAX) {
+        Serialization::Serialize(send, SECURITY_MANAGER_API_ERROR_INPUT_PARAM);
+        return;
+    }
+
+    Serialization::Serialize(send, SECURITY_MANAGER_API_SUCCESS);
+    for (const auto &appId : appIds) {
+        std::string pkgId;
+        SmackLabelCache::Label label;
+        std::unordered_set<gid_t> gids;
+
+        int ret = serviceImpl.getAppLaunchBundle(appId, uid, pid, m_isSlave, pkgId, label, gids);
+        Serialization::Serialize(send, ret);
+        if (ret == SECURITY_MANAGER_API_SUCCESS) {
+            Serialization::Serialize(send, pkgId, *label, static_cast<int>(gids.size()));
+            for (const auto &gid : gids)
+                Serialization::Serialize(send, gid);
+        }
+    }
+}
+
 void Service::processUserAdd(MessageBuffer &buffer, MessageBuffer &send, uid_t uid)
 {
     int ret;
@@ -301,6 +357,62 @@ void Service::processGetPolicy(MessageBuffer &buffer, MessageBuffer &send, uid_t
     };
 }
 
+void Service::processGetPolicyPage(MessageBuffer &buffer, MessageBuffer &send, uid_t uid, pid_t pid, const std::string &smackLabel, bool configuredForAdmin)
+{
+    int ret;
+    policy_entry filter;
+    bool hasCursor;
+    unsigned int pageSize;
+    Deserialization::Deserialize(buffer, filter);
+    Deserialization::Deserialize(buffer, hasCursor);
+    policy_entry cursor;
+    if (hasCursor)
+        Deserialization::Deserialize(buffer, cursor);
+    Deserialization::Deserialize(buffer, pageSize);
+    std::vector<policy_entry> policyEntries;
+
+    pageSize = std::min(std::max(pageSize, 1u), POLICY_PAGE_SIZE_MAX);
+
+    if (m_isSlave) {
+        // Master protocol has no paging, fetch everything and cut the page out
+        if (configuredForAdmin)
+            ret = MasterReq::GetConfiguredPolicy(true, filter, uid, pid, smackLabel, policyEntries);
+        else
+            ret = MasterReq::GetPolicy(filter, uid, pid, smackLabel, policyEntries);
+
+        if (hasCursor) {
+            auto it = std::find_if(policyEntries.begin(), policyEntries.end(),
+                [&](const policy_entry &pe) {
+                    return pe.appId == cursor.appId && pe.user == cursor.user &&
+                        pe.privilege == cursor.privilege;
+                });
+            policyEntries.erase(policyEntries.begin(),
+                it == policyEntries.end() ? it : it + 1);
+        }
+        if (policyEntries.size() > pageSize + 1)
+            policyEntries.resize(pageSize + 1);
+    } else {
+        // One entry more than requested tells whether there is a next page
+        if (configuredForAdmin)
+            ret = serviceImpl.getConfiguredPolicyPage(filter, uid, pid, smackLabel,
+                policyEntries, hasCursor ? &cursor : nullptr, pageSize + 1);
+        else
+            ret = serviceImpl.getPolicy(filter, uid, pid, smackLabel,
+                policyEntries, hasCursor ? &cursor : nullptr, pageSize + 1);
+    }
+
+    bool more = policyEntries.size() > pageSize;
+    if (more)
+        policyEntries.resize(pageSize);
+
+    Serialization::Serialize(send, ret);
+    Serialization::Serialize(send, static_cast<int>(policyEntries.size()));
+    for (const auto &policyEntry : policyEntries) {
+        Serialization::Serialize(send, policyEntry);
+    };
+    Serialization::Serialize(send, more);
+}
+
 void Service::processPolicyGetDesc(MessageBuffer &send)
 {
     int ret;